@@ -4,16 +4,124 @@ CREATE TYPE todo_item_status AS ENUM (
     'Not Started'    
 );
 
+-- Lets the GIN indexes lead with the list_id partition key
+CREATE EXTENSION IF NOT EXISTS btree_gin;
+
+-- Tag dictionary: every distinct tag name is stored once, items refer to it
+-- by id. Ids come from a sequence and are never reused, which lets the
+-- service cache id -> name mappings for good.
+CREATE TABLE IF NOT EXISTS Tags (
+    id   SERIAL PRIMARY KEY,
+    name TEXT NOT NULL UNIQUE
+);
+
+-- Ids for `names`, in order, adding the names not in the dictionary yet.
+-- New names are inserted in one statement, deduplicated and sorted, so two
+-- transactions interning overlapping sets take the unique index's locks in
+-- the same order and cannot deadlock on each other. A name inserted by a
+-- concurrent transaction is skipped by ON CONFLICT once that one commits,
+-- and the lookup afterwards sees it.
+CREATE OR REPLACE FUNCTION intern_tags(names TEXT[]) RETURNS INTEGER[] AS $$
+BEGIN
+    INSERT INTO Tags (name)
+    SELECT DISTINCT n.name FROM unnest(coalesce(names, '{}')) AS n(name)
+    WHERE NOT EXISTS (SELECT 1 FROM Tags t WHERE t.name = n.name)
+    ORDER BY n.name
+    ON CONFLICT (name) DO NOTHING;
+
+    RETURN (
+        SELECT coalesce(array_agg(t.id ORDER BY n.ord), '{}')
+        FROM unnest(coalesce(names, '{}')) WITH ORDINALITY AS n(name, ord)
+        JOIN Tags t ON t.name = n.name
+    );
+END $$ LANGUAGE plpgsql;
+
+-- Names for tag ids, in order; used where rows are rendered in SQL (export)
+CREATE OR REPLACE FUNCTION tag_names(ids INTEGER[]) RETURNS TEXT[] AS $$
+    SELECT coalesce(array_agg(t.name ORDER BY u.ord), '{}')
+    FROM unnest(ids) WITH ORDINALITY AS u(id, ord)
+    JOIN Tags t ON t.id = u.id
+$$ LANGUAGE sql STABLE;
+
+-- Orders row changes (inserts, updates, deletes) for incremental catch-up
+CREATE SEQUENCE IF NOT EXISTS todoitems_version_seq;
+
+-- Items are hash-partitioned by list. Every query the service issues filters on
+-- list_id, so Postgres prunes to a single partition; the unscoped /todos routes
+-- use the nil-UUID default list.
 CREATE TABLE ToDoItems (
-    id          UUID PRIMARY KEY DEFAULT gen_random_uuid(),
+    list_id     UUID NOT NULL DEFAULT '00000000-0000-0000-0000-000000000000',
+    id          UUID NOT NULL DEFAULT gen_random_uuid(),
     name        TEXT NOT NULL,
     description TEXT,
     due_date    TIMESTAMPTZ,
     status      todo_item_status NOT NULL DEFAULT 'Not Started',
     priority    INTEGER DEFAULT 3 CHECK (priority BETWEEN 1 AND 5),
-    tags        TEXT[] DEFAULT '{}'
+    -- Tags as ids into the Tags dictionary (see intern_tags)
+    tag_ids     INTEGER[] NOT NULL DEFAULT '{}',
+    -- Set on every insert and update (todoitems_version); snapshots catch up by it
+    version     BIGINT NOT NULL DEFAULT 0,
+    -- Full-text search over name (weight A) and description (weight B)
+    search_vector TSVECTOR GENERATED ALWAYS AS (
+        setweight(to_tsvector('simple', coalesce(name, '')), 'A') ||
+        setweight(to_tsvector('simple', coalesce(description, '')), 'B')
+    ) STORED,
+    PRIMARY KEY (list_id, id)
+) PARTITION BY HASH (list_id);
+
+DO $$
+BEGIN
+    FOR i IN 0..15 LOOP
+        EXECUTE format(
+            'CREATE TABLE IF NOT EXISTS todoitems_p%s PARTITION OF ToDoItems '
+            'FOR VALUES WITH (MODULUS 16, REMAINDER %s)', i, i);
+    END LOOP;
+END $$;
+
+-- Indexes on the partitioned table are created on every partition
+CREATE INDEX IF NOT EXISTS idx_todoitems_priority ON ToDoItems (list_id, priority);
+
+CREATE INDEX IF NOT EXISTS idx_todoitems_due_date ON ToDoItems (list_id, due_date);
+
+-- Serves the tag filters: containment (@>) and overlap (&&) of tag_ids
+CREATE INDEX IF NOT EXISTS idx_todoitems_tag_ids ON ToDoItems USING GIN (list_id, tag_ids);
+
+CREATE INDEX IF NOT EXISTS idx_todoitems_search ON ToDoItems USING GIN (list_id, search_vector);
+
+CREATE INDEX IF NOT EXISTS idx_todoitems_version ON ToDoItems (version);
+
+-- Deleted ids with the version of their deletion, so a snapshot that still
+-- holds them can drop them when it catches up. Rows older than the oldest
+-- snapshot in use can be removed.
+CREATE TABLE IF NOT EXISTS ToDoItemTombstones (
+    list_id UUID NOT NULL,
+    id      UUID NOT NULL,
+    version BIGINT NOT NULL,
+    PRIMARY KEY (list_id, id)
 );
 
-CREATE INDEX IF NOT EXISTS idx_todoitems_priority ON ToDoItems (priority);
+CREATE INDEX IF NOT EXISTS idx_todoitem_tombstones_version ON ToDoItemTombstones (version);
+
+-- The transaction takes its id before drawing a version, so a catch-up can
+-- tell from the running transaction ids when every version up to a point
+-- has committed or rolled back (see VersionFence in DbAccess.hpp)
+CREATE OR REPLACE FUNCTION todoitems_bump_version() RETURNS trigger AS $$
+BEGIN
+    PERFORM pg_current_xact_id();
+    NEW.version := nextval('todoitems_version_seq');
+    RETURN NEW;
+END $$ LANGUAGE plpgsql;
+
+CREATE OR REPLACE FUNCTION todoitems_record_delete() RETURNS trigger AS $$
+BEGIN
+    INSERT INTO ToDoItemTombstones (list_id, id, version)
+    VALUES (OLD.list_id, OLD.id, nextval('todoitems_version_seq'))
+    ON CONFLICT (list_id, id) DO UPDATE SET version = EXCLUDED.version;
+    RETURN OLD;
+END $$ LANGUAGE plpgsql;
+
+CREATE TRIGGER todoitems_version BEFORE INSERT OR UPDATE ON ToDoItems
+    FOR EACH ROW EXECUTE FUNCTION todoitems_bump_version();
 
-CREATE INDEX IF NOT EXISTS idx_todoitems_tags ON ToDoItems USING GIN (tags);
\ No newline at end of file
+CREATE TRIGGER todoitems_tombstone AFTER DELETE ON ToDoItems
+    FOR EACH ROW EXECUTE FUNCTION todoitems_record_delete();
@@ -0,0 +1,786 @@
+#ifndef CONNECTION_POOL_HPP
+#define CONNECTION_POOL_HPP
+
+#include <pqxx/pqxx>
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <future>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+using namespace std;
+
+// Sizing and health-check knobs for ConnectionPool
+//
+struct PoolOptions
+{
+    size_t min_size = 5;
+    size_t max_size = 20;
+
+    // How long get() waits for a connection before giving up
+    chrono::milliseconds acquire_timeout{2000};
+
+    // A lease that has waited this long opens another connection (up to max_size)
+    chrono::milliseconds grow_after_wait{20};
+
+    // Idle connections above min_size are closed after this long
+    chrono::seconds idle_timeout{60};
+
+    // Idle connections are pinged by the maintenance thread this often
+    chrono::seconds health_check_interval{10};
+
+    chrono::seconds maintenance_interval{5};
+
+    // Each thread keeps the connection it last released and takes it back on
+    // its next lease, and other returns go to a lock-free free-list; the mutex
+    // is only taken on a miss. Parked connections can still be taken over by
+    // other threads, so nothing is pinned to an idle thread, and the
+    // maintenance thread only collects the ones that sat unused long enough
+    // to need a health check or to be closed.
+    bool thread_affine = false;
+};
+
+// Counters exposed for monitoring
+//
+struct PoolStats
+{
+    size_t open = 0;        // connections owned by the pool, leased or idle
+    size_t idle = 0;
+    size_t leases = 0;
+    size_t timeouts = 0;
+    size_t grown = 0;
+    size_t shrunk = 0;
+    size_t reconnects = 0;  // broken connections that were dropped
+    double avg_wait_ms = 0; // moving average of the time get() waited
+    double max_wait_ms = 0;
+
+    // Contention: how often the pool mutex was taken, and how often a thread
+    // had to block for it
+    size_t mutex_acquisitions = 0;
+    size_t mutex_contended = 0;
+
+    // Thread-affine mode: leases served without the mutex
+    size_t thread_hits = 0;     // the thread's own parked connection
+    size_t shared_hits = 0;     // the lock-free free-list
+    size_t steals = 0;          // another thread's parked connection
+};
+
+class ConnectionPool;
+
+// A leased connection: a plain, move-only handle that gives the connection
+// back to its pool when it goes out of scope.
+//
+class ConnectionLease
+{
+public:
+    ConnectionLease() = default;
+
+    ConnectionLease(ConnectionPool* pool, pqxx::connection* conn) : pool_(pool), conn_(conn) {}
+
+    ConnectionLease(ConnectionLease&& other) noexcept
+        : pool_(other.pool_), conn_(exchange(other.conn_, nullptr))
+    {
+    }
+
+    ConnectionLease& operator=(ConnectionLease&& other) noexcept
+    {
+        if (this != &other)
+        {
+            reset();
+            pool_ = other.pool_;
+            conn_ = exchange(other.conn_, nullptr);
+        }
+        return *this;
+    }
+
+    ConnectionLease(const ConnectionLease&) = delete;
+    ConnectionLease& operator=(const ConnectionLease&) = delete;
+
+    ~ConnectionLease()
+    {
+        reset();
+    }
+
+    inline void reset();
+
+    explicit operator bool() const { return conn_ != nullptr; }
+    pqxx::connection& operator*() const { return *conn_; }
+    pqxx::connection* operator->() const { return conn_; }
+
+private:
+    ConnectionPool* pool_ = nullptr;
+    pqxx::connection* conn_ = nullptr;
+};
+
+// A self-healing pool of libpqxx connections for one server.
+//
+// Leased connections come back automatically when their ConnectionLease goes
+// out of scope, so an exception between get() and the end of a transaction can
+// no longer leak a connection. Broken connections are discarded on return and
+// replaced, idle connections are pinged in the background, and the pool grows
+// towards max_size when leases have to wait and shrinks back to min_size once
+// connections sit idle.
+//
+class ConnectionPool
+{
+public:
+    ConnectionPool(const string& conn_str, PoolOptions options = {})
+        : conn_str_(conn_str), options_(options), id_(next_pool_id_++),
+          affine_(make_shared<AffineSlots>(options.max_size < options.min_size ? options.min_size : options.max_size))
+    {
+        if (options_.max_size < options_.min_size)
+        {
+            options_.max_size = options_.min_size;
+        }
+
+        // Open the initial connections in parallel rather than one after another
+        total_ = options_.min_size;
+        auto now = chrono::steady_clock::now();
+        for (auto& conn : open_connections(options_.min_size))
+        {
+            if (conn)
+            {
+                idle_.push_back({move(conn), now, now});
+            }
+            else
+            {
+                --total_;
+            }
+        }
+        if (total_ < options_.min_size)
+        {
+            cerr << "Connection pool started with " << total_ << " of " << options_.min_size
+                 << " connections; the rest will be retried in the background\n";
+        }
+
+        maintenance_ = thread([this] { maintain(); });
+    }
+
+    ~ConnectionPool()
+    {
+        {
+            lock_guard<mutex> lock(mtx_);
+            stopping_ = true;
+        }
+        wake_.notify_all();
+        if (maintenance_.joinable())
+        {
+            maintenance_.join();
+        }
+        for (auto& parked : DrainAffine())
+        {
+            delete parked.first;
+        }
+    }
+
+    ConnectionPool(const ConnectionPool&) = delete;
+    ConnectionPool& operator=(const ConnectionPool&) = delete;
+
+    // Leases a connection, or returns an empty lease if none became available
+    // within acquire_timeout (or by `not_after`, if that comes first). The
+    // connection returns to the pool when the lease is destroyed.
+    //
+    ConnectionLease get(chrono::steady_clock::time_point not_after = chrono::steady_clock::time_point::max())
+    {
+        if (options_.thread_affine)
+        {
+            while (auto* conn = TakeAffine())
+            {
+                if (conn->is_open())
+                {
+                    MyCounters().fast_leases.fetch_add(1, memory_order_relaxed);
+                    return ConnectionLease(this, conn);
+                }
+                give_back(unique_ptr<pqxx::connection>(conn));  // counts and drops it
+            }
+        }
+
+        auto started = chrono::steady_clock::now();
+        auto deadline = min(started + options_.acquire_timeout, not_after);
+        auto grow_at = started + options_.grow_after_wait;
+
+        unique_lock<mutex> lock(mtx_, defer_lock);
+        LockCounted(lock);
+        WaiterGuard waiting(*this);
+        for (;;)
+        {
+            if (options_.thread_affine)
+            {
+                // Catches connections parked after this thread missed them above
+                if (auto* conn = TakeAffine())
+                {
+                    if (!conn->is_open())
+                    {
+                        delete conn;
+                        --total_;
+                        ++reconnects_;
+                        continue;
+                    }
+                    record_wait(started);
+                    MyCounters().fast_leases.fetch_add(1, memory_order_relaxed);
+                    return ConnectionLease(this, conn);
+                }
+            }
+            if (!idle_.empty())
+            {
+                auto entry = move(idle_.back());
+                idle_.pop_back();
+                if (!entry.conn->is_open())
+                {
+                    --total_;
+                    ++reconnects_;
+                    continue;
+                }
+                record_wait(started);
+                return wrap(move(entry.conn));
+            }
+
+            auto now = chrono::steady_clock::now();
+            bool below_min = total_ < options_.min_size;
+            bool waited_too_long = now >= grow_at && total_ < options_.max_size;
+            if (below_min || waited_too_long)
+            {
+                ++total_;
+                if (!below_min) ++grown_;
+                lock.unlock();
+                auto conn = open_connection();
+                lock.lock();
+                if (conn)
+                {
+                    record_wait(started);
+                    return wrap(move(conn));
+                }
+                --total_;
+                ++timeouts_;
+                return {};  // the server is unreachable, don't keep callers waiting
+            }
+
+            if (now >= deadline)
+            {
+                ++timeouts_;
+                return {};
+            }
+            auto wake_at = (total_ < options_.max_size && grow_at < deadline) ? grow_at : deadline;
+            if (wake_at <= now)
+            {
+                wake_at = deadline;
+            }
+            available_.wait_until(lock, wake_at);
+        }
+    }
+
+    PoolStats stats() const
+    {
+        lock_guard<mutex> lock(mtx_);
+        PoolStats s;
+        s.open = total_;
+        s.idle = idle_.size() + CountAffine();
+        s.leases = leases_;
+        s.timeouts = timeouts_;
+        s.grown = grown_;
+        s.shrunk = shrunk_;
+        s.reconnects = reconnects_;
+        s.avg_wait_ms = avg_wait_ms_;
+        s.max_wait_ms = max_wait_ms_;
+        s.mutex_acquisitions = mutex_acquisitions_;
+        s.mutex_contended = mutex_contended_;
+        auto add = [&s](const LeaseCounters& counters) {
+            s.leases += counters.fast_leases.load(memory_order_relaxed);
+            s.thread_hits += counters.thread_hits.load(memory_order_relaxed);
+            s.shared_hits += counters.shared_hits.load(memory_order_relaxed);
+            s.steals += counters.steals.load(memory_order_relaxed);
+        };
+        for (const auto& slot : affine_->threads)
+        {
+            add(slot.counters);
+        }
+        add(affine_->unslotted);
+        return s;
+    }
+
+private:
+    friend class ConnectionLease;
+
+    // Upper bound on threads that get a parking slot of their own; further
+    // threads only use the shared free-list
+    static constexpr size_t kMaxThreadSlots = 256;
+
+    enum SlotState { kSlotFree, kSlotOwned };
+
+    // Lock-free lease counters. Each thread slot has its own, written only by
+    // the thread that owns the slot, so counting shares no cache line between
+    // threads; stats() sums them. They outlive the owning thread with the slot.
+    struct LeaseCounters
+    {
+        atomic<size_t> fast_leases{0};
+        atomic<size_t> thread_hits{0};    // the thread's own parked connection
+        atomic<size_t> shared_hits{0};    // the lock-free free-list
+        atomic<size_t> steals{0};         // another thread's parked connection
+    };
+
+    // A parked connection and when it was parked (steady clock ticks), so
+    // that maintenance leaves recently used ones where they are
+    struct alignas(64) ParkingSlot
+    {
+        atomic<pqxx::connection*> conn{nullptr};
+        atomic<int64_t> parked_at{0};
+    };
+
+    struct alignas(64) ThreadSlot : ParkingSlot
+    {
+        atomic<int> state{kSlotFree};
+        LeaseCounters counters;
+    };
+
+    // Lock-free parking places for idle connections. Shared with the
+    // thread-local slot references so that a thread exiting after the pool
+    // is gone never touches freed memory.
+    struct AffineSlots
+    {
+        explicit AffineSlots(size_t shared_size) : shared(shared_size) {}
+
+        array<ThreadSlot, kMaxThreadSlots> threads;
+        vector<ParkingSlot> shared;
+        LeaseCounters unslotted;    // threads beyond kMaxThreadSlots
+    };
+
+    // A thread's claim on one ThreadSlot of one pool; released on thread exit.
+    // A connection still parked there stays in the pool for others to take.
+    struct ThreadSlotRef
+    {
+        uint64_t pool_id;
+        ThreadSlot* slot;
+        shared_ptr<AffineSlots> owner;
+
+        ThreadSlotRef(uint64_t id, ThreadSlot* s, shared_ptr<AffineSlots> o) : pool_id(id), slot(s), owner(move(o)) {}
+        ThreadSlotRef(ThreadSlotRef&& other) noexcept
+            : pool_id(other.pool_id), slot(exchange(other.slot, nullptr)), owner(move(other.owner))
+        {
+        }
+        ThreadSlotRef& operator=(ThreadSlotRef&&) = delete;
+
+        ~ThreadSlotRef()
+        {
+            if (slot != nullptr) slot->state.store(kSlotFree);
+        }
+    };
+
+    // Counts threads blocked in get() so that returns go through the mutex
+    // (and wake them) while anyone is waiting
+    struct WaiterGuard
+    {
+        ConnectionPool& pool;
+        explicit WaiterGuard(ConnectionPool& p) : pool(p) { ++pool.waiters_; }
+        ~WaiterGuard() { --pool.waiters_; }
+    };
+
+    // Takes mtx_, counting the acquisition and whether it had to block
+    //
+    void LockCounted(unique_lock<mutex>& lock)
+    {
+        if (!lock.try_lock())
+        {
+            ++mutex_contended_;
+            lock.lock();
+        }
+        ++mutex_acquisitions_;
+    }
+
+    // The calling thread's slot in this pool, claimed on first use; nullptr
+    // when every slot is taken
+    //
+    ThreadSlot* MySlot()
+    {
+        thread_local vector<ThreadSlotRef> refs;
+        for (const auto& ref : refs)
+        {
+            if (ref.pool_id == id_) return ref.slot;
+        }
+        for (auto& slot : affine_->threads)
+        {
+            int expected = kSlotFree;
+            if (slot.state.load(memory_order_relaxed) == kSlotFree && slot.state.compare_exchange_strong(expected, kSlotOwned))
+            {
+                refs.emplace_back(id_, &slot, affine_);
+                return &slot;
+            }
+        }
+        refs.emplace_back(id_, nullptr, affine_);
+        return nullptr;
+    }
+
+    LeaseCounters& MyCounters()
+    {
+        ThreadSlot* mine = MySlot();
+        return mine != nullptr ? mine->counters : affine_->unslotted;
+    }
+
+    static int64_t Ticks(chrono::steady_clock::time_point at)
+    {
+        return at.time_since_epoch().count();
+    }
+
+    // Lock-free lease: own slot, then the shared free-list, then any other
+    // thread's slot. The caller checks the connection is still open. The
+    // loads pair with the waiters_ check in ParkAffine, so they stay seq_cst.
+    //
+    pqxx::connection* TakeAffine()
+    {
+        ThreadSlot* mine = MySlot();
+        LeaseCounters& counters = mine != nullptr ? mine->counters : affine_->unslotted;
+        pqxx::connection* conn = nullptr;
+        if (mine != nullptr && (conn = mine->conn.exchange(nullptr)) != nullptr)
+        {
+            counters.thread_hits.fetch_add(1, memory_order_relaxed);
+            return conn;
+        }
+        for (auto& slot : affine_->shared)
+        {
+            if (slot.conn.load() != nullptr && (conn = slot.conn.exchange(nullptr)) != nullptr)
+            {
+                counters.shared_hits.fetch_add(1, memory_order_relaxed);
+                return conn;
+            }
+        }
+        for (auto& slot : affine_->threads)
+        {
+            if (&slot != mine && slot.conn.load() != nullptr && (conn = slot.conn.exchange(nullptr)) != nullptr)
+            {
+                counters.steals.fetch_add(1, memory_order_relaxed);
+                return conn;
+            }
+        }
+        return nullptr;
+    }
+
+    // Parks `conn` in the calling thread's slot or the shared free-list.
+    // Returns false when there is no room or a thread is waiting in get().
+    //
+    bool ParkAffine(pqxx::connection* conn)
+    {
+        if (waiters_.load() > 0 || !conn->is_open())
+        {
+            return false;
+        }
+        // The time goes in before the connection is published; a slot that is
+        // taken and refilled in between only makes it look younger
+        int64_t now = Ticks(chrono::steady_clock::now());
+        atomic<pqxx::connection*>* parked = nullptr;
+        pqxx::connection* expected = nullptr;
+        ThreadSlot* mine = MySlot();
+        if (mine != nullptr && mine->conn.load(memory_order_relaxed) == nullptr)
+        {
+            mine->parked_at.store(now);
+            if (mine->conn.compare_exchange_strong(expected, conn))
+            {
+                parked = &mine->conn;
+            }
+        }
+        if (parked == nullptr)
+        {
+            for (auto& slot : affine_->shared)
+            {
+                expected = nullptr;
+                if (slot.conn.load(memory_order_relaxed) == nullptr)
+                {
+                    slot.parked_at.store(now);
+                    if (slot.conn.compare_exchange_strong(expected, conn))
+                    {
+                        parked = &slot.conn;
+                        break;
+                    }
+                }
+            }
+        }
+        if (parked == nullptr)
+        {
+            return false;
+        }
+
+        // A thread may have started waiting after the check above; if so hand
+        // the connection over through the mutex path unless someone took it already
+        if (waiters_.load() > 0)
+        {
+            expected = conn;
+            if (parked->compare_exchange_strong(expected, nullptr))
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // Takes the connections parked before `parked_before` out of the
+    // lock-free parking places, with the time each was parked; the caller
+    // takes ownership. The default empties every place.
+    //
+    vector<pair<pqxx::connection*, chrono::steady_clock::time_point>> DrainAffine(
+        chrono::steady_clock::time_point parked_before = chrono::steady_clock::time_point::max())
+    {
+        vector<pair<pqxx::connection*, chrono::steady_clock::time_point>> conns;
+        auto drain = [&](ParkingSlot& slot) {
+            pqxx::connection* conn = slot.conn.load();
+            if (conn == nullptr) return;
+            chrono::steady_clock::time_point parked_at{chrono::steady_clock::duration(slot.parked_at.load())};
+            if (parked_at < parked_before && slot.conn.compare_exchange_strong(conn, nullptr))
+            {
+                conns.emplace_back(conn, parked_at);
+            }
+        };
+        for (auto& slot : affine_->shared)
+        {
+            drain(slot);
+        }
+        for (auto& slot : affine_->threads)
+        {
+            drain(slot);
+        }
+        return conns;
+    }
+
+    size_t CountAffine() const
+    {
+        size_t count = 0;
+        for (const auto& slot : affine_->shared)
+        {
+            if (slot.conn.load(memory_order_relaxed) != nullptr) ++count;
+        }
+        for (const auto& slot : affine_->threads)
+        {
+            if (slot.conn.load(memory_order_relaxed) != nullptr) ++count;
+        }
+        return count;
+    }
+
+    void Release(pqxx::connection* conn)
+    {
+        if (options_.thread_affine && ParkAffine(conn))
+        {
+            return;
+        }
+        give_back(unique_ptr<pqxx::connection>(conn));
+    }
+    struct IdleConnection
+    {
+        unique_ptr<pqxx::connection> conn;
+        chrono::steady_clock::time_point idle_since;
+        chrono::steady_clock::time_point checked_at;
+    };
+
+    unique_ptr<pqxx::connection> open_connection()
+    {
+        try
+        {
+            return make_unique<pqxx::connection>(conn_str_);
+        }
+        catch (const exception& e)
+        {
+            cerr << "Failed to open database connection: " << e.what() << "\n";
+            return nullptr;
+        }
+    }
+
+    vector<unique_ptr<pqxx::connection>> open_connections(size_t count)
+    {
+        vector<future<unique_ptr<pqxx::connection>>> pending;
+        for (size_t i = 0; i < count; ++i)
+        {
+            pending.push_back(async(launch::async, [this] { return open_connection(); }));
+        }
+        vector<unique_ptr<pqxx::connection>> conns;
+        for (auto& f : pending)
+        {
+            conns.push_back(f.get());
+        }
+        return conns;
+    }
+
+    // Hands out `conn` as a lease that puts it back into the pool. Caller holds mtx_.
+    //
+    ConnectionLease wrap(unique_ptr<pqxx::connection> conn)
+    {
+        ++leases_;
+        return ConnectionLease(this, conn.release());
+    }
+
+    void give_back(unique_ptr<pqxx::connection> conn)
+    {
+        {
+            unique_lock<mutex> lock(mtx_, defer_lock);
+            LockCounted(lock);
+            if (conn->is_open() && !stopping_)
+            {
+                auto now = chrono::steady_clock::now();
+                idle_.push_back({move(conn), now, now});
+            }
+            else
+            {
+                --total_;
+                ++reconnects_;
+            }
+        }
+        available_.notify_one();
+        // a dropped connection is closed here, outside the lock
+    }
+
+    // Caller holds mtx_
+    void record_wait(chrono::steady_clock::time_point started)
+    {
+        double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - started).count();
+        avg_wait_ms_ = avg_wait_ms_ * 0.9 + ms * 0.1;
+        if (ms > max_wait_ms_) max_wait_ms_ = ms;
+    }
+
+    static bool ping(pqxx::connection& conn)
+    {
+        try
+        {
+            pqxx::nontransaction txn(conn);
+            txn.exec("SELECT 1");
+            return true;
+        }
+        catch (const exception&)
+        {
+            return false;
+        }
+    }
+
+    // Background loop: closes surplus idle connections, pings the rest and
+    // reopens connections until the pool is back at min_size.
+    //
+    void maintain()
+    {
+        unique_lock<mutex> lock(mtx_);
+        while (!stopping_)
+        {
+            wake_.wait_for(lock, options_.maintenance_interval, [this] { return stopping_; });
+            if (stopping_) break;
+
+            auto now = chrono::steady_clock::now();
+
+            // Connections parked long enough to be due for a health check or
+            // to be closed come back for the checks and shrinking below; they
+            // are handed out again through the mutex path. Connections in use
+            // under steady load stay parked with their threads.
+            auto parked_before = now - min<chrono::steady_clock::duration>(options_.health_check_interval,
+                                                                           options_.idle_timeout);
+            for (auto& parked : DrainAffine(parked_before))
+            {
+                idle_.push_front({unique_ptr<pqxx::connection>(parked.first), parked.second, parked.second});
+            }
+
+            // idle_ is LIFO, so the front holds the connections idle the longest
+            vector<unique_ptr<pqxx::connection>> surplus;
+            while (total_ > options_.min_size && !idle_.empty() &&
+                   now - idle_.front().idle_since > options_.idle_timeout)
+            {
+                surplus.push_back(move(idle_.front().conn));
+                idle_.pop_front();
+                --total_;
+                ++shrunk_;
+            }
+
+            vector<IdleConnection> to_check;
+            for (auto it = idle_.begin(); it != idle_.end();)
+            {
+                if (now - it->checked_at > options_.health_check_interval)
+                {
+                    to_check.push_back(move(*it));
+                    it = idle_.erase(it);
+                }
+                else
+                {
+                    ++it;
+                }
+            }
+
+            size_t missing = total_ < options_.min_size ? options_.min_size - total_ : 0;
+            total_ += missing;
+            lock.unlock();
+
+            surplus.clear();
+            for (auto& entry : to_check)
+            {
+                if (!ping(*entry.conn))
+                {
+                    entry.conn.reset();
+                }
+                entry.checked_at = chrono::steady_clock::now();
+            }
+            auto reopened = open_connections(missing);
+
+            lock.lock();
+            for (auto& entry : to_check)
+            {
+                if (entry.conn)
+                {
+                    idle_.push_back(move(entry));
+                }
+                else
+                {
+                    --total_;
+                    ++reconnects_;
+                }
+            }
+            now = chrono::steady_clock::now();
+            for (auto& conn : reopened)
+            {
+                if (conn)
+                {
+                    idle_.push_back({move(conn), now, now});
+                }
+                else
+                {
+                    --total_;
+                }
+            }
+            available_.notify_all();
+        }
+    }
+
+    string conn_str_;
+    PoolOptions options_;
+
+    mutable mutex mtx_;
+    condition_variable available_;
+    condition_variable wake_;
+    deque<IdleConnection> idle_;
+    size_t total_ = 0;
+    bool stopping_ = false;
+    thread maintenance_;
+
+    size_t leases_ = 0;
+    size_t timeouts_ = 0;
+    size_t grown_ = 0;
+    size_t shrunk_ = 0;
+    size_t reconnects_ = 0;
+    double avg_wait_ms_ = 0;
+    double max_wait_ms_ = 0;
+    atomic<size_t> mutex_acquisitions_{0};
+    atomic<size_t> mutex_contended_{0};
+
+    static inline atomic<uint64_t> next_pool_id_{1};
+    uint64_t id_;   // keys the thread-local slot references; never reused, unlike addresses
+    shared_ptr<AffineSlots> affine_;
+    atomic<size_t> waiters_{0};
+};
+
+inline void ConnectionLease::reset()
+{
+    if (conn_ != nullptr)
+    {
+        pool_->Release(conn_);
+        conn_ = nullptr;
+    }
+}
+
+#endif
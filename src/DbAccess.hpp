@@ -10,8 +10,18 @@
 #include <string>
 #include <memory>
 #include <mutex>
+#include <functional>
+#include <optional>
+#include <atomic>
+#include <thread>
+#include <unordered_map>
+#include <map>
 
 #include "Utility.hpp"
+#include "ConnectionPool.hpp"
+#include "RequestContext.hpp"
+#include "QueryWatchdog.hpp"
+#include "TagDictionary.hpp"
 
 namespace json = boost::json;
 using namespace std;
@@ -26,61 +36,421 @@ public:
     string status;   // "Completed", "In Progress", "Not Started"
     int priority;    // 1 (highest) to 5 (lowest)
     vector<string> tags;
+    string list_id;  // partition key; the default list for the unscoped /todos routes
+    uint64_t version = 0;  // row version (todoitems_version_seq) of this image; 0 when unknown
+};
+
+// List used by the unscoped /todos routes
+//
+static const string kDefaultListId = "00000000-0000-0000-0000-000000000000";
+
+// Where todoitems_version_seq stood when a change scan began. `version` is
+// the last version drawn; xmin and xmax are the transaction id bounds of a
+// database snapshot taken after reading it. Versions are drawn after the
+// writing transaction has its id (see create_db.sql), so everything up to
+// `version` belongs to transactions below xmax: once the oldest running
+// transaction is at or past xmax, all of them have committed or rolled back.
+//
+struct VersionFence
+{
+    uint64_t version = 0;
+    uint64_t xmin = 0;
+    uint64_t xmax = 0;
+};
+
+// Column list matching the ToDoItem fields, in RowToItem() order. Tags are
+// stored as ids into the Tags dictionary and named through tags_.
+//
+#define ITEM_COLUMNS "id, name, description, due_date, status, priority, tag_ids, list_id, version"
+
+// Number of columns in ITEM_COLUMNS
+//
+constexpr int kItemColumnCount = 9;
+
+// Imported rows handed to the observers per call
+//
+constexpr size_t kImportBatchRows = 1000;
+
+// Old (o) and new (t) row images for UPDATE ... FROM (...) o ... RETURNING
+//
+#define RETURNING_IMAGES \
+    "o.id, o.name, o.description, o.due_date, o.status, o.priority, o.tag_ids, o.list_id, o.version, " \
+    "t.id, t.name, t.description, t.due_date, t.status, t.priority, t.tag_ids, t.list_id, t.version"
+
+// Filters accepted by the list and export endpoints
+//
+class ToDoFilter
+{
+public:
+    optional<string> status;
+    optional<string> due_date_after;
+    optional<string> due_date_before;
+    optional<int> min_priority;
+    optional<int> max_priority;
+    optional<string> tag;
+    vector<string> tags_all;    // items carrying every one of these tags
+    vector<string> tags_any;    // items carrying at least one of them
+    optional<string> search;    // tsquery text matched against search_vector
+
+    bool Empty() const
+    {
+        return !status && !due_date_after && !due_date_before && !min_priority && !max_priority && !tag &&
+               tags_all.empty() && tags_any.empty() && !search;
+    }
+
+    // Canonical form of the filter; equal keys select the same rows
+    //
+    string Key() const
+    {
+        string key;
+        auto add = [&](const auto& value) {
+            if (!value.has_value())
+            {
+                key += '-';
+                return;
+            }
+            string text;
+            if constexpr (is_same_v<decay_t<decltype(*value)>, string>) text = *value;
+            else text = to_string(*value);
+            key += to_string(text.size()) + ':' + text;  // length-prefixed, so values cannot run together
+        };
+        add(status);
+        add(due_date_after);
+        add(due_date_before);
+        add(min_priority);
+        add(max_priority);
+        add(tag);
+        for (const auto* tags : {&tags_all, &tags_any})
+        {
+            key += '[';
+            for (const auto& tag_name : *tags) key += to_string(tag_name.size()) + ':' + tag_name;
+            key += ']';
+        }
+        add(search);
+        return key;
+    }
+};
+
+// Column projection for the read endpoints (?fields=). `id` is always included.
+//
+class ToDoFields
+{
+public:
+    enum Field { Id, Name, Description, DueDate, Status, Priority, Tags, Count };
+
+    static constexpr const char* kNames[Count] = {"id", "name", "description", "due_date", "status", "priority", "tags"};
+
+    // Table columns behind kNames
+    static constexpr const char* kColumns[Count] = {"id", "name", "description", "due_date", "status", "priority", "tag_ids"};
+
+    unsigned mask = (1u << Count) - 1;
+
+    bool Has(Field field) const
+    {
+        return (mask >> field) & 1u;
+    }
+
+    // Parses a comma-separated field list against the whitelist
+    //
+    static bool Parse(const string& list, ToDoFields& out, string& error)
+    {
+        out.mask = 1u << Id;
+        size_t start = 0;
+        while (start <= list.size()) 
+        {
+            size_t end = list.find(',', start);
+            if (end == string::npos) end = list.size();
+            string name = list.substr(start, end - start);
+            name.erase(0, name.find_first_not_of(' '));
+            name.erase(name.find_last_not_of(' ') + 1);
+
+            int index = -1;
+            for (int i = 0; i < Count; ++i) 
+            {
+                if (name == kNames[i]) index = i;
+            }
+            if (index < 0) 
+            {
+                error = "Unknown field '" + name + "'. Allowed: id, name, description, due_date, status, priority, tags";
+                return false;
+            }
+            out.mask |= 1u << index;
+            start = end + 1;
+        }
+        return true;
+    }
+
+    // The selected column names, comma-separated, for a SELECT list
+    //
+    string SelectList() const
+    {
+        string columns;
+        for (int i = 0; i < Count; ++i) 
+        {
+            if (!Has(static_cast<Field>(i))) continue;
+            if (!columns.empty()) columns += ", ";
+            columns += kColumns[i];
+        }
+        return columns;
+    }
+};
+
+// Pagination for the list endpoint
+//
+class ToDoPage
+{
+public:
+    optional<int> limit;
+    optional<int> offset;
 };
 
 
 
 class PgPool {
 public:
-    PgPool(const string& conn_str, size_t size = 5) : conn_str_(conn_str), size_(size) 
+    // `thread_affine` selects the lock-free, thread-affine leasing mode of
+    // ConnectionPool for the primary and every replica
+    //
+    PgPool(const string& conn_str, size_t min_size = 5, size_t max_size = 20, bool thread_affine = false)
+        : min_size_(min_size), max_size_(max_size), thread_affine_(thread_affine),
+          primary_(conn_str, MakePoolOptions(min_size, max_size, thread_affine))
+    {
+    }
+
+    virtual ~PgPool()
+    {
+        stopping_ = true;
+        if (monitor_.joinable())
+        {
+            monitor_.join();
+        }
+    }
+
+    // Adds a read replica. Reads are spread over healthy replicas round-robin.
+    // Must be called before the pool starts serving requests.
+    //
+    void AddReplica(const string& conn_str)
+    {
+        auto replica = make_unique<Replica>();
+        replica->name = "replica-" + to_string(replicas_.size());
+        replica->pool = make_unique<ConnectionPool>(conn_str, MakePoolOptions(min_size_, max_size_, thread_affine_));
+        replicas_.push_back(move(replica));
+
+        if (!monitor_.joinable())
+        {
+            monitor_ = thread([this] { MonitorReplicas(); });
+        }
+    }
+
+    // With read-your-writes on, a client's reads go to the primary after it
+    // writes, until a replica has replayed past the LSN of that write.
+    //
+    void SetReadYourWrites(bool enabled)
+    {
+        read_your_writes_ = enabled;
+    }
+
+    // Leases a primary connection; it goes back to the pool when the lease is
+    // destroyed. Returns an empty lease if none became available in time.
+    //
+    ConnectionLease get(const RequestContext* ctx = nullptr) 
+    {
+        CheckDeadline(ctx);
+        ScopedStage wait_stage(Timings(ctx), Stage::PoolWait);
+        return primary_.get(Deadline(ctx));
+    }
+
+    // Leases a connection for a read-only query: a replica when one is healthy
+    // and caught up with the client's last write, the primary otherwise.
+    //
+    ConnectionLease get_read(const RequestContext* ctx)
+    {
+        CheckDeadline(ctx);
+        ScopedStage wait_stage(Timings(ctx), Stage::PoolWait);
+        if (replicas_.empty())
+        {
+            return primary_.get(Deadline(ctx));
+        }
+        if (ctx != nullptr && ctx->read_primary)
+        {
+            ++primary_reads_;
+            return primary_.get(Deadline(ctx));
+        }
+
+        // Clients whose write marks were pruned wrote at or below pruned_lsn_;
+        // a replica that was down at the time may come back behind it
+        uint64_t required_lsn = RequiredLsn(ctx);
+        uint64_t replica_floor = required_lsn;
+        if (read_your_writes_ && ctx != nullptr && !ctx->client_id.empty())
+        {
+            replica_floor = max(replica_floor, pruned_lsn_.load());
+        }
+
+        size_t n = replicas_.size();
+        size_t start = next_replica_.fetch_add(1, memory_order_relaxed);
+        for (size_t i = 0; i < n; ++i)
+        {
+            auto& replica = *replicas_[(start + i) % n];
+            if (!replica.healthy || replica.replay_lsn < replica_floor)
+            {
+                continue;
+            }
+            if (auto conn = replica.pool->get(Deadline(ctx)))
+            {
+                ++replica_reads_;
+                return conn;
+            }
+        }
+
+        if (required_lsn != 0)
+        {
+            ++read_your_writes_reads_;
+        }
+        ++primary_reads_;
+        return primary_.get(Deadline(ctx));
+    }
+
+    // Whether get_read() may have to send this client's reads to the primary:
+    // it has a write that not every replica is known to have replayed. Shared
+    // reads are keyed on this, so they never mix clients that need the
+    // primary with ones that do not.
+    //
+    bool ReadNeedsPrimary(const RequestContext* ctx) const
+    {
+        return !replicas_.empty() && RequiredLsn(ctx) != 0;
+    }
+
+    PoolStats stats() const
     {
-        for (size_t i = 0; i < size_; ++i) {
-            conns_.emplace_back(make_shared<pqxx::connection>(conn_str_));
+        return primary_.stats();
+    }
+
+    // Most connections the primary pool opens
+    //
+    size_t MaxConnections() const
+    {
+        return max_size_;
+    }
+
+    // Pool, routing and replica lag figures for the metrics endpoint
+    //
+    json::object Metrics() const
+    {
+        json::array replicas;
+        uint64_t primary_lsn = primary_lsn_;
+        for (const auto& replica : replicas_)
+        {
+            uint64_t replay_lsn = replica->replay_lsn;
+            replicas.emplace_back(json::object{
+                {"name",        replica->name},
+                {"healthy",     replica->healthy.load()},
+                {"lag_bytes",   primary_lsn > replay_lsn ? primary_lsn - replay_lsn : 0},
+                {"lag_seconds", replica->lag_seconds.load()},
+                {"pool",        PoolStatsJson(replica->pool->stats())}
+            });
         }
+
+        return json::object{
+            {"primary",  PoolStatsJson(primary_.stats())},
+            {"replicas", move(replicas)},
+            {"reads", json::object{
+                {"replica",               replica_reads_.load()},
+                {"primary",               primary_reads_.load()},
+                {"read_your_writes",      read_your_writes_reads_.load()},
+                {"broken_retries",        broken_read_retries_.load()}
+            }},
+            {"cancelled", json::object{
+                {"deadline",   watchdog_.DeadlineCancels()},
+                {"disconnect", watchdog_.DisconnectCancels()}
+            }},
+            {"tags", tags_.Metrics()}
+        };
     }
 
-    shared_ptr<pqxx::connection> get() 
+    // True for a statement cancelled by statement_timeout or cancel_query()
+    // (SQLSTATE 57014, query_canceled)
+    //
+    static bool IsCancellation(const exception& e)
     {
-        lock_guard<mutex> lock(mtx_);
-        if (conns_.empty()) return nullptr;
-        auto conn = conns_.back();
-        conns_.pop_back();
-        return conn;
+        auto sql = dynamic_cast<const pqxx::sql_error*>(&e);
+        return sql != nullptr && sql->sqlstate() == "57014";
     }
 
-    void release(shared_ptr<pqxx::connection> conn) 
+    // Marks `ctx` cancelled when `e` is a cancellation or the request ran out
+    // of time; called from every catch that turns a failure into false
+    //
+    static void NoteFailure(const exception& e, const RequestContext* ctx)
     {
-        lock_guard<mutex> lock(mtx_);
-        conns_.push_back(conn);
+        if (ctx != nullptr && (IsCancellation(e) || ctx->Expired()))
+        {
+            ctx->cancelled = true;
+        }
+    }
+
+    // Runs an idempotent read, and once more on a fresh lease if the first
+    // connection turns out to be broken (the server restarted or dropped it
+    // while it sat idle). `read` leases its own connection, so the broken one
+    // has gone back to the pool, and been dropped there, before the retry.
+    //
+    template <class Read>
+    auto RetryBrokenRead(const RequestContext* ctx, Read&& read) -> decltype(read())
+    {
+        try
+        {
+            return read();
+        }
+        catch (const pqxx::broken_connection& e)
+        {
+            if (ctx != nullptr && ctx->Expired())
+            {
+                throw;
+            }
+            ++broken_read_retries_;
+            cerr << "Connection broke during a read, retrying once: " << e.what() << "\n";
+        }
+        return read();
     }
 
-    virtual bool CreateToDoItem(ToDoItem item)
+    // `created`, when given, receives the row as stored (normalized due_date etc.)
+    //
+    virtual bool CreateToDoItem(ToDoItem item, const RequestContext* ctx = nullptr, ToDoItem* created = nullptr)
     {
         try
         {   
-            auto conn_ptr = this->get();
+            auto conn_ptr = this->get(ctx);
             if (!conn_ptr) 
             {
                 throw runtime_error("No available database connection");
             }
+            ScopedStage query_stage(Timings(ctx), Stage::Query);
+            auto watch = watchdog_.Start(*conn_ptr, ctx);
             pqxx::work txn(*conn_ptr);
-            auto result = txn.exec_params(
-                "INSERT INTO ToDoItems (id, name, description, due_date, status, priority, tags) "
-                "VALUES ($1, $2, $3, $4, $5::todo_item_status, $6, $7::text[])",
+            ApplyDeadline(txn, ctx);
+            auto row = txn.exec_params1(
+                "INSERT INTO ToDoItems (id, name, description, due_date, status, priority, tag_ids, list_id) "
+                "VALUES ($1, $2, $3, $4, $5::todo_item_status, $6, intern_tags($7::text[]), $8) "
+                "RETURNING " ITEM_COLUMNS,
                 item.id, item.name, item.description.empty() ? nullopt : optional<string>{item.description},
                 item.due_date.empty() ? nullopt : optional<string>{item.due_date},
-                item.status, item.priority, item.tags
+                item.status, item.priority, item.tags, ListScope(ctx)
             );
+            ResolveTags(txn, row);
             txn.commit();
-            this->release(conn_ptr);
+            if (created != nullptr) 
+            {
+                *created = RowToItem(row);
+            }
+            NoteWrite(*conn_ptr, ctx);
         }
         catch (const pqxx::sql_error& se) 
         {
+            NoteFailure(se, ctx);
             cerr << "Database error: " << se.what() << "\n";
             return false;
         }
         catch (const exception& e) 
         {
+            NoteFailure(e, ctx);
             cerr << "Error: " << e.what() << "\n";
             return false;
         }
@@ -89,288 +459,290 @@ public:
 
     bool GetAllToDoItems(
         boost::json::array& out_items,
-        std::optional<std::string> status_filter      = std::nullopt,
-        std::optional<std::string> due_date_after     = std::nullopt,
-        std::optional<std::string> due_date_before    = std::nullopt,
-        std::optional<int> min_priority               = std::nullopt,
-        std::optional<int> max_priority               = std::nullopt,
-        std::optional<std::string> tag_contains       = std::nullopt,
+        const ToDoFilter& filter,
         std::optional<std::string> sort_by            = "due_date",
-        std::optional<std::string> sort_order         = "asc"
+        std::optional<std::string> sort_order         = "asc",
+        const ToDoPage& page                          = {},
+        const ToDoFields& fields                      = {},
+        const RequestContext* ctx                     = nullptr
     )   
     {
         out_items.clear();
 
         try {
-            auto conn_ptr = this->get();
-            if (!conn_ptr) 
-            {
-                std::cerr << "No available connection in pool" << std::endl;
-                return false;
-            }
-
-            pqxx::work txn(*conn_ptr);
+            return RetryBrokenRead(ctx, [&] {
+                auto conn_ptr = this->get_read(ctx);
+                if (!conn_ptr) 
+                {
+                    std::cerr << "No available connection in pool" << std::endl;
+                    return false;
+                }
 
-            std::string where_clause;
-            std::vector<std::string> params;
+                ScopedStage query_stage(Timings(ctx), Stage::Query);
+                auto watch = watchdog_.Start(*conn_ptr, ctx);
+                pqxx::work txn(*conn_ptr);
+                ApplyDeadline(txn, ctx);
 
-            auto add_condition = [&](const std::string& cond, const std::string& val) {
-                where_clause += (where_clause.empty() ? "WHERE " : " AND ");
-                where_clause += cond + " $" + std::to_string(params.size() + 1);
-                params.push_back(val);
-            };
+                std::vector<std::string> params;
+                auto bind = [&](const std::string& val) {
+                    params.push_back(val);
+                    return "$" + std::to_string(params.size());
+                };
+                std::string rank_expr;
+                std::string where_clause = BuildWhereClause(filter, ListScope(ctx), TagCondition(txn, filter), bind, &rank_expr);
+                std::string order_clause = BuildOrderClause(sort_by, sort_order, rank_expr);
 
-            if (status_filter.has_value()) 
-            {
-                add_condition("status = ", *status_filter);
-            }
+                std::string page_clause;
+                if (page.limit.has_value()) 
+                {
+                    page_clause += " LIMIT " + bind(std::to_string(*page.limit));
+                }
+                if (page.offset.has_value()) 
+                {
+                    page_clause += " OFFSET " + bind(std::to_string(*page.offset));
+                }
 
-            if (due_date_after.has_value()) 
-            {
-                add_condition("due_date > ", *due_date_after);
-            }
+                // Final SQL query – only the projected columns
+                std::string sql = 
+                    "SELECT " + fields.SelectList() + " "
+                    "FROM ToDoItems "
+                    + where_clause
+                    + order_clause
+                    + page_clause;
 
-            if (due_date_before.has_value()) 
-            {
-                add_condition("due_date < ", *due_date_before);
-            }
+                pqxx::result rows = ExecParams(txn, sql, params);
+                ResolveTags(txn, rows);
+                query_stage.Stop();
 
-            if (min_priority.has_value()) 
-            {
-                add_condition("priority >= ", std::to_string(*min_priority));
-            }
+                ScopedStage serialize_stage(Timings(ctx), Stage::Serialize);
+                out_items.reserve(rows.size());
+                for (auto row : rows) 
+                {
+                    out_items.emplace_back(RowToJson(row, fields));
+                }
 
-            if (max_priority.has_value()) 
-            {
-                add_condition("priority <= ", std::to_string(*max_priority));
-            }
+                return true;
+            });
+        }
+        catch (const std::exception& e) 
+        {
+            NoteFailure(e, ctx);
+            std::cerr << "GetAllToDoItems failed: " << e.what() << std::endl;
+            return false;
+        }
+    }
 
-            if (tag_contains.has_value()) 
+    // Streams the filtered items as one JSON document per row through
+    // COPY ... TO STDOUT, so memory use does not grow with the result size.
+    // `on_line` returns false once the consumer has gone away; the statement
+    // is then cancelled and the rows still in flight are discarded. The query stage of the
+    // request includes the time `on_line` spends writing to the client.
+    //
+    bool ExportToDoItems(
+        const ToDoFilter& filter,
+        const function<bool(string_view)>& on_line,
+        size_t& exported,
+        optional<string> sort_by    = nullopt,
+        optional<string> sort_order = nullopt,
+        const ToDoFields& fields    = {},
+        const RequestContext* ctx   = nullptr
+    )
+    {
+        exported = 0;
+        try
+        {
+            auto conn_ptr = this->get_read(ctx);
+            if (!conn_ptr) 
             {
-                // PostgreSQL: check if array contains value
-                where_clause += (where_clause.empty() ? "WHERE " : " AND ");
-                where_clause += "$" + std::to_string(params.size() + 1) + " = ANY(tags)";
-                params.push_back(*tag_contains);
+                throw runtime_error("No available database connection");
             }
+            ScopedStage query_stage(Timings(ctx), Stage::Query);
+            auto watch = watchdog_.Start(*conn_ptr, ctx);
+            pqxx::work txn(*conn_ptr);
+            ApplyDeadline(txn, ctx);
 
-            std::string order_clause = " ORDER BY ";
-
-            std::string field = sort_by.value_or("due_date");
-            std::string direction = (sort_order.value_or("asc") == "desc") ? "DESC" : "ASC";
-
-            if (field == "due_date") 
-            {
-                order_clause += "due_date " + direction + " NULLS LAST";
-            } 
-            else if (field == "name") 
-            {
-                order_clause += "name " + direction;
-            } 
-            else if (field == "status") 
-            {
-                order_clause += "status " + direction;
-            } 
-            else if (field == "id") 
+            // COPY does not accept bind parameters, so filter values are quoted inline
+            string rank_expr;
+            string object_args;
+            for (int i = 0; i < ToDoFields::Count; ++i) 
             {
-                order_clause += "id " + direction;
-            } 
-            else if (field == "priority") 
-            {
-                order_clause += "priority " + direction + " NULLS LAST";
-            } 
-            else 
-            {
-                order_clause += "due_date ASC NULLS LAST";  // fallback
+                if (!fields.Has(static_cast<ToDoFields::Field>(i))) continue;
+                if (!object_args.empty()) object_args += ", ";
+                // Names are resolved in SQL here: the rows never pass through RowToJson
+                object_args += string("'") + ToDoFields::kNames[i] + "', " +
+                               (i == ToDoFields::Tags ? "tag_names(tag_ids)" : ToDoFields::kColumns[i]);
             }
-
-            // Final SQL query – include new columns
-            std::string sql = 
-                "SELECT id, name, description, due_date, status, priority, tags "
+            string sql =
+                "SELECT json_build_object(" + object_args + ")::text "
                 "FROM ToDoItems "
-                + where_clause
-                + order_clause;
-
-            pqxx::result rows;
-            if (params.empty()) 
-            {
-                rows = txn.exec(sql);
-            } 
-            else if (params.size() == 1) 
-            {
-                rows = txn.exec_params(sql, params[0]);
-            } 
-            else if (params.size() == 2) 
-            {
-                rows = txn.exec_params(sql, params[0], params[1]);
-            } 
-            else if (params.size() == 3) 
-            {
-                rows = txn.exec_params(sql, params[0], params[1], params[2]);
-            } 
-            else if (params.size() == 4) 
-            {
-                rows = txn.exec_params(sql, params[0], params[1], params[2], params[3]);
-            } 
-            else if (params.size() == 5) 
-            {
-                rows = txn.exec_params(sql, params[0], params[1], params[2], params[3], params[4]);
-            } 
-            else if (params.size() == 6) 
-            {
-                rows = txn.exec_params(sql, params[0], params[1], params[2], params[3], params[4], params[5]);
-            } 
-            else if (params.size() == 7) 
-            {
-                rows = txn.exec_params(sql, params[0], params[1], params[2], params[3], params[4], params[5], params[6]);
-            } 
-            else if (params.size() == 8) 
-            {
-                rows = txn.exec_params(sql, params[0], params[1], params[2], params[3], params[4], params[5], params[6], params[7]);
-            } 
-            else if (params.size() == 9) 
-            {
-                rows = txn.exec_params(sql, params[0], params[1], params[2], params[3], params[4], params[5], params[6], params[7], params[8]);
-            } 
-            else 
-            {
-                throw std::runtime_error("Too many parameters for exec_params (max 9 supported in this impl)");
-            }
+                + BuildWhereClause(filter, ListScope(ctx), TagCondition(txn, filter),
+                                   [&](const string& val) { return txn.quote(val); }, &rank_expr)
+                + (sort_by.has_value() ? BuildOrderClause(sort_by, sort_order, rank_expr) : "");
 
-            for (auto row : rows) 
+            auto stream = pqxx::stream_from::query(txn, sql);
+            bool consumer_open = true;
+            while (auto fields = stream.read_row())
             {
-                boost::json::object item;
-
-                item["id"]          = row["id"].as<std::string>();
-                item["name"]        = row["name"].as<std::string>();
-                item["description"] = row["description"].is_null() ? "" : row["description"].as<std::string>();
-                item["due_date"]    = row["due_date"].is_null() ? "" : row["due_date"].as<std::string>();
-                item["status"]      = row["status"].as<std::string>();
-                item["priority"]    = row["priority"].as<int>();
-
-                string tagsStr = row["tags"].is_null() ? "" : row["tags"].as<std::string>();
-                if (!tagsStr.empty() && tagsStr.front() == '{' && tagsStr.back() == '}') 
+                if (!consumer_open) continue;
+                if (on_line((*fields)[0])) 
                 {
-                    tagsStr = tagsStr.substr(1, tagsStr.size() - 2);
+                    ++exported;
+                }
+                else
+                {
+                    // Stop the server producing rows nobody will read; what is
+                    // already in flight is discarded until the cancel lands
+                    consumer_open = false;
+                    conn_ptr->cancel_query();
                 }
-
-                out_items.emplace_back(std::move(item));
-                std::cout << "Fetched item: " << row["name"].as<std::string>() << std::endl;
             }
+            stream.complete();
+            txn.commit();
 
-            release(conn_ptr);
-            return true;
+            if (!consumer_open) 
+            {
+                throw runtime_error("Export aborted after " + to_string(exported) + " rows");
+            }
         }
-        catch (const std::exception& e) 
+        catch (const pqxx::sql_error& se) 
         {
-            std::cerr << "GetAllToDoItems failed: " << e.what() << std::endl;
+            NoteFailure(se, ctx);
+            cerr << "Database error: " << se.what() << "\n";
+            return false;
+        }
+        catch (const exception& e) 
+        {
+            NoteFailure(e, ctx);
+            cerr << "Error: " << e.what() << "\n";
             return false;
         }
+        return true;
     }
 
-    virtual bool GetToDoItemById(const string& id, json::object& item)
+    // Loads items pulled from `next_item` through COPY ... FROM STDIN in a
+    // single transaction. Nothing is committed if `next_item` throws. Rows
+    // are copied into a temporary table first: their tags are interned with
+    // one call for all distinct names before the rows move into ToDoItems.
+    // `on_inserted`, when given, receives the rows as stored (RETURNING,
+    // streamed back through COPY) in batches of kImportBatchRows, for the
+    // observers that mirror the table. The batches arrive before the commit:
+    // a commit that fails afterwards has shown them rows that do not exist.
+    //
+    bool ImportToDoItems(const function<bool(ToDoItem&)>& next_item, size_t& imported,
+                         const function<void(const vector<ToDoItem>&)>& on_inserted = nullptr,
+                         const RequestContext* ctx = nullptr)
     {
+        imported = 0;
         try
-        {   
-            auto conn_ptr = this->get();
+        {
+            auto conn_ptr = this->get(ctx);
             if (!conn_ptr) 
             {
                 throw runtime_error("No available database connection");
             }
-            pqxx::work txn(*conn_ptr);            
-
-            auto row = txn.exec_params1("SELECT name, description, due_date, status, priority, tags "
-                                        "FROM ToDoItems WHERE id = $1", id);
+            ScopedStage query_stage(Timings(ctx), Stage::Query);
+            auto watch = watchdog_.Start(*conn_ptr, ctx);
+            pqxx::work txn(*conn_ptr);
+            ApplyDeadline(txn, ctx);
+            txn.exec(
+                "CREATE TEMP TABLE todoitems_import ("
+                "id UUID, name TEXT, description TEXT, due_date TIMESTAMPTZ, "
+                "status todo_item_status, priority INTEGER, tags TEXT[]) ON COMMIT DROP");
+            auto stream = pqxx::stream_to::table(txn, {"todoitems_import"},
+                {"id", "name", "description", "due_date", "status", "priority", "tags"});
 
-            string tagsStr = row["tags"].is_null() ? "" : row["tags"].as<std::string>();
-            if (!tagsStr.empty() && tagsStr.front() == '{' && tagsStr.back() == '}') 
+            ToDoItem item;
+            while (next_item(item))
             {
-                tagsStr = tagsStr.substr(1, tagsStr.size() - 2);
+                stream.write_values(
+                    item.id, item.name,
+                    item.description.empty() ? nullopt : optional<string>{item.description},
+                    item.due_date.empty() ? nullopt : optional<string>{item.due_date},
+                    item.status, item.priority, item.tags
+                );
+                ++imported;
             }
+            stream.complete();
 
-            json::object foundItem
+            auto tag_ids = txn.exec1("SELECT intern_tags(ARRAY(SELECT DISTINCT unnest(tags) FROM todoitems_import))");
+            const string insert =
+                "INSERT INTO ToDoItems (id, name, description, due_date, status, priority, tag_ids, list_id) "
+                "SELECT i.id, i.name, i.description, i.due_date, i.status, i.priority, "
+                "ARRAY(SELECT t.id FROM unnest(i.tags) WITH ORDINALITY u(name, ord) JOIN Tags t ON t.name = u.name ORDER BY u.ord), ";
+            if (!on_inserted) 
             {
-                {"id",          id},
-                {"name",        row["name"].as<string>()},
-                {"description", row["description"].is_null() ? "" : row["description"].as<string>()},
-                {"due_date",    row["due_date"].is_null() ? "" : row["due_date"].as<string>()},
-                {"status",      row["status"].as<string>()},
-                {"priority",    row["priority"].as<int>()},
-                {"tags",        tagsStr}
-            };
-            item = move(foundItem);
-            
+                txn.exec_params(insert + "$1 FROM todoitems_import i", ListScope(ctx));
+            }
+            else 
+            {
+                // COPY takes no parameters, so the list id is quoted in
+                LoadTags(txn, tag_ids[0].is_null() ? vector<TagDictionary::TagId>{}
+                                                   : TagDictionary::ParseIds(tag_ids[0].as<string>()));
+                vector<ToDoItem> batch;
+                batch.reserve(min(imported, kImportBatchRows));
+                auto rows = pqxx::stream_from::query(txn,
+                    insert + txn.quote(ListScope(ctx)) + " FROM todoitems_import i RETURNING " ITEM_COLUMNS);
+                while (auto fields = rows.read_row()) 
+                {
+                    batch.emplace_back();
+                    StreamedRowToItem(*fields, batch.back());
+                    if (batch.size() == kImportBatchRows) 
+                    {
+                        on_inserted(batch);
+                        batch.clear();
+                    }
+                }
+                rows.complete();
+                if (!batch.empty()) 
+                {
+                    on_inserted(batch);
+                }
+            }
             txn.commit();
-            this->release(conn_ptr);
+            NoteWrite(*conn_ptr, ctx);
         }
         catch (const pqxx::sql_error& se) 
         {
+            NoteFailure(se, ctx);
             cerr << "Database error: " << se.what() << "\n";
             return false;
         }
         catch (const exception& e) 
         {
+            NoteFailure(e, ctx);
             cerr << "Error: " << e.what() << "\n";
             return false;
         }
         return true;
     }
 
-    virtual bool UpdateToDoItem(const string& id, const map<string, string>& updates)
+    // Streams every row of every list through `on_item` in constant memory.
+    // Used to build in-process structures that mirror the table; the only
+    // query that deliberately spans all partitions. Reads the primary: a
+    // lagging replica would seed them with rows already overwritten.
+    //
+    bool ScanToDoItems(const function<void(const ToDoItem&)>& on_item)
     {
         try
-        {   
+        {
             auto conn_ptr = this->get();
             if (!conn_ptr) 
             {
                 throw runtime_error("No available database connection");
             }
-            pqxx::work txn(*conn_ptr);            
-
-            string set_clause;
-            vector<string> params;
-            int idx = 1;
-            for (const auto& [k, v] : updates) {
-                if (!set_clause.empty()) set_clause += ", ";
-                set_clause += k + " = $" + to_string(idx++);
-                params.push_back(v);
-            }
-            params.push_back(id);  // last param = id
+            pqxx::work txn(*conn_ptr);
+            txn.exec("SET TRANSACTION ISOLATION LEVEL REPEATABLE READ");
+            LoadAllTags(txn);
+            auto stream = pqxx::stream_from::query(txn, "SELECT " ITEM_COLUMNS " FROM ToDoItems");
 
-            string query = "UPDATE ToDoItems SET " + set_clause + " WHERE id = $" + to_string(idx);            
-            if (params.size() == 1) 
-            {
-                txn.exec_params(query, params[0]);
-            } 
-            else if (params.size() == 2) 
-            {
-                txn.exec_params(query, params[0], params[1]);
-            } 
-            else if (params.size() == 3) 
-            {
-                txn.exec_params(query, params[0], params[1], params[2]);
-            } 
-            else if (params.size() == 4) 
-            {
-                txn.exec_params(query, params[0], params[1], params[2], params[3]);
-            } 
-            else if (params.size() == 5) 
-            {
-                txn.exec_params(query, params[0], params[1], params[2], params[3], params[4]);
-            }
-            else if (params.size() == 6) 
-            {
-                txn.exec_params(query, params[0], params[1], params[2], params[3], params[4], params[5]);
-            }
-            else if (params.size() == 7) 
-            {
-                txn.exec_params(query, params[0], params[1], params[2], params[3], params[4], params[5], params[6]);
-            }
-            else 
+            ToDoItem item;
+            while (auto fields = stream.read_row())
             {
-                throw runtime_error("Too many parameters for update");
+                StreamedRowToItem(*fields, item);
+                on_item(item);
             }
+            stream.complete();
             txn.commit();
-            this->release(conn_ptr);
         }
         catch (const pqxx::sql_error& se) 
         {
@@ -385,27 +757,60 @@ public:
         return true;
     }
 
-    virtual bool DeleteToDoItem(const string& id)
+    // Streams the rows inserted or updated after version `since` and the ids
+    // deleted after it, both read from one database snapshot. Versions come
+    // from todoitems_version_seq, bumped by the triggers in create_db.sql.
+    // `fence` is filled in before that snapshot is taken. Runs on the primary:
+    // a replica's view of the sequence runs ahead of the versions drawn.
+    //
+    bool ScanToDoItemsSince(uint64_t since,
+                            const function<void(const ToDoItem&, uint64_t)>& on_item,
+                            const function<void(const string& list_id, const string& id, uint64_t)>& on_deleted,
+                            VersionFence& fence)
     {
         try
-        {   
+        {
             auto conn_ptr = this->get();
             if (!conn_ptr) 
             {
                 throw runtime_error("No available database connection");
             }
-            pqxx::work txn(*conn_ptr);            
+            {
+                // Separate statements: the snapshot bounding the transactions
+                // must be taken after the sequence is read
+                pqxx::nontransaction fence_txn(*conn_ptr);
+                fence.version = fence_txn.query_value<uint64_t>(
+                    "SELECT CASE WHEN is_called THEN last_value ELSE 0 END FROM todoitems_version_seq");
+                auto bounds = fence_txn.exec1(
+                    "SELECT pg_snapshot_xmin(s)::text::bigint, pg_snapshot_xmax(s)::text::bigint "
+                    "FROM pg_current_snapshot() s");
+                fence.xmin = bounds[0].as<uint64_t>();
+                fence.xmax = bounds[1].as<uint64_t>();
+            }
+            pqxx::work txn(*conn_ptr);
+            txn.exec("SET TRANSACTION ISOLATION LEVEL REPEATABLE READ");
+            LoadAllTags(txn);
+            const string since_text = to_string(since);
 
-            auto result = txn.exec_params("DELETE FROM ToDoItems WHERE id = $1", id);
-            this->release(conn_ptr);
-            if (result.affected_rows() == 0) 
+            auto rows = pqxx::stream_from::query(txn,
+                "SELECT " ITEM_COLUMNS " FROM ToDoItems WHERE version > " + since_text);
+            ToDoItem item;
+            while (auto fields = rows.read_row())
             {
-                throw runtime_error("No ToDo item found with given ID");
+                StreamedRowToItem(*fields, item);
+                on_item(item, item.version);
             }
-            else
-            {                
-                txn.commit();
+            rows.complete();
+
+            auto deleted = pqxx::stream_from::query(txn,
+                "SELECT list_id, id, version FROM ToDoItemTombstones WHERE version > " + since_text);
+            while (auto fields = deleted.read_row())
+            {
+                const auto& f = *fields;
+                on_deleted(string(f[0]), string(f[1]), stoull(string(f[2])));
             }
+            deleted.complete();
+            txn.commit();
         }
         catch (const pqxx::sql_error& se) 
         {
@@ -420,12 +825,849 @@ public:
         return true;
     }
 
+    virtual bool GetToDoItemById(const string& id, json::object& item, const ToDoFields& fields = {}, const RequestContext* ctx = nullptr)
+    {
+        try
+        {
+            RetryBrokenRead(ctx, [&] {
+                auto conn_ptr = this->get_read(ctx);
+                if (!conn_ptr) 
+                {
+                    throw runtime_error("No available database connection");
+                }
+                ScopedStage query_stage(Timings(ctx), Stage::Query);
+                auto watch = watchdog_.Start(*conn_ptr, ctx);
+                pqxx::work txn(*conn_ptr);
+                ApplyDeadline(txn, ctx);
 
-private:
-    string conn_str_;
-    size_t size_;
-    vector<shared_ptr<pqxx::connection>> conns_;
-    mutex mtx_;
+                auto row = txn.exec_params1("SELECT " + fields.SelectList() + " "
+                                            "FROM ToDoItems WHERE list_id = $1 AND id = $2", ListScope(ctx), id);
+                ResolveTags(txn, row);
+                txn.commit();
+                query_stage.Stop();
+
+                ScopedStage serialize_stage(Timings(ctx), Stage::Serialize);
+                item = RowToJson(row, fields);
+            });
+        }
+        catch (const pqxx::sql_error& se) 
+        {
+            NoteFailure(se, ctx);
+            cerr << "Database error: " << se.what() << "\n";
+            return false;
+        }
+        catch (const exception& e) 
+        {
+            NoteFailure(e, ctx);
+            cerr << "Error: " << e.what() << "\n";
+            return false;
+        }
+        return true;
+    }
+
+    // `before` / `after`, when given, receive the row images around the update;
+    // both are left untouched if no row has that id.
+    //
+    virtual bool UpdateToDoItem(const string& id, const map<string, string>& updates, const RequestContext* ctx = nullptr,
+                                ToDoItem* before = nullptr, ToDoItem* after = nullptr)
+    {
+        try
+        {   
+            auto conn_ptr = this->get(ctx);
+            if (!conn_ptr) 
+            {
+                throw runtime_error("No available database connection");
+            }
+            ScopedStage query_stage(Timings(ctx), Stage::Query);
+            auto watch = watchdog_.Start(*conn_ptr, ctx);
+            pqxx::work txn(*conn_ptr);
+            ApplyDeadline(txn, ctx);
+
+            string set_clause;
+            vector<string> params;
+            int idx = 1;
+            for (const auto& [k, v] : updates) {
+                if (!set_clause.empty()) set_clause += ", ";
+                set_clause += SetColumn(k, "$" + to_string(idx++));
+                params.push_back(v);
+            }
+            params.push_back(ListScope(ctx));
+            params.push_back(id);  // last params = partition key, id
+
+            // Lock the old row in a subquery so RETURNING can report both images
+            string query = "UPDATE ToDoItems t SET " + set_clause + 
+                           " FROM (SELECT " ITEM_COLUMNS " FROM ToDoItems"
+                           " WHERE list_id = $" + to_string(idx) + " AND id = $" + to_string(idx + 1) + " FOR UPDATE) o"
+                           " WHERE t.list_id = $" + to_string(idx) + " AND t.id = o.id"
+                           " RETURNING " RETURNING_IMAGES;
+            pqxx::result rows = ExecParams(txn, query, params);
+            ResolveTags(txn, rows);
+            txn.commit();
+            if (rows.size() == 1) 
+            {
+                if (before != nullptr) *before = RowToItem(rows[0], 0);
+                if (after != nullptr) *after = RowToItem(rows[0], kItemColumnCount);
+            }
+            NoteWrite(*conn_ptr, ctx);
+        }
+        catch (const pqxx::sql_error& se) 
+        {
+            NoteFailure(se, ctx);
+            cerr << "Database error: " << se.what() << "\n";
+            return false;
+        }
+        catch (const exception& e) 
+        {
+            NoteFailure(e, ctx);
+            cerr << "Error: " << e.what() << "\n";
+            return false;
+        }
+        return true;
+    }
+
+    // `deleted`, when given, receives the removed row
+    //
+    virtual bool DeleteToDoItem(const string& id, const RequestContext* ctx = nullptr, ToDoItem* deleted = nullptr)
+    {
+        try
+        {   
+            auto conn_ptr = this->get(ctx);
+            if (!conn_ptr) 
+            {
+                throw runtime_error("No available database connection");
+            }
+            ScopedStage query_stage(Timings(ctx), Stage::Query);
+            auto watch = watchdog_.Start(*conn_ptr, ctx);
+            pqxx::work txn(*conn_ptr);
+            ApplyDeadline(txn, ctx);
+
+            auto result = txn.exec_params("DELETE FROM ToDoItems WHERE list_id = $1 AND id = $2 RETURNING " ITEM_COLUMNS,
+                                          ListScope(ctx), id);
+            if (result.affected_rows() == 0) 
+            {
+                throw runtime_error("No ToDo item found with given ID");
+            }
+            else
+            {                
+                ResolveTags(txn, result);
+                txn.commit();
+                if (deleted != nullptr) 
+                {
+                    *deleted = RowToItem(result[0]);
+                }
+                NoteWrite(*conn_ptr, ctx);
+            }
+        }
+        catch (const pqxx::sql_error& se) 
+        {
+            NoteFailure(se, ctx);
+            cerr << "Database error: " << se.what() << "\n";
+            return false;
+        }
+        catch (const exception& e) 
+        {
+            NoteFailure(e, ctx);
+            cerr << "Error: " << e.what() << "\n";
+            return false;
+        }
+        return true;
+    }
+
+
+    // Applies `updates` to every row selected by `ids` (when non-empty) or
+    // `filter`, in a single statement and transaction. `images`, when given,
+    // receives the before/after image of each updated row.
+    //
+    virtual bool UpdateToDoItems(const vector<string>& ids, const ToDoFilter& filter, const map<string, string>& updates,
+                                 size_t& affected, const RequestContext* ctx = nullptr,
+                                 vector<pair<ToDoItem, ToDoItem>>* images = nullptr)
+    {
+        affected = 0;
+        try
+        {   
+            auto conn_ptr = this->get(ctx);
+            if (!conn_ptr) 
+            {
+                throw runtime_error("No available database connection");
+            }
+            ScopedStage query_stage(Timings(ctx), Stage::Query);
+            auto watch = watchdog_.Start(*conn_ptr, ctx);
+            pqxx::work txn(*conn_ptr);
+            ApplyDeadline(txn, ctx);
+
+            vector<string> params;
+            auto bind = [&](const string& val) {
+                params.push_back(val);
+                return "$" + to_string(params.size());
+            };
+
+            string set_clause;
+            for (const auto& [k, v] : updates) {
+                if (!set_clause.empty()) set_clause += ", ";
+                set_clause += SetColumn(k, bind(v));
+            }
+
+            string selection = BuildSelection(ids, filter, ListScope(ctx), ids.empty() ? TagCondition(txn, filter) : "", bind);
+            string query = "UPDATE ToDoItems t SET " + set_clause + 
+                           " FROM (SELECT " ITEM_COLUMNS " FROM ToDoItems " + selection + " FOR UPDATE) o"
+                           " WHERE t.list_id = " + bind(ListScope(ctx)) + " AND t.id = o.id"
+                           " RETURNING " RETURNING_IMAGES;
+            pqxx::result rows = ExecParams(txn, query, params);
+            ResolveTags(txn, rows);
+            txn.commit();
+            NoteWrite(*conn_ptr, ctx);
+
+            affected = rows.size();
+            if (images != nullptr) 
+            {
+                images->reserve(rows.size());
+                for (const auto& row : rows) 
+                {
+                    images->emplace_back(RowToItem(row, 0), RowToItem(row, kItemColumnCount));
+                }
+            }
+        }
+        catch (const pqxx::sql_error& se) 
+        {
+            NoteFailure(se, ctx);
+            cerr << "Database error: " << se.what() << "\n";
+            return false;
+        }
+        catch (const exception& e) 
+        {
+            NoteFailure(e, ctx);
+            cerr << "Error: " << e.what() << "\n";
+            return false;
+        }
+        return true;
+    }
+
+    // Deletes every row selected by `ids` (when non-empty) or `filter` in one
+    // transaction. `deleted`, when given, receives the removed rows.
+    //
+    virtual bool DeleteToDoItems(const vector<string>& ids, const ToDoFilter& filter, size_t& affected,
+                                 const RequestContext* ctx = nullptr, vector<ToDoItem>* deleted = nullptr)
+    {
+        affected = 0;
+        try
+        {   
+            auto conn_ptr = this->get(ctx);
+            if (!conn_ptr) 
+            {
+                throw runtime_error("No available database connection");
+            }
+            ScopedStage query_stage(Timings(ctx), Stage::Query);
+            auto watch = watchdog_.Start(*conn_ptr, ctx);
+            pqxx::work txn(*conn_ptr);
+            ApplyDeadline(txn, ctx);
+
+            vector<string> params;
+            auto bind = [&](const string& val) {
+                params.push_back(val);
+                return "$" + to_string(params.size());
+            };
+            string selection = BuildSelection(ids, filter, ListScope(ctx), ids.empty() ? TagCondition(txn, filter) : "", bind);
+            string query = "DELETE FROM ToDoItems " + selection + " RETURNING " ITEM_COLUMNS;
+            pqxx::result rows = ExecParams(txn, query, params);
+            ResolveTags(txn, rows);
+            txn.commit();
+            NoteWrite(*conn_ptr, ctx);
+
+            affected = rows.size();
+            if (deleted != nullptr) 
+            {
+                deleted->reserve(rows.size());
+                for (const auto& row : rows) 
+                {
+                    deleted->push_back(RowToItem(row));
+                }
+            }
+        }
+        catch (const pqxx::sql_error& se) 
+        {
+            NoteFailure(se, ctx);
+            cerr << "Database error: " << se.what() << "\n";
+            return false;
+        }
+        catch (const exception& e) 
+        {
+            NoteFailure(e, ctx);
+            cerr << "Error: " << e.what() << "\n";
+            return false;
+        }
+        return true;
+    }
+
+private:
+    // The list a request is scoped to; the default list for unscoped requests
+    //
+    static const string& ListScope(const RequestContext* ctx)
+    {
+        return (ctx != nullptr && !ctx->list_id.empty()) ? ctx->list_id : kDefaultListId;
+    }
+
+    static chrono::steady_clock::time_point Deadline(const RequestContext* ctx)
+    {
+        return ctx != nullptr ? ctx->deadline : chrono::steady_clock::time_point::max();
+    }
+
+    // Expired requests are dropped before they take a connection
+    //
+    static void CheckDeadline(const RequestContext* ctx)
+    {
+        if (ctx != nullptr && ctx->Expired())
+        {
+            throw runtime_error("Request deadline exceeded");
+        }
+    }
+
+    // Bounds the transaction's statements by what is left of the request's
+    // deadline; one extra round trip, only for requests that have a deadline
+    //
+    static void ApplyDeadline(pqxx::transaction_base& txn, const RequestContext* ctx)
+    {
+        if (ctx == nullptr || !ctx->HasDeadline())
+        {
+            return;
+        }
+        auto left = chrono::duration_cast<chrono::milliseconds>(ctx->deadline - chrono::steady_clock::now()).count();
+        if (left <= 0)
+        {
+            throw runtime_error("Request deadline exceeded");
+        }
+        txn.exec("SET LOCAL statement_timeout = " + to_string(left));
+    }
+
+    // Where a request's pool wait and query time is accumulated; nullptr (no
+    // timing) for calls made outside a request
+    //
+    static RequestTimings* Timings(const RequestContext* ctx)
+    {
+        return ctx != nullptr ? &ctx->timings : nullptr;
+    }
+
+    // Fills `item` from an ITEM_COLUMNS row read through stream_from. The
+    // caller has loaded the tag names (LoadAllTags).
+    //
+    void StreamedRowToItem(const vector<pqxx::zview>& f, ToDoItem& item) const
+    {
+        item.id = string(f[0]);
+        item.name = string(f[1]);
+        item.description = f[2].data() == nullptr ? "" : string(f[2]);
+        item.due_date = f[3].data() == nullptr ? "" : string(f[3]);
+        item.status = string(f[4]);
+        item.priority = f[5].data() == nullptr ? 3 : stoi(string(f[5]));
+        item.tags = f[6].data() == nullptr ? vector<string>{} : tags_.Names(TagDictionary::ParseIds(string(f[6])));
+        item.list_id = string(f[7]);
+        item.version = stoull(string(f[8]));
+    }
+
+    // Reads the ITEM_COLUMNS starting at column `offset` of `row`, whose tags
+    // went through ResolveTags
+    //
+    ToDoItem RowToItem(const pqxx::row& row, int offset = 0) const
+    {
+        ToDoItem item;
+        item.id          = row[offset].as<string>();
+        item.name        = row[offset + 1].as<string>();
+        item.description = row[offset + 2].is_null() ? "" : row[offset + 2].as<string>();
+        item.due_date    = row[offset + 3].is_null() ? "" : row[offset + 3].as<string>();
+        item.status      = row[offset + 4].as<string>();
+        item.priority    = row[offset + 5].is_null() ? 3 : row[offset + 5].as<int>();
+        item.tags        = row[offset + 6].is_null() ? vector<string>{} : tags_.Names(TagDictionary::ParseIds(row[offset + 6].as<string>()));
+        item.list_id     = row[offset + 7].as<string>();
+        item.version     = row[offset + 8].as<uint64_t>();
+        return item;
+    }
+
+    // Runs `sql` with any number of text parameters
+    //
+    static pqxx::result ExecParams(pqxx::transaction_base& txn, const string& sql, const vector<string>& params)
+    {
+        pqxx::params values;
+        values.reserve(params.size());
+        for (const auto& param : params) 
+        {
+            values.append(param);
+        }
+        return txn.exec_params(sql, values);
+    }
+
+    // Builds the row selection for the bulk operations within list `list_id`:
+    // the id set when one is given, the list filters otherwise.
+    //
+    static string BuildSelection(const vector<string>& ids, const ToDoFilter& filter, const string& list_id,
+                                 const string& tag_condition, const function<string(const string&)>& bind)
+    {
+        if (ids.empty()) 
+        {
+            return BuildWhereClause(filter, list_id, tag_condition, bind);
+        }
+        // ids are validated as UUIDs by the service layer, so they are safe in an array literal
+        string array = "{";
+        for (size_t i = 0; i < ids.size(); ++i) 
+        {
+            if (i > 0) array += ",";
+            array += ids[i];
+        }
+        array += "}";
+        return "WHERE list_id = " + bind(list_id) + " AND id = ANY(" + bind(array) + "::uuid[])";
+    }
+
+    // Serializes the projected columns of `row`; columns outside `fields`
+    // are neither selected nor touched here.
+    //
+    json::object RowToJson(const pqxx::row& row, const ToDoFields& fields) const
+    {
+        json::object item;
+        item.reserve(ToDoFields::Count);
+
+        item["id"] = row["id"].as<string>();
+        if (fields.Has(ToDoFields::Name)) 
+        {
+            item["name"] = row["name"].as<string>();
+        }
+        if (fields.Has(ToDoFields::Description)) 
+        {
+            item["description"] = row["description"].is_null() ? "" : row["description"].as<string>();
+        }
+        if (fields.Has(ToDoFields::DueDate)) 
+        {
+            item["due_date"] = row["due_date"].is_null() ? "" : row["due_date"].as<string>();
+        }
+        if (fields.Has(ToDoFields::Status)) 
+        {
+            item["status"] = row["status"].as<string>();
+        }
+        if (fields.Has(ToDoFields::Priority)) 
+        {
+            item["priority"] = row["priority"].as<int>();
+        }
+        if (fields.Has(ToDoFields::Tags)) 
+        {
+            json::array tags;
+            if (!row["tag_ids"].is_null()) 
+            {
+                for (auto& name : tags_.Names(TagDictionary::ParseIds(row["tag_ids"].as<string>()))) 
+                {
+                    tags.emplace_back(move(name));
+                }
+            }
+            item["tags"] = move(tags);
+        }
+        return item;
+    }
+
+    // Builds the WHERE clause for the list filters within list `list_id`.
+    // The partition key always comes first so that Postgres prunes to one
+    // partition. `bind` turns a value into the SQL text referencing it: a $n
+    // placeholder, or a quoted literal where bind parameters are not
+    // available. The tag filters come in already resolved by TagCondition().
+    // For a text search, `rank_expr` receives the matching ts_rank()
+    // expression.
+    //
+    static string BuildWhereClause(const ToDoFilter& filter, const string& list_id, const string& tag_condition,
+                                   const function<string(const string&)>& bind, string* rank_expr = nullptr)
+    {
+        string where_clause;
+
+        auto add_condition = [&](const string& cond) {
+            where_clause += (where_clause.empty() ? "WHERE " : " AND ");
+            where_clause += cond;
+        };
+
+        add_condition("list_id = " + bind(list_id));
+
+        if (filter.status.has_value()) 
+        {
+            add_condition("status = " + bind(*filter.status));
+        }
+
+        if (filter.due_date_after.has_value()) 
+        {
+            add_condition("due_date > " + bind(*filter.due_date_after));
+        }
+
+        if (filter.due_date_before.has_value()) 
+        {
+            add_condition("due_date < " + bind(*filter.due_date_before));
+        }
+
+        if (filter.min_priority.has_value()) 
+        {
+            add_condition("priority >= " + bind(to_string(*filter.min_priority)));
+        }
+
+        if (filter.max_priority.has_value()) 
+        {
+            add_condition("priority <= " + bind(to_string(*filter.max_priority)));
+        }
+
+        if (!tag_condition.empty()) 
+        {
+            add_condition(tag_condition);
+        }
+
+        if (filter.search.has_value()) 
+        {
+            // Served by the GIN index on the generated search_vector column
+            string query = "to_tsquery('simple', " + bind(*filter.search) + ")";
+            add_condition("search_vector @@ " + query);
+            if (rank_expr != nullptr) 
+            {
+                *rank_expr = "ts_rank(search_vector, " + query + ")";
+            }
+        }
+
+        return where_clause;
+    }
+
+    // SQL condition for the tag filters of `filter`, empty without any. Names
+    // are resolved to ids here, so the GIN index on tag_ids is probed with
+    // integer constants: containment (@>) for tags_all and `tag`, overlap (&&)
+    // for tags_any. A name the dictionary does not hold matches no item.
+    //
+    string TagCondition(pqxx::transaction_base& txn, const ToDoFilter& filter)
+    {
+        vector<string> all = filter.tags_all;
+        if (filter.tag.has_value()) all.push_back(*filter.tag);
+        if (all.empty() && filter.tags_any.empty()) 
+        {
+            return "";
+        }
+
+        vector<string> unknown;
+        TagDictionary::TagId id = 0;
+        for (const auto& names : {all, filter.tags_any}) 
+        {
+            for (const auto& name : names) 
+            {
+                if (!tags_.FindCommitted(name, id)) unknown.push_back(name);
+            }
+        }
+        if (!unknown.empty()) 
+        {
+            // Runs before this transaction writes anything, so only committed tags are seen
+            for (const auto& row : txn.exec_params("SELECT id, name FROM Tags WHERE name = ANY($1::text[])", unknown)) 
+            {
+                tags_.LearnCommitted(row[0].as<TagDictionary::TagId>(), row[1].as<string>());
+            }
+        }
+
+        auto resolve = [&](const vector<string>& names, vector<TagDictionary::TagId>& ids) {
+            bool found_all = true;
+            for (const auto& name : names) 
+            {
+                if (tags_.FindCommitted(name, id)) ids.push_back(id);
+                else found_all = false;
+            }
+            return found_all;
+        };
+
+        string condition;
+        vector<TagDictionary::TagId> ids;
+        if (!all.empty()) 
+        {
+            if (!resolve(all, ids)) return "FALSE";
+            condition = "tag_ids @> '" + TagDictionary::FormatIds(ids) + "'::int[]";
+        }
+        if (!filter.tags_any.empty()) 
+        {
+            ids.clear();
+            resolve(filter.tags_any, ids);
+            if (ids.empty()) return "FALSE";
+            if (!condition.empty()) condition += " AND ";
+            condition += "tag_ids && '" + TagDictionary::FormatIds(ids) + "'::int[]";
+        }
+        return condition;
+    }
+
+    // `column = value` for an UPDATE; tag names are interned into ids
+    //
+    static string SetColumn(const string& column, const string& value)
+    {
+        if (column == "tags") 
+        {
+            return "tag_ids = intern_tags(" + value + "::text[])";
+        }
+        return column + " = " + value;
+    }
+
+    // Teaches the dictionary the names behind the tag_ids columns of `rows`
+    // with at most one query. Call before the commit: tags the statement
+    // interned are only visible inside its transaction until then.
+    //
+    void ResolveTags(pqxx::transaction_base& txn, const pqxx::result& rows)
+    {
+        vector<TagDictionary::TagId> ids;
+        for (const auto& row : rows) 
+        {
+            CollectTagIds(row, ids);
+        }
+        LoadTags(txn, ids);
+    }
+
+    void ResolveTags(pqxx::transaction_base& txn, const pqxx::row& row)
+    {
+        vector<TagDictionary::TagId> ids;
+        CollectTagIds(row, ids);
+        LoadTags(txn, ids);
+    }
+
+    static void CollectTagIds(const pqxx::row& row, vector<TagDictionary::TagId>& ids)
+    {
+        for (const auto& field : row) 
+        {
+            if (!field.is_null() && string_view(field.name()) == "tag_ids") 
+            {
+                auto row_ids = TagDictionary::ParseIds(field.c_str());
+                ids.insert(ids.end(), row_ids.begin(), row_ids.end());
+            }
+        }
+    }
+
+    void LoadTags(pqxx::transaction_base& txn, const vector<TagDictionary::TagId>& ids)
+    {
+        auto missing = tags_.Missing(ids);
+        if (missing.empty()) 
+        {
+            return;
+        }
+        auto rows = txn.exec_params("SELECT id, name FROM Tags WHERE id = ANY($1::int[])", TagDictionary::FormatIds(missing));
+        for (const auto& row : rows) 
+        {
+            tags_.Learn(row[0].as<TagDictionary::TagId>(), row[1].as<string>());
+        }
+    }
+
+    // Loads the whole dictionary ahead of a scan over many rows. In a
+    // REPEATABLE READ transaction this covers every tag its rows refer to.
+    //
+    void LoadAllTags(pqxx::transaction_base& txn)
+    {
+        auto stream = pqxx::stream_from::query(txn, "SELECT id, name FROM Tags");
+        while (auto fields = stream.read_row()) 
+        {
+            const auto& f = *fields;
+            tags_.LearnCommitted(stoi(string(f[0])), string(f[1]));
+        }
+        stream.complete();
+    }
+
+    // Ties are broken by id so that LIMIT/OFFSET pages are stable
+    //
+    static string BuildOrderClause(const optional<string>& sort_by, const optional<string>& sort_order,
+                                   const string& rank_expr = "")
+    {
+        string order_clause = " ORDER BY ";
+
+        string field = sort_by.value_or("due_date");
+        string direction = (sort_order.value_or("asc") == "desc") ? "DESC" : "ASC";
+
+        if (field == "due_date") 
+        {
+            order_clause += "due_date " + direction + " NULLS LAST";
+        } 
+        else if (field == "name") 
+        {
+            order_clause += "name " + direction;
+        } 
+        else if (field == "status") 
+        {
+            order_clause += "status " + direction;
+        } 
+        else if (field == "id") 
+        {
+            order_clause += "id " + direction;
+        } 
+        else if (field == "priority") 
+        {
+            order_clause += "priority " + direction + " NULLS LAST";
+        } 
+        else if (field == "rank" && !rank_expr.empty()) 
+        {
+            order_clause += rank_expr + " " + direction;
+        } 
+        else 
+        {
+            order_clause += "due_date ASC NULLS LAST";  // fallback
+        }
+        if (field != "id") 
+        {
+            order_clause += ", id ASC";
+        }
+        return order_clause;
+    }
+
+    struct Replica
+    {
+        string name;
+        unique_ptr<ConnectionPool> pool;
+        atomic<bool> healthy{false};
+        atomic<uint64_t> replay_lsn{0};
+        atomic<double> lag_seconds{0};
+    };
+
+    // LSN a replica must have replayed to serve this client; 0 for none
+    //
+    uint64_t RequiredLsn(const RequestContext* ctx) const
+    {
+        if (!read_your_writes_ || ctx == nullptr || ctx->client_id.empty())
+        {
+            return 0;
+        }
+        lock_guard<mutex> lock(writes_mtx_);
+        auto it = client_writes_.find(ctx->client_id);
+        return it != client_writes_.end() ? it->second : 0;
+    }
+
+    // Records the primary's WAL position after a committed write so that the
+    // client's following reads wait for a replica that has replayed it.
+    //
+    void NoteWrite(pqxx::connection& conn, const RequestContext* ctx)
+    {
+        if (!read_your_writes_ || replicas_.empty() || ctx == nullptr || ctx->client_id.empty())
+        {
+            return;
+        }
+        uint64_t lsn = 0;
+        try
+        {
+            pqxx::nontransaction txn(conn);
+            lsn = parse_lsn(txn.query_value<string>("SELECT pg_current_wal_lsn()::text"));
+        }
+        catch (const exception& e)
+        {
+            // The write itself is committed; only the routing hint is lost
+            cerr << "Failed to read WAL position after write: " << e.what() << "\n";
+            return;
+        }
+
+        lock_guard<mutex> lock(writes_mtx_);
+        uint64_t& recorded = client_writes_[ctx->client_id];
+        if (lsn > recorded)
+        {
+            recorded = lsn;
+        }
+    }
+
+    // Polls the primary's WAL position and each replica's replay position.
+    // Client write marks that every healthy replica has passed are dropped;
+    // pruned_lsn_ remembers how far, for replicas that were not healthy.
+    //
+    void MonitorReplicas()
+    {
+        while (!stopping_)
+        {
+            if (auto conn = primary_.get())
+            {
+                try
+                {
+                    pqxx::nontransaction txn(*conn);
+                    primary_lsn_ = parse_lsn(txn.query_value<string>("SELECT pg_current_wal_lsn()::text"));
+                }
+                catch (const exception& e)
+                {
+                    cerr << "Primary LSN poll failed: " << e.what() << "\n";
+                }
+            }
+
+            uint64_t min_replayed = numeric_limits<uint64_t>::max();
+            for (auto& replica : replicas_)
+            {
+                bool healthy = false;
+                if (auto conn = replica->pool->get())
+                {
+                    try
+                    {
+                        pqxx::nontransaction txn(*conn);
+                        auto row = txn.exec1(
+                            "SELECT pg_last_wal_replay_lsn()::text, "
+                            "COALESCE(EXTRACT(EPOCH FROM now() - pg_last_xact_replay_timestamp()), 0)::float8");
+                        replica->replay_lsn = row[0].is_null() ? 0 : parse_lsn(row[0].as<string>());
+                        replica->lag_seconds = row[1].as<double>();
+                        healthy = !row[0].is_null();
+                    }
+                    catch (const exception& e)
+                    {
+                        cerr << replica->name << " lag poll failed: " << e.what() << "\n";
+                    }
+                }
+                replica->healthy = healthy;
+                if (healthy && replica->replay_lsn < min_replayed)
+                {
+                    min_replayed = replica->replay_lsn;
+                }
+            }
+
+            if (min_replayed != numeric_limits<uint64_t>::max())
+            {
+                lock_guard<mutex> lock(writes_mtx_);
+                for (auto it = client_writes_.begin(); it != client_writes_.end();)
+                {
+                    it = it->second <= min_replayed ? client_writes_.erase(it) : next(it);
+                }
+                if (min_replayed > pruned_lsn_)
+                {
+                    pruned_lsn_ = min_replayed;
+                }
+            }
+
+            this_thread::sleep_for(chrono::milliseconds(500));
+        }
+    }
+
+    static json::object PoolStatsJson(const PoolStats& s)
+    {
+        return json::object{
+            {"open",        s.open},
+            {"idle",        s.idle},
+            {"leases",      s.leases},
+            {"timeouts",    s.timeouts},
+            {"grown",       s.grown},
+            {"shrunk",      s.shrunk},
+            {"reconnects",  s.reconnects},
+            {"avg_wait_ms", s.avg_wait_ms},
+            {"max_wait_ms", s.max_wait_ms},
+            {"mutex_acquisitions", s.mutex_acquisitions},
+            {"mutex_contended",    s.mutex_contended},
+            {"thread_hits",        s.thread_hits},
+            {"shared_hits",        s.shared_hits},
+            {"steals",             s.steals}
+        };
+    }
+
+    static PoolOptions MakePoolOptions(size_t min_size, size_t max_size, bool thread_affine)
+    {
+        PoolOptions options;
+        options.min_size = min_size;
+        options.max_size = max_size;
+        options.thread_affine = thread_affine;
+        return options;
+    }
+
+    size_t min_size_;
+    size_t max_size_;
+    bool thread_affine_;
+    QueryWatchdog watchdog_;
+    TagDictionary tags_;
+    ConnectionPool primary_;
+    vector<unique_ptr<Replica>> replicas_;
+    atomic<size_t> next_replica_{0};
+    atomic<uint64_t> primary_lsn_{0};
+
+    bool read_your_writes_ = false;
+    mutable mutex writes_mtx_;
+    unordered_map<string, uint64_t> client_writes_;   // client id -> LSN of its latest write
+    atomic<uint64_t> pruned_lsn_{0};                   // marks at or below this were dropped
+
+    atomic<size_t> replica_reads_{0};
+    atomic<size_t> primary_reads_{0};
+    atomic<size_t> read_your_writes_reads_{0};
+    atomic<size_t> broken_read_retries_{0};
+
+    atomic<bool> stopping_{false};
+    thread monitor_;
 };
 
 #endif
\ No newline at end of file
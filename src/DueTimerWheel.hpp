@@ -0,0 +1,550 @@
+#ifndef DUE_TIMER_WHEEL_HPP
+#define DUE_TIMER_WHEEL_HPP
+
+#include <boost/json.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <ctime>
+#include <deque>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "DbAccess.hpp"
+#include "ToDoObserver.hpp"
+#include "Utility.hpp"
+
+using namespace std;
+
+// Open items with a due date, scheduled in a hierarchical timing wheel so that
+// overdue and reminder events fire without polling the table, and so that
+// GET /todos/due is answered from memory.
+//
+// The wheel has kLevels levels of kSlots one-second slots each; level L covers
+// the next 2^(8 * (L + 1)) seconds, so four levels reach ~136 years. A timer
+// sits in the slot of the level that fits its distance and moves one level
+// down whenever that slot comes up (cascading), until it fires from level 0.
+// Slots are intrusive doubly linked lists over a pooled vector of timers, and
+// timers are found by "list_id/id", so scheduling and cancelling are O(1);
+// each tick touches only the slots that are due. Each list also keeps its
+// timers ordered by due time, so GET /todos/due reads only the list's
+// entries up to the horizon instead of walking the wheel.
+//
+// Each item gets one timer. With a reminder lead it first fires a Reminder
+// at due - lead, is then rescheduled for the due time and fires Overdue;
+// overdue items stay in a separate list until they are completed, deleted or
+// moved into the future. Loading is quiet: items that are already overdue or
+// within the lead when the wheel is built do not fire again.
+//
+// Observer callbacks arrive in thread order, not commit order, so every
+// image is checked against the row version the wheel holds for the item:
+// older images are dropped, and cancelled items leave a tombstone with their
+// version so that a late update cannot bring a deleted item back.
+//
+class DueTimerWheel : public ToDoObserver
+{
+public:
+    enum class Event { Reminder, Overdue };
+
+    // Receives fired events on the ticking thread, outside the wheel's lock
+    using Sink = function<void(Event, const ToDoItem&)>;
+
+    // Hands every item to the callback; false when the scan failed
+    using ItemScan = function<bool(const function<void(const ToDoItem&)>&)>;
+
+    struct DueItem
+    {
+        ToDoItem item;
+        int64_t due = 0;
+        bool overdue = false;
+    };
+
+    static constexpr int kSlotBits = 8;
+    static constexpr uint32_t kSlots = 1u << kSlotBits;
+    static constexpr int kLevels = 4;
+
+    // `reminder_lead_s` <= 0 disables reminders
+    //
+    explicit DueTimerWheel(int64_t reminder_lead_s = 3600, int64_t now = time(nullptr))
+        : lead_(reminder_lead_s), now_(now), heads_(kBuckets, kNil)
+    {
+    }
+
+    ~DueTimerWheel()
+    {
+        {
+            lock_guard<mutex> lock(mtx_);
+            stopping_ = true;
+        }
+        wake_.notify_all();
+        if (ticker_.joinable())
+        {
+            ticker_.join();
+        }
+    }
+
+    DueTimerWheel(const DueTimerWheel&) = delete;
+    DueTimerWheel& operator=(const DueTimerWheel&) = delete;
+
+    // Set before Start()
+    //
+    void SetSink(Sink sink)
+    {
+        sink_ = move(sink);
+    }
+
+    // Set before Load() and Start(); <= 0 disables reminders
+    //
+    void SetReminderLead(int64_t reminder_lead_s)
+    {
+        lead_ = reminder_lead_s;
+    }
+
+    // Advances the wheel to the wall clock every `tick` on a background thread
+    //
+    void Start(chrono::milliseconds tick = chrono::seconds(1))
+    {
+        ticker_ = thread([this, tick] {
+            unique_lock<mutex> lock(mtx_);
+            while (!stopping_)
+            {
+                wake_.wait_for(lock, tick, [this] { return stopping_; });
+                if (stopping_) break;
+                lock.unlock();
+                Advance(time(nullptr));
+                lock.lock();
+            }
+        });
+    }
+
+    // Replaces the timers with a fresh scan of the table
+    //
+    bool Load(PgPool& pool, int64_t now = time(nullptr))
+    {
+        return Load([&pool](const function<void(const ToDoItem&)>& on_item) { return pool.ScanToDoItems(on_item); },
+                    now);
+    }
+
+    // Replaces the timers with the items `scan` yields, e.g. from a snapshot
+    //
+    bool Load(const ItemScan& scan, int64_t now = time(nullptr))
+    {
+        DueTimerWheel fresh(lead_, now);
+        if (!scan([&](const ToDoItem& item) { fresh.Schedule(item, true); }))
+        {
+            return false;
+        }
+
+        lock_guard<mutex> lock(mtx_);
+        now_ = fresh.now_;
+        timers_ = move(fresh.timers_);
+        free_ = move(fresh.free_);
+        heads_ = move(fresh.heads_);
+        index_ = move(fresh.index_);
+        by_list_ = move(fresh.by_list_);
+        overdue_ = fresh.overdue_;
+        return true;
+    }
+
+    void OnCreated(const ToDoItem& item) override
+    {
+        lock_guard<mutex> lock(mtx_);
+        Schedule(item, false);
+    }
+
+    void OnUpdated(const ToDoItem& before, const ToDoItem& after) override
+    {
+        lock_guard<mutex> lock(mtx_);
+        if (before.list_id != after.list_id || before.id != after.id)
+        {
+            string old_key = Key(before);
+            if (!Stale(old_key, after.version))
+            {
+                Cancel(old_key, after.version);
+            }
+        }
+        Schedule(after, false);
+    }
+
+    void OnDeleted(const ToDoItem& item) override
+    {
+        lock_guard<mutex> lock(mtx_);
+        string key = Key(item);
+        if (Stale(key, item.version))
+        {
+            ++stale_images_;
+            return;
+        }
+        Cancel(key, item.version);
+    }
+
+    void OnBulkImport(const vector<ToDoItem>& items) override
+    {
+        lock_guard<mutex> lock(mtx_);
+        for (const auto& item : items)
+        {
+            Schedule(item, false);
+        }
+    }
+
+    // Moves the wheel forward to `now`, one slot per second, and hands what
+    // fired to the sink. Returns the number of events fired.
+    //
+    size_t Advance(int64_t now)
+    {
+        vector<pair<Event, ToDoItem>> fired;
+        {
+            lock_guard<mutex> lock(mtx_);
+            Drain(kExpired, fired);
+            while (now_ < now)
+            {
+                ++now_;
+                for (int level = 1; level < kLevels; ++level)
+                {
+                    int shift = kSlotBits * level;
+                    if ((now_ & ((int64_t(1) << shift) - 1)) != 0) break;
+                    Cascade(level * kSlots + ((now_ >> shift) & (kSlots - 1)));
+                }
+                Drain(now_ & (kSlots - 1), fired);
+                Drain(kExpired, fired);
+            }
+            for (const auto& event : fired)
+            {
+                ++(event.first == Event::Reminder ? reminders_fired_ : overdue_fired_);
+            }
+            ExpireTombstones();
+        }
+        if (sink_)
+        {
+            for (const auto& event : fired)
+            {
+                sink_(event.first, event.second);
+            }
+        }
+        return fired.size();
+    }
+
+    // Open items of `list_id` that are overdue or due within `within_s` of
+    // `now`, earliest first, at most `limit` of them. `matched` receives how
+    // many there are in total. Reads the list's own entries up to the
+    // horizon, so the cost follows the answer, not the number of timers.
+    //
+    vector<DueItem> Due(const string& list_id, int64_t within_s, size_t limit, size_t& matched,
+                        int64_t now = time(nullptr)) const
+    {
+        int64_t horizon = now + max<int64_t>(within_s, 0);
+        vector<DueItem> due;
+        matched = 0;
+        lock_guard<mutex> lock(mtx_);
+        auto list = by_list_.find(list_id);
+        if (list == by_list_.end())
+        {
+            return due;
+        }
+        for (const auto& entry : list->second)
+        {
+            if (entry.first.first > horizon) break;
+            if (matched++ < limit)
+            {
+                due.push_back({timers_[entry.second].item, entry.first.first, entry.first.first <= now});
+            }
+        }
+        return due;
+    }
+
+    size_t Size() const
+    {
+        lock_guard<mutex> lock(mtx_);
+        return index_.size();
+    }
+
+    int64_t Overdue() const
+    {
+        lock_guard<mutex> lock(mtx_);
+        return overdue_;
+    }
+
+    boost::json::object Metrics() const
+    {
+        lock_guard<mutex> lock(mtx_);
+        return {
+            {"timers",          index_.size()},
+            {"overdue",         overdue_},
+            {"reminders_fired", reminders_fired_},
+            {"overdue_fired",   overdue_fired_},
+            {"tombstones",      tombstones_.size()},
+            {"stale_images",    stale_images_},
+            {"clock",           now_}
+        };
+    }
+
+private:
+    static constexpr uint32_t kNil = UINT32_MAX;
+
+    // Buckets past the wheel's slots: timers that fired Overdue, and timers
+    // whose expiry had already passed when they were scheduled
+    static constexpr uint32_t kOverdue = kLevels * kSlots;
+    static constexpr uint32_t kExpired = kOverdue + 1;
+    static constexpr uint32_t kBuckets = kExpired + 1;
+
+    // How long (wheel seconds) a cancelled item's version is kept. Callbacks
+    // only race within the lifetime of the requests that sent them.
+    static constexpr int64_t kTombstoneSeconds = 600;
+
+    struct Tombstone
+    {
+        uint64_t version;
+        int64_t at;
+    };
+
+    struct Timer
+    {
+        ToDoItem item;
+        int64_t due = 0;
+        int64_t expires = 0;      // next firing: the reminder, then the due time
+        bool reminded = false;    // the reminder has fired or is skipped
+        uint32_t bucket = kNil;
+        uint32_t prev = kNil;
+        uint32_t next = kNil;
+    };
+
+    // A list's timers by (due time, item id)
+    using DueOrder = map<pair<int64_t, string>, uint32_t>;
+
+    static string Key(const ToDoItem& item)
+    {
+        return item.list_id + "/" + item.id;
+    }
+
+    // Whether `version` is older than what the wheel holds for `key`: its
+    // timer's image, or the tombstone it was cancelled with. Images without
+    // a version are always taken. Caller holds mtx_.
+    bool Stale(const string& key, uint64_t version) const
+    {
+        if (version == 0) return false;
+        auto it = index_.find(key);
+        if (it != index_.end())
+        {
+            return timers_[it->second].item.version > version;
+        }
+        auto tombstone = tombstones_.find(key);
+        return tombstone != tombstones_.end() && tombstone->second.version >= version;
+    }
+
+    // Caller holds mtx_ (or owns the object exclusively). Completed items and
+    // items without a (readable) due date are only cancelled. `quiet` skips
+    // the events that are already due, for loading.
+    void Schedule(const ToDoItem& item, bool quiet)
+    {
+        string key = Key(item);
+        if (Stale(key, item.version))
+        {
+            ++stale_images_;
+            return;
+        }
+        int64_t due = 0;
+        if (item.status == "Completed" || item.due_date.empty() || !parse_timestamp(item.due_date, due))
+        {
+            Cancel(key, item.version);
+            return;
+        }
+
+        auto existing = index_.find(key);
+        if (existing != index_.end())
+        {
+            Timer& timer = timers_[existing->second];
+            if (timer.due == due)
+            {
+                // Same deadline: keep the timer where it is, with its events
+                timer.item = item;
+                return;
+            }
+            Cancel(key);
+        }
+
+        uint32_t i = Allocate();
+        Timer& timer = timers_[i];
+        timer.item = item;
+        timer.due = due;
+        tombstones_.erase(key);
+        index_.emplace(move(key), i);
+        by_list_[item.list_id].emplace(make_pair(due, item.id), i);
+
+        // Reminders that are already due still fire for new deadlines, unless
+        // the item is overdue right away
+        bool reminder_due = due - lead_ <= now_;
+        timer.reminded = lead_ <= 0 || (reminder_due && (quiet || due <= now_));
+        timer.expires = timer.reminded ? due : due - lead_;
+        if (quiet && due <= now_)
+        {
+            Link(i, kOverdue);
+        }
+        else
+        {
+            Link(i, BucketFor(timer.expires));
+        }
+    }
+
+    // Caller holds mtx_. A non-zero `version` is kept as the key's tombstone.
+    void Cancel(const string& key, uint64_t version = 0)
+    {
+        if (version != 0)
+        {
+            tombstones_[key] = Tombstone{version, now_};
+            tombstone_order_.emplace_back(now_, key);
+        }
+        auto it = index_.find(key);
+        if (it == index_.end()) return;
+        uint32_t i = it->second;
+        index_.erase(it);
+        Unlink(i);
+        Timer& timer = timers_[i];
+        auto list = by_list_.find(timer.item.list_id);
+        if (list != by_list_.end())
+        {
+            list->second.erase(make_pair(timer.due, timer.item.id));
+            if (list->second.empty()) by_list_.erase(list);
+        }
+        timer.item = ToDoItem{};
+        free_.push_back(i);
+    }
+
+    // Caller holds mtx_
+    void ExpireTombstones()
+    {
+        while (!tombstone_order_.empty() && tombstone_order_.front().first + kTombstoneSeconds <= now_)
+        {
+            auto it = tombstones_.find(tombstone_order_.front().second);
+            if (it != tombstones_.end() && it->second.at == tombstone_order_.front().first)
+            {
+                tombstones_.erase(it);
+            }
+            tombstone_order_.pop_front();
+        }
+    }
+
+    uint32_t Allocate()
+    {
+        if (!free_.empty())
+        {
+            uint32_t i = free_.back();
+            free_.pop_back();
+            return i;
+        }
+        timers_.emplace_back();
+        return static_cast<uint32_t>(timers_.size() - 1);
+    }
+
+    // Expiries past the last level's reach are parked in its slots and
+    // rescheduled when they come up
+    uint32_t BucketFor(int64_t expires) const
+    {
+        if (expires <= now_) return kExpired;
+        uint64_t delta = static_cast<uint64_t>(expires - now_);
+        int level = 0;
+        while (level < kLevels - 1 && delta >= (uint64_t(1) << (kSlotBits * (level + 1))))
+        {
+            ++level;
+        }
+        return level * kSlots + ((expires >> (kSlotBits * level)) & (kSlots - 1));
+    }
+
+    void Link(uint32_t i, uint32_t bucket)
+    {
+        Timer& timer = timers_[i];
+        timer.bucket = bucket;
+        timer.prev = kNil;
+        timer.next = heads_[bucket];
+        if (timer.next != kNil) timers_[timer.next].prev = i;
+        heads_[bucket] = i;
+        if (bucket == kOverdue) ++overdue_;
+    }
+
+    void Unlink(uint32_t i)
+    {
+        Timer& timer = timers_[i];
+        if (timer.prev != kNil) timers_[timer.prev].next = timer.next;
+        else heads_[timer.bucket] = timer.next;
+        if (timer.next != kNil) timers_[timer.next].prev = timer.prev;
+        if (timer.bucket == kOverdue) --overdue_;
+        timer.bucket = timer.prev = timer.next = kNil;
+    }
+
+    // Detaches a bucket's list, so that timers can be relinked into the same
+    // bucket while it is walked
+    uint32_t Take(uint32_t bucket)
+    {
+        uint32_t head = heads_[bucket];
+        heads_[bucket] = kNil;
+        return head;
+    }
+
+    // Moves a higher level's slot down now that its time range has begun
+    void Cascade(uint32_t bucket)
+    {
+        for (uint32_t i = Take(bucket); i != kNil;)
+        {
+            uint32_t next = timers_[i].next;
+            Link(i, BucketFor(timers_[i].expires));
+            i = next;
+        }
+    }
+
+    // Fires the timers in a level 0 slot or in kExpired
+    void Drain(uint32_t bucket, vector<pair<Event, ToDoItem>>& fired)
+    {
+        for (uint32_t i = Take(bucket); i != kNil;)
+        {
+            Timer& timer = timers_[i];
+            uint32_t next = timer.next;
+            if (timer.expires > now_)
+            {
+                Link(i, BucketFor(timer.expires));
+            }
+            else if (!timer.reminded)
+            {
+                timer.reminded = true;
+                timer.expires = timer.due;
+                fired.emplace_back(Event::Reminder, timer.item);
+                Link(i, BucketFor(timer.expires));
+            }
+            else
+            {
+                fired.emplace_back(Event::Overdue, timer.item);
+                Link(i, kOverdue);
+            }
+            i = next;
+        }
+    }
+
+    int64_t lead_;
+    Sink sink_;
+
+    mutable mutex mtx_;
+    condition_variable wake_;
+    bool stopping_ = false;
+    thread ticker_;
+
+    int64_t now_;                        // the wheel's clock: every slot up to it has fired
+    vector<Timer> timers_;
+    vector<uint32_t> free_;
+    vector<uint32_t> heads_;             // kBuckets list heads
+    unordered_map<string, uint32_t> index_;
+    unordered_map<string, DueOrder> by_list_;    // list id -> its timers in due order
+    unordered_map<string, Tombstone> tombstones_;    // "list_id/id" -> version it was cancelled at
+    deque<pair<int64_t, string>> tombstone_order_;  // (wheel time, key), oldest first
+    int64_t overdue_ = 0;
+    uint64_t stale_images_ = 0;
+    uint64_t reminders_fired_ = 0;
+    uint64_t overdue_fired_ = 0;
+};
+
+#endif
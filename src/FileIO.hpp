@@ -0,0 +1,291 @@
+#ifndef FILE_IO_HPP
+#define FILE_IO_HPP
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <system_error>
+
+using namespace std;
+
+// The few file operations the mutation log and the snapshot need, on POSIX
+// descriptors (mmap, fdatasync, fsync of the directory) or on Win32 handles
+// (file mappings, FlushFileBuffers). Windows has no directory sync; NTFS
+// journals renames and creates itself.
+//
+// A file that is mapped cannot be replaced or truncated on Windows, so
+// callers drop their mapping of a file before rewriting it in place.
+//
+
+// Text of the last failed file operation, for log lines
+//
+inline string LastFileError()
+{
+#ifdef _WIN32
+    return system_category().message(static_cast<int>(GetLastError()));
+#else
+    return strerror(errno);
+#endif
+}
+
+// A whole file mapped read-only; unmapped when destroyed
+//
+class MappedFile
+{
+public:
+    // Maps `path`; nullptr when it is missing, empty or cannot be mapped
+    //
+    static unique_ptr<MappedFile> Open(const string& path)
+    {
+        unique_ptr<MappedFile> file(new MappedFile());
+#ifdef _WIN32
+        HANDLE handle = CreateFileW(filesystem::path(path).c_str(), GENERIC_READ,
+                                    FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, nullptr,
+                                    OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+        if (handle == INVALID_HANDLE_VALUE)
+        {
+            return nullptr;
+        }
+        LARGE_INTEGER size;
+        if (!GetFileSizeEx(handle, &size) || size.QuadPart == 0)
+        {
+            CloseHandle(handle);
+            return nullptr;
+        }
+        HANDLE mapping = CreateFileMappingW(handle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        CloseHandle(handle);
+        if (mapping == nullptr)
+        {
+            return nullptr;
+        }
+        void* view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+        CloseHandle(mapping);   // the view keeps the mapping alive
+        if (view == nullptr)
+        {
+            return nullptr;
+        }
+        file->data_ = static_cast<const char*>(view);
+        file->size_ = static_cast<size_t>(size.QuadPart);
+#else
+        int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0)
+        {
+            return nullptr;
+        }
+        struct stat st;
+        if (fstat(fd, &st) != 0 || st.st_size == 0)
+        {
+            close(fd);
+            return nullptr;
+        }
+        size_t size = static_cast<size_t>(st.st_size);
+        void* mapped = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (mapped == MAP_FAILED)
+        {
+            return nullptr;
+        }
+        madvise(mapped, size, MADV_SEQUENTIAL);
+        file->data_ = static_cast<const char*>(mapped);
+        file->size_ = size;
+#endif
+        return file;
+    }
+
+    ~MappedFile()
+    {
+#ifdef _WIN32
+        UnmapViewOfFile(data_);
+#else
+        munmap(const_cast<char*>(data_), size_);
+#endif
+    }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    const char* data() const { return data_; }
+
+    size_t size() const { return size_; }
+
+private:
+    MappedFile() = default;
+
+    const char* data_ = nullptr;
+    size_t size_ = 0;
+};
+
+// A file written sequentially from one thread and synced on demand
+//
+class AppendFile
+{
+public:
+    AppendFile() = default;
+    AppendFile(const AppendFile&) = delete;
+    AppendFile& operator=(const AppendFile&) = delete;
+
+    ~AppendFile()
+    {
+        Close();
+    }
+
+    // Opens `path` for appending, creating it; `truncate` empties it first
+    //
+    bool Open(const string& path, bool truncate)
+    {
+        Close();
+#ifdef _WIN32
+        handle_ = CreateFileW(filesystem::path(path).c_str(), GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_DELETE,
+                              nullptr, truncate ? CREATE_ALWAYS : OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (handle_ == INVALID_HANDLE_VALUE)
+        {
+            return false;
+        }
+        LARGE_INTEGER zero{};
+        if (!SetFilePointerEx(handle_, zero, nullptr, FILE_END))
+        {
+            Close();
+            return false;
+        }
+        return true;
+#else
+        fd_ = open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC | (truncate ? O_TRUNC : 0), 0644);
+        return fd_ >= 0;
+#endif
+    }
+
+    bool IsOpen() const
+    {
+#ifdef _WIN32
+        return handle_ != INVALID_HANDLE_VALUE;
+#else
+        return fd_ >= 0;
+#endif
+    }
+
+    // Writes all of `data`; false on the first failed write
+    //
+    bool Write(const char* data, size_t size)
+    {
+        size_t written = 0;
+        while (written < size)
+        {
+#ifdef _WIN32
+            DWORD chunk = static_cast<DWORD>(min<size_t>(size - written, 1u << 30));
+            DWORD n = 0;
+            if (!WriteFile(handle_, data + written, chunk, &n, nullptr))
+            {
+                return false;
+            }
+#else
+            ssize_t n = write(fd_, data + written, size - written);
+            if (n < 0)
+            {
+                if (errno == EINTR) continue;
+                return false;
+            }
+#endif
+            written += static_cast<size_t>(n);
+        }
+        return true;
+    }
+
+    // Waits until what was written is on stable storage
+    //
+    bool Sync()
+    {
+#ifdef _WIN32
+        return FlushFileBuffers(handle_) != 0;
+#elif defined(__APPLE__)
+        return fsync(fd_) == 0;
+#else
+        return fdatasync(fd_) == 0;
+#endif
+    }
+
+    void Close()
+    {
+#ifdef _WIN32
+        if (handle_ != INVALID_HANDLE_VALUE)
+        {
+            CloseHandle(handle_);
+            handle_ = INVALID_HANDLE_VALUE;
+        }
+#else
+        if (fd_ >= 0)
+        {
+            close(fd_);
+            fd_ = -1;
+        }
+#endif
+    }
+
+private:
+#ifdef _WIN32
+    HANDLE handle_ = INVALID_HANDLE_VALUE;
+#else
+    int fd_ = -1;
+#endif
+};
+
+// Makes the creates, renames and removals in `dir` durable
+//
+inline void SyncDirectory(const string& dir)
+{
+#ifndef _WIN32
+    int dir_fd = open(dir.empty() ? "." : dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (dir_fd >= 0)
+    {
+        fsync(dir_fd);
+        close(dir_fd);
+    }
+#else
+    (void)dir;
+#endif
+}
+
+// Replaces `path` with exactly `data`, or fails leaving it as it was: the
+// data goes to `path` + ".tmp", is synced, and is renamed over `path`
+//
+inline bool WriteFileAtomically(const string& path, const string& data)
+{
+    string tmp_path = path + ".tmp";
+    bool ok = false;
+    {
+        AppendFile tmp;
+        ok = tmp.Open(tmp_path, true) && tmp.Write(data.data(), data.size()) && tmp.Sync();
+    }
+    error_code ec;
+    if (ok)
+    {
+        filesystem::rename(tmp_path, path, ec);
+        ok = !ec;
+    }
+    if (!ok)
+    {
+        filesystem::remove(tmp_path, ec);
+        return false;
+    }
+    SyncDirectory(filesystem::path(path).parent_path().string());
+    return true;
+}
+
+#endif
@@ -0,0 +1,345 @@
+#ifndef LANE_SCHEDULER_HPP
+#define LANE_SCHEDULER_HPP
+
+#include <boost/json.hpp>
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <deque>
+#include <limits>
+#include <mutex>
+#include <string>
+#include <utility>
+
+using namespace std;
+
+// Classes of work that are admitted separately, so a burst of one kind cannot
+// take every connection and thread from the others
+//
+enum class Lane { Point, Write, Scan, Bulk, Count };
+
+static const char* LaneName(Lane lane)
+{
+    static const char* names[] = {"point", "write", "scan", "bulk"};
+    return names[static_cast<int>(lane)];
+}
+
+struct LaneOptions
+{
+    // Slots only this lane may use; reserved slots are not lent out
+    size_t reserved = 1;
+
+    // Most requests of the lane that may run at once (its worker budget)
+    size_t max_in_flight = 1;
+
+    // Share of the contended slots: lanes with waiting requests are served in
+    // proportion to their weights
+    unsigned weight = 1;
+};
+
+// Latencies in log2-spaced buckets from 0.01 ms, enough for percentiles to
+// within a factor of two without keeping samples
+//
+class LatencyHistogram
+{
+public:
+    void Add(double ms)
+    {
+        size_t bucket = 0;
+        for (double bound = kFirstBoundMs; bucket + 1 < kBuckets && ms > bound; bound *= 2)
+        {
+            ++bucket;
+        }
+        ++counts_[bucket];
+        ++total_;
+        max_ms_ = max(max_ms_, ms);
+    }
+
+    // Upper bound of the bucket holding the q-quantile
+    //
+    double Percentile(double q) const
+    {
+        if (total_ == 0) return 0;
+        uint64_t rank = static_cast<uint64_t>(ceil(q * total_));
+        uint64_t seen = 0;
+        double bound = kFirstBoundMs;
+        for (size_t i = 0; i < kBuckets; ++i, bound *= 2)
+        {
+            seen += counts_[i];
+            if (seen >= rank) return min(bound, max_ms_);
+        }
+        return max_ms_;
+    }
+
+    boost::json::object ToJson() const
+    {
+        return {
+            {"p50", Percentile(0.5)},
+            {"p99", Percentile(0.99)},
+            {"max", max_ms_}
+        };
+    }
+
+private:
+    static constexpr size_t kBuckets = 32;
+    static constexpr double kFirstBoundMs = 0.01;
+
+    uint64_t counts_[kBuckets] = {};
+    uint64_t total_ = 0;
+    double max_ms_ = 0;
+};
+
+// Admits requests into lanes that share a fixed number of execution slots
+// (one per database connection). Each lane keeps its reserved slots, may
+// borrow from the unreserved rest up to its max_in_flight, and waits in its
+// own FIFO queue otherwise.
+//
+// Slots count admissions, not connections: work that takes connections
+// without a lane (replica monitoring, snapshot catch-up, the startup scans)
+// competes with every lane, so the reservations are best-effort.
+//
+// When a slot frees up the waiting lanes are served by weighted fair
+// queueing (self-clocked): every request gets a virtual finish tag of
+// max(system virtual time, its lane's last tag) + 1 / weight, and the
+// admissible queue head with the smallest tag goes next. A lane with twice
+// the weight is therefore admitted twice as often while both are backlogged,
+// and an idle lane does not bank credit.
+//
+class LaneScheduler
+{
+public:
+    using Options = array<LaneOptions, static_cast<size_t>(Lane::Count)>;
+
+    // Holds one slot of a lane until released or destroyed. Empty when the
+    // request gave up waiting.
+    //
+    class Ticket
+    {
+    public:
+        Ticket() = default;
+        Ticket(LaneScheduler* scheduler, Lane lane)
+            : scheduler_(scheduler), lane_(lane), started_(chrono::steady_clock::now())
+        {
+        }
+        Ticket(Ticket&& other) noexcept
+            : scheduler_(exchange(other.scheduler_, nullptr)), lane_(other.lane_), started_(other.started_)
+        {
+        }
+        Ticket& operator=(Ticket&& other) noexcept
+        {
+            if (this != &other)
+            {
+                Release();
+                scheduler_ = exchange(other.scheduler_, nullptr);
+                lane_ = other.lane_;
+                started_ = other.started_;
+            }
+            return *this;
+        }
+        Ticket(const Ticket&) = delete;
+        Ticket& operator=(const Ticket&) = delete;
+
+        ~Ticket()
+        {
+            Release();
+        }
+
+        void Release()
+        {
+            if (scheduler_ != nullptr)
+            {
+                exchange(scheduler_, nullptr)->Release(lane_, started_);
+            }
+        }
+
+        explicit operator bool() const { return scheduler_ != nullptr; }
+
+    private:
+        LaneScheduler* scheduler_ = nullptr;
+        Lane lane_ = Lane::Point;
+        chrono::steady_clock::time_point started_;
+    };
+
+    // Reserved slots beyond `slots` are cut back lane by lane, from the last
+    //
+    LaneScheduler(size_t slots, const Options& options) : slots_(max<size_t>(slots, 1))
+    {
+        size_t reserved = 0;
+        for (size_t i = 0; i < kLanes; ++i)
+        {
+            LaneState& lane = lanes_[i];
+            lane.options = options[i];
+            lane.options.weight = max(1u, lane.options.weight);
+            lane.options.max_in_flight = max<size_t>(1, min(lane.options.max_in_flight, slots_));
+            lane.options.reserved = min(lane.options.reserved, lane.options.max_in_flight);
+            reserved += lane.options.reserved;
+        }
+        for (size_t i = kLanes; i-- > 0 && reserved > slots_;)
+        {
+            size_t cut = min(lanes_[i].options.reserved, reserved - slots_);
+            lanes_[i].options.reserved -= cut;
+            reserved -= cut;
+        }
+        shared_slots_ = slots_ - reserved;
+    }
+
+    // Waits for a slot in `lane` until `deadline`
+    //
+    Ticket Acquire(Lane lane_id, chrono::steady_clock::time_point deadline = chrono::steady_clock::time_point::max())
+    {
+        LaneState& lane = lanes_[static_cast<size_t>(lane_id)];
+        auto enqueued = chrono::steady_clock::now();
+        Waiter waiter;
+
+        unique_lock<mutex> lock(mtx_);
+        waiter.tag = max(virtual_time_, lane.last_tag) + 1.0 / lane.options.weight;
+        lane.last_tag = waiter.tag;
+        lane.queue.push_back(&waiter);
+        Dispatch();
+
+        while (!waiter.granted)
+        {
+            if (waiter.wake.wait_until(lock, deadline) == cv_status::timeout && !waiter.granted)
+            {
+                lane.queue.erase(find(lane.queue.begin(), lane.queue.end(), &waiter));
+                ++lane.timed_out;
+                return Ticket();
+            }
+        }
+        lane.wait.Add(chrono::duration<double, milli>(chrono::steady_clock::now() - enqueued).count());
+        return Ticket(this, lane_id);
+    }
+
+    size_t Queued(Lane lane) const
+    {
+        lock_guard<mutex> lock(mtx_);
+        return lanes_[static_cast<size_t>(lane)].queue.size();
+    }
+
+    size_t InFlight(Lane lane) const
+    {
+        lock_guard<mutex> lock(mtx_);
+        return lanes_[static_cast<size_t>(lane)].in_flight;
+    }
+
+    boost::json::object Metrics() const
+    {
+        lock_guard<mutex> lock(mtx_);
+        boost::json::object lanes;
+        for (size_t i = 0; i < kLanes; ++i)
+        {
+            const LaneState& lane = lanes_[i];
+            lanes[LaneName(static_cast<Lane>(i))] = boost::json::object{
+                {"reserved",      lane.options.reserved},
+                {"max_in_flight", lane.options.max_in_flight},
+                {"weight",        lane.options.weight},
+                {"queued",        lane.queue.size()},
+                {"in_flight",     lane.in_flight},
+                {"admitted",      lane.admitted},
+                {"timed_out",     lane.timed_out},
+                {"wait_ms",       lane.wait.ToJson()},
+                {"run_ms",        lane.run.ToJson()}
+            };
+        }
+        return {
+            {"slots",        slots_},
+            {"shared_slots", shared_slots_},
+            {"shared_in_use", SharedInUse()},
+            {"lanes",        move(lanes)}
+        };
+    }
+
+private:
+    static constexpr size_t kLanes = static_cast<size_t>(Lane::Count);
+
+    struct Waiter
+    {
+        double tag = 0;
+        bool granted = false;
+        condition_variable wake;
+    };
+
+    struct LaneState
+    {
+        LaneOptions options;
+        deque<Waiter*> queue;
+        size_t in_flight = 0;
+        double last_tag = 0;
+
+        uint64_t admitted = 0;
+        uint64_t timed_out = 0;
+        LatencyHistogram wait;
+        LatencyHistogram run;
+    };
+
+    // Slots lanes hold beyond their reservation. Caller holds mtx_.
+    //
+    size_t SharedInUse() const
+    {
+        size_t used = 0;
+        for (const auto& lane : lanes_)
+        {
+            if (lane.in_flight > lane.options.reserved) used += lane.in_flight - lane.options.reserved;
+        }
+        return used;
+    }
+
+    // Caller holds mtx_
+    //
+    bool CanAdmit(const LaneState& lane) const
+    {
+        if (lane.in_flight >= lane.options.max_in_flight) return false;
+        return lane.in_flight < lane.options.reserved || SharedInUse() < shared_slots_;
+    }
+
+    // Grants slots to queue heads in finish-tag order while any can be
+    // admitted. Caller holds mtx_.
+    //
+    void Dispatch()
+    {
+        for (;;)
+        {
+            LaneState* next = nullptr;
+            for (auto& lane : lanes_)
+            {
+                if (!lane.queue.empty() && CanAdmit(lane) && (next == nullptr || lane.queue.front()->tag < next->queue.front()->tag))
+                {
+                    next = &lane;
+                }
+            }
+            if (next == nullptr)
+            {
+                return;
+            }
+            Waiter* waiter = next->queue.front();
+            next->queue.pop_front();
+            ++next->in_flight;
+            ++next->admitted;
+            virtual_time_ = max(virtual_time_, waiter->tag);
+            waiter->granted = true;
+            waiter->wake.notify_one();
+        }
+    }
+
+    void Release(Lane lane_id, chrono::steady_clock::time_point started)
+    {
+        double run_ms = chrono::duration<double, milli>(chrono::steady_clock::now() - started).count();
+        lock_guard<mutex> lock(mtx_);
+        LaneState& lane = lanes_[static_cast<size_t>(lane_id)];
+        --lane.in_flight;
+        lane.run.Add(run_ms);
+        Dispatch();
+    }
+
+    const size_t slots_;
+    size_t shared_slots_ = 0;
+
+    mutable mutex mtx_;
+    array<LaneState, kLanes> lanes_;
+    double virtual_time_ = 0;
+};
+
+#endif
@@ -0,0 +1,865 @@
+#ifndef MUTATION_LOG_HPP
+#define MUTATION_LOG_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "FileIO.hpp"
+#include "ToDoObserver.hpp"
+#include "Utility.hpp"
+
+using namespace std;
+
+// One committed mutation as stored in the log, or an event about an item
+// (Reminder, Overdue) that travels the same stream without changing it
+//
+struct MutationRecord
+{
+    enum Op : uint8_t { Created = 1, Updated = 2, Deleted = 3, Reminder = 5, Overdue = 6 };
+
+    uint64_t seq = 0;
+    int64_t unix_ms = 0;
+    Op op = Created;
+    ToDoItem before;    // Updated, Deleted
+    ToDoItem after;     // Created, Updated, Reminder, Overdue
+};
+
+struct MutationLogOptions
+{
+    // The active segment is sealed and a new one started past this size
+    size_t segment_bytes = 64 << 20;
+
+    // Appends are buffered and written + synced together this often
+    chrono::milliseconds sync_interval{5};
+
+    // ... or as soon as this much is buffered
+    size_t max_pending_bytes = 1 << 20;
+
+    // While flushes fail, appends wait once this much is pending, for at
+    // most max_append_wait after the first failure; past that, records that
+    // do not fit are dropped (and counted) instead of buffered
+    size_t max_failing_bytes = 64 << 20;
+    chrono::milliseconds max_append_wait{1000};
+
+    // Sealed segments are folded into one once there are more than this many
+    size_t compact_after_segments = 8;
+};
+
+// Durable, append-only log of every mutation that goes through ToDoService,
+// kept as segment files "mutations-<first seq>.log" in one directory.
+//
+// Records are length-prefixed and checksummed:
+//
+//     u32 length | u32 crc32(body) | body
+//     body = u64 seq | i64 unix_ms | u8 op | [before item] | [after item]
+//     item = str id | str name | str description | str due_date | str status
+//            | i32 priority | u32 tag count | str tag... | str list_id | u64 version
+//     str  = u32 length | bytes
+//
+// Integers are in host byte order. Observer callbacks only encode the record
+// into a memory buffer; a background thread writes the buffer and syncs it
+// (FileIO.hpp) every sync_interval (group commit), so a crash loses at most that
+// window. A batch that fails to reach the disk is kept and written again to
+// a fresh segment; DurableSeq() does not move past it until it is synced.
+// The records buffered meanwhile are capped by max_failing_bytes: appends
+// first wait for the disk to come back, then drop what does not fit.
+// A segment's records end where the next segment begins, so whatever a
+// failed write left behind is never read.
+//
+// Records are appended in the order the observer callbacks arrive, which for
+// concurrent writes to one item is not necessarily commit order; the row
+// version in each image is. Sealed segments are compacted on a thread of
+// their own to the newest image of each live item by version (events are
+// dropped), and are read back through a file mapping by Replay().
+//
+class MutationLog : public ToDoObserver
+{
+public:
+    explicit MutationLog(const string& dir, MutationLogOptions options = {})
+        : dir_(dir), options_(options)
+    {
+        filesystem::create_directories(dir_);
+        Recover();
+        flusher_ = thread([this] { FlushLoop(); });
+        compactor_ = thread([this] { CompactLoop(); });
+    }
+
+    ~MutationLog()
+    {
+        {
+            lock_guard<mutex> lock(mtx_);
+            stopping_ = true;
+        }
+        wake_.notify_all();
+        room_.notify_all();
+        compact_wake_.notify_all();
+        if (flusher_.joinable())
+        {
+            flusher_.join();
+        }
+        if (compactor_.joinable())
+        {
+            compactor_.join();
+        }
+    }
+
+    MutationLog(const MutationLog&) = delete;
+    MutationLog& operator=(const MutationLog&) = delete;
+
+    void OnCreated(const ToDoItem& item) override
+    {
+        Append(MutationRecord::Created, nullptr, &item);
+    }
+
+    void OnUpdated(const ToDoItem& before, const ToDoItem& after) override
+    {
+        Append(MutationRecord::Updated, &before, &after);
+    }
+
+    void OnDeleted(const ToDoItem& item) override
+    {
+        Append(MutationRecord::Deleted, &item, nullptr);
+    }
+
+    // Imported rows are logged one by one, as Created records
+    void OnBulkImport(const vector<ToDoItem>& items) override
+    {
+        int64_t unix_ms = chrono::duration_cast<chrono::milliseconds>(
+            chrono::system_clock::now().time_since_epoch()).count();
+        {
+            unique_lock<mutex> lock(mtx_);
+            if (!MakeRoom(lock, items.size()))
+            {
+                return;
+            }
+            for (const auto& item : items)
+            {
+                uint64_t seq = next_seq_++;
+                Encode(seq, unix_ms, MutationRecord::Created, nullptr, &item, pending_);
+                pending_last_seq_ = seq;
+                ++appended_;
+            }
+        }
+        wake_.notify_one();
+    }
+
+    // Logs a Reminder or Overdue event for `item`, e.g. from DueTimerWheel
+    void OnEvent(MutationRecord::Op op, const ToDoItem& item)
+    {
+        Append(op, nullptr, &item);
+    }
+
+    // Highest sequence number that has reached the disk
+    //
+    uint64_t DurableSeq() const
+    {
+        return durable_seq_.load();
+    }
+
+    // Compaction leaves records from `seq` on untouched, so that a consumer
+    // that has not read them yet still sees every individual mutation
+    //
+    void SetRetainFrom(uint64_t seq)
+    {
+        retain_from_.store(seq);
+    }
+
+    // Calls `on_record` for every durable record with seq >= from_seq, in
+    // order, until it returns false. Compacted segments hold one Created
+    // record per live item, carrying its last image and sequence number.
+    //
+    void Replay(uint64_t from_seq, const function<bool(const MutationRecord&)>& on_record) const
+    {
+        uint64_t up_to = DurableSeq();
+        for (const auto& segment : Segments())
+        {
+            if (segment.first_seq > up_to)
+            {
+                return;
+            }
+            if (!ReadSegment(segment.path, from_seq, min(up_to, segment.last_seq), on_record))
+            {
+                return;
+            }
+        }
+    }
+
+    // Replays into observer callbacks, e.g. to warm an in-process cache that
+    // mirrors the mutations; events are skipped
+    //
+    void Replay(uint64_t from_seq, ToDoObserver& observer) const
+    {
+        Replay(from_seq, [&](const MutationRecord& rec) {
+            switch (rec.op)
+            {
+                case MutationRecord::Created:    observer.OnCreated(rec.after); break;
+                case MutationRecord::Updated:    observer.OnUpdated(rec.before, rec.after); break;
+                case MutationRecord::Deleted:    observer.OnDeleted(rec.before); break;
+                case MutationRecord::Reminder:
+                case MutationRecord::Overdue:    break;
+            }
+            return true;
+        });
+    }
+
+    boost::json::object Metrics() const
+    {
+        lock_guard<mutex> lock(mtx_);
+        return {
+            {"appended",    appended_},
+            {"durable_seq", durable_seq_.load()},
+            {"segments",    segments_.size()},
+            {"syncs",       syncs_},
+            {"compactions", compactions_},
+            {"write_errors", write_errors_},
+            {"failing",     failing_},
+            {"pending_bytes", pending_.size()},
+            {"dropped",     dropped_}
+        };
+    }
+
+    // Appends the encoded record to `out`. `before` / `after` must be set as
+    // the op requires (see MutationRecord).
+    //
+    static void Encode(uint64_t seq, int64_t unix_ms, MutationRecord::Op op,
+                       const ToDoItem* before, const ToDoItem* after, string& out)
+    {
+        size_t header = out.size();
+        out.append(8, '\0');
+        Put(out, seq);
+        Put(out, unix_ms);
+        Put(out, static_cast<uint8_t>(op));
+        if (before != nullptr) PutItem(out, *before);
+        if (after != nullptr) PutItem(out, *after);
+
+        uint32_t length = static_cast<uint32_t>(out.size() - header - 8);
+        uint32_t crc = crc32(out.data() + header + 8, length);
+        memcpy(&out[header], &length, 4);
+        memcpy(&out[header + 4], &crc, 4);
+    }
+
+    // Decodes the record at `data`. Returns false for a truncated or corrupt
+    // record, which ends the readable part of a segment.
+    //
+    static bool Decode(const char* data, size_t available, MutationRecord& rec, size_t& consumed)
+    {
+        uint32_t length, crc;
+        if (available < 8) return false;
+        memcpy(&length, data, 4);
+        memcpy(&crc, data + 4, 4);
+        if (length > available - 8 || crc32(data + 8, length) != crc)
+        {
+            return false;
+        }
+
+        Reader in{data + 8, data + 8 + length};
+        uint8_t op = 0;
+        in.Get(rec.seq);
+        in.Get(rec.unix_ms);
+        in.Get(op);
+        rec.op = static_cast<MutationRecord::Op>(op);
+        switch (op)
+        {
+            case MutationRecord::Created:    in.GetItem(rec.after); break;
+            case MutationRecord::Updated:    in.GetItem(rec.before); in.GetItem(rec.after); break;
+            case MutationRecord::Deleted:    in.GetItem(rec.before); break;
+            case MutationRecord::Reminder:
+            case MutationRecord::Overdue:    in.GetItem(rec.after); break;
+            default: return false;
+        }
+        if (!in.ok || in.pos != in.end)
+        {
+            return false;
+        }
+        consumed = 8 + length;
+        return true;
+    }
+
+private:
+    struct Reader
+    {
+        const char* pos;
+        const char* end;
+        bool ok = true;
+
+        template <class T>
+        void Get(T& value)
+        {
+            if (!ok || static_cast<size_t>(end - pos) < sizeof(T)) { ok = false; return; }
+            memcpy(&value, pos, sizeof(T));
+            pos += sizeof(T);
+        }
+
+        void GetString(string& value)
+        {
+            uint32_t size = 0;
+            Get(size);
+            if (!ok || static_cast<size_t>(end - pos) < size) { ok = false; return; }
+            value.assign(pos, size);
+            pos += size;
+        }
+
+        void GetItem(ToDoItem& item)
+        {
+            GetString(item.id);
+            GetString(item.name);
+            GetString(item.description);
+            GetString(item.due_date);
+            GetString(item.status);
+            int32_t priority = 0;
+            Get(priority);
+            item.priority = priority;
+            uint32_t tags = 0;
+            Get(tags);
+            item.tags.clear();
+            for (uint32_t i = 0; ok && i < tags; ++i)
+            {
+                item.tags.emplace_back();
+                GetString(item.tags.back());
+            }
+            GetString(item.list_id);
+            Get(item.version);
+        }
+    };
+
+    template <class T>
+    static void Put(string& out, T value)
+    {
+        out.append(reinterpret_cast<const char*>(&value), sizeof(T));
+    }
+
+    static void PutString(string& out, const string& value)
+    {
+        Put(out, static_cast<uint32_t>(value.size()));
+        out += value;
+    }
+
+    static void PutItem(string& out, const ToDoItem& item)
+    {
+        PutString(out, item.id);
+        PutString(out, item.name);
+        PutString(out, item.description);
+        PutString(out, item.due_date);
+        PutString(out, item.status);
+        Put(out, static_cast<int32_t>(item.priority));
+        Put(out, static_cast<uint32_t>(item.tags.size()));
+        for (const auto& tag : item.tags) PutString(out, tag);
+        PutString(out, item.list_id);
+        Put(out, item.version);
+    }
+
+    // The only work done on the request thread: one buffered append
+    //
+    void Append(MutationRecord::Op op, const ToDoItem* before, const ToDoItem* after)
+    {
+        int64_t unix_ms = chrono::duration_cast<chrono::milliseconds>(
+            chrono::system_clock::now().time_since_epoch()).count();
+        bool flush_now;
+        {
+            unique_lock<mutex> lock(mtx_);
+            if (!MakeRoom(lock, 1))
+            {
+                return;
+            }
+            uint64_t seq = next_seq_++;
+            Encode(seq, unix_ms, op, before, after, pending_);
+            pending_last_seq_ = seq;
+            ++appended_;
+            flush_now = pending_.size() >= options_.max_pending_bytes;
+        }
+        if (flush_now)
+        {
+            wake_.notify_one();
+        }
+    }
+
+    // Called with mtx_ held before `records` are buffered. While flushes
+    // fail and max_failing_bytes are pending, waits for the flusher to catch
+    // up until max_append_wait after the first failure; false, with the
+    // records counted as dropped, if it has not by then.
+    //
+    bool MakeRoom(unique_lock<mutex>& lock, size_t records)
+    {
+        auto has_room = [this] {
+            return stopping_ || !failing_ || pending_.size() < options_.max_failing_bytes;
+        };
+        if (has_room())
+        {
+            return true;
+        }
+        if (room_.wait_until(lock, failing_since_ + options_.max_append_wait, has_room))
+        {
+            return true;
+        }
+        if (dropped_ == 0)
+        {
+            cerr << "Mutation log is failing with " << pending_.size() << " bytes pending; dropping records\n";
+        }
+        dropped_ += records;
+        return false;
+    }
+
+    string SegmentPath(uint64_t first_seq) const
+    {
+        char name[64];
+        snprintf(name, sizeof(name), "mutations-%020llu.log", static_cast<unsigned long long>(first_seq));
+        return (filesystem::path(dir_) / name).string();
+    }
+
+    struct Segment
+    {
+        uint64_t first_seq;
+        uint64_t last_seq;    // the next segment's first seq - 1; UINT64_MAX for the active one
+        string path;
+    };
+
+    vector<Segment> Segments() const
+    {
+        lock_guard<mutex> lock(mtx_);
+        vector<Segment> segments;
+        for (auto it = segments_.begin(); it != segments_.end(); ++it)
+        {
+            auto following = next(it);
+            segments.push_back({it->first, following != segments_.end() ? following->first - 1 : UINT64_MAX, it->second});
+        }
+        return segments;
+    }
+
+    // Maps `path` and hands out its valid records with from_seq <= seq <= up_to.
+    // `valid_bytes`, when given, receives the length of the readable prefix.
+    // Returns false once `on_record` asked to stop.
+    //
+    static bool ReadSegment(const string& path, uint64_t from_seq, uint64_t up_to,
+                            const function<bool(const MutationRecord&)>& on_record, size_t* valid_bytes = nullptr)
+    {
+        if (valid_bytes != nullptr) *valid_bytes = 0;
+        auto mapped = MappedFile::Open(path);
+        if (!mapped)
+        {
+            return true;  // empty, or compacted away in the meantime
+        }
+
+        const char* data = mapped->data();
+        const size_t size = mapped->size();
+        size_t pos = 0;
+        bool go_on = true;
+        MutationRecord rec;
+        while (pos < size)
+        {
+            size_t used = 0;
+            if (!Decode(data + pos, size - pos, rec, used) || rec.seq > up_to)
+            {
+                break;
+            }
+            pos += used;
+            if (rec.seq >= from_seq && !on_record(rec))
+            {
+                go_on = false;
+                break;
+            }
+        }
+        if (valid_bytes != nullptr) *valid_bytes = pos;
+        return go_on;
+    }
+
+    // Finds the segments, cuts a torn record off the end of the last one and
+    // reopens it for appending
+    //
+    void Recover()
+    {
+        for (const auto& entry : filesystem::directory_iterator(dir_))
+        {
+            unsigned long long first_seq;
+            string name = entry.path().filename().string();
+            if (name.size() == 34 && sscanf(name.c_str(), "mutations-%20llu.log", &first_seq) == 1)
+            {
+                segments_[first_seq] = entry.path().string();
+            }
+        }
+
+        uint64_t last_seq = 0;
+        size_t valid_bytes = 0;
+        if (!segments_.empty())
+        {
+            auto& [first_seq, path] = *segments_.rbegin();
+            last_seq = first_seq - 1;
+            ReadSegment(path, 0, UINT64_MAX, [&](const MutationRecord& rec) {
+                last_seq = rec.seq;
+                return true;
+            }, &valid_bytes);
+            error_code ec;
+            filesystem::resize_file(path, valid_bytes, ec);
+            if (ec)
+            {
+                cerr << "Failed to truncate " << path << ": " << ec.message() << "\n";
+            }
+        }
+        else
+        {
+            segments_[1] = SegmentPath(1);
+        }
+
+        next_seq_ = last_seq + 1;
+        pending_last_seq_ = last_seq;
+        durable_seq_ = last_seq;
+        const string& active = segments_.rbegin()->second;
+        if (!OpenActive(active, valid_bytes))
+        {
+            throw runtime_error("Cannot open mutation log segment " + active + ": " + LastFileError());
+        }
+    }
+
+    // Opens `path` for appending after its first `size` bytes. A new segment
+    // (size 0) is truncated: it may be one a failed write is being retried in.
+    //
+    bool OpenActive(const string& path, size_t size)
+    {
+        if (!active_.Open(path, size == 0))
+        {
+            return false;
+        }
+        active_bytes_ = size;
+        SyncDirectory(dir_);
+        return true;
+    }
+
+    // Group commit: swaps out the buffered records, writes and syncs them in
+    // one go, then rotates as needed. Only this thread touches the active
+    // segment.
+    //
+    // A failed write or sync may have left part of the batch on disk,
+    // or only in a page cache that has since dropped it. The batch goes back
+    // in front of the pending records and is written again, whole, to a
+    // fresh segment that starts at its first record, every kRetryInterval
+    // until it succeeds. DurableSeq() stays put meanwhile, so no consumer
+    // reads past a record that is not on disk.
+    //
+    void FlushLoop()
+    {
+        string batch;
+        unique_lock<mutex> lock(mtx_);
+        for (;;)
+        {
+            wake_.wait_for(lock, failing_ ? kRetryInterval : options_.sync_interval, [this] {
+                return stopping_ || (!failing_ && pending_.size() >= options_.max_pending_bytes);
+            });
+            if (pending_.empty())
+            {
+                if (stopping_) break;
+                continue;
+            }
+            batch.swap(pending_);
+            uint64_t last_seq = pending_last_seq_;
+            lock.unlock();
+
+            bool written = active_.IsOpen() && active_.Write(batch.data(), batch.size()) && active_.Sync();
+            if (written)
+            {
+                durable_seq_ = last_seq;
+                active_bytes_ += batch.size();
+                batch.clear();
+                if (active_bytes_ >= options_.segment_bytes)
+                {
+                    Rotate(last_seq + 1);
+                }
+            }
+            else
+            {
+                cerr << "Mutation log write failed: " << LastFileError() << "\n";
+                Rotate(durable_seq_ + 1);
+            }
+
+            lock.lock();
+            if (written)
+            {
+                failing_ = false;
+                ++syncs_;
+                room_.notify_all();
+                continue;
+            }
+            if (!failing_)
+            {
+                failing_ = true;
+                failing_since_ = chrono::steady_clock::now();
+            }
+            ++write_errors_;
+            batch += pending_;
+            pending_.swap(batch);
+            batch.clear();
+            if (stopping_)
+            {
+                cerr << "Mutation log stopping with records " << durable_seq_ + 1 << " to " << pending_last_seq_
+                     << " not on disk\n";
+                break;
+            }
+        }
+    }
+
+    // Starts the active segment at `next_first_seq`; the one before it is
+    // sealed. Opening can fail like a write; the next flush then fails too
+    // and rotates again.
+    //
+    void Rotate(uint64_t next_first_seq)
+    {
+        active_.Close();
+        string path = SegmentPath(next_first_seq);
+        {
+            lock_guard<mutex> lock(mtx_);
+            segments_[next_first_seq] = path;
+            if (segments_.size() - 1 > options_.compact_after_segments)
+            {
+                compact_requested_ = true;
+                compact_wake_.notify_one();
+            }
+        }
+        if (!OpenActive(path, 0))
+        {
+            cerr << "Cannot open mutation log segment " << path << ": " << LastFileError() << "\n";
+        }
+    }
+
+    // Compacts on request from Rotate(), so that group commits carry on while
+    // sealed segments are read and rewritten
+    //
+    void CompactLoop()
+    {
+        unique_lock<mutex> lock(mtx_);
+        for (;;)
+        {
+            compact_wake_.wait(lock, [this] { return stopping_ || compact_requested_; });
+            if (stopping_) break;
+            compact_requested_ = false;
+            lock.unlock();
+            Compact();
+            lock.lock();
+        }
+    }
+
+    // Folds the sealed segments that lie entirely before retain_from into the
+    // first of them, keeping only the newest image of each live item. Only
+    // sealed segments are touched; the flusher keeps appending to the active
+    // one, and the compacted set replaces the old one in segments_ at once.
+    //
+    void Compact()
+    {
+        vector<Segment> sealed;
+        for (const auto& segment : Segments())
+        {
+            if (segment.last_seq == UINT64_MAX || segment.last_seq >= retain_from_.load()) break;
+            sealed.push_back(segment);
+        }
+        if (sealed.size() < 2)
+        {
+            return;
+        }
+
+        // Newest image by row version; log order decides between images
+        // without one. Deletes stay as tombstones until the end, so that an
+        // older image logged after the delete does not bring the item back;
+        // a delete carries the version of the image it removed, so it also
+        // wins over that image.
+        struct Latest
+        {
+            MutationRecord rec;
+            bool deleted = false;
+        };
+        unordered_map<string, Latest> latest;
+        auto newer = [](uint64_t version, const Latest& held) {
+            uint64_t held_version = held.deleted ? held.rec.before.version : held.rec.after.version;
+            if (version == 0 || held_version == 0) return true;
+            return held.deleted ? version > held_version : version >= held_version;
+        };
+        for (const auto& segment : sealed)
+        {
+            ReadSegment(segment.path, 0, segment.last_seq, [&](const MutationRecord& rec) {
+                if (rec.op == MutationRecord::Deleted)
+                {
+                    auto [it, added] = latest.try_emplace(rec.before.list_id + "/" + rec.before.id);
+                    if (added || newer(rec.before.version, it->second)) it->second = Latest{rec, true};
+                }
+                else if (rec.op == MutationRecord::Created || rec.op == MutationRecord::Updated)
+                {
+                    auto [it, added] = latest.try_emplace(rec.after.list_id + "/" + rec.after.id);
+                    if (added || newer(rec.after.version, it->second)) it->second = Latest{rec, false};
+                }
+                return true;
+            });
+        }
+
+        vector<const MutationRecord*> ordered;
+        ordered.reserve(latest.size());
+        for (const auto& entry : latest)
+        {
+            if (!entry.second.deleted) ordered.push_back(&entry.second.rec);
+        }
+        sort(ordered.begin(), ordered.end(), [](auto a, auto b) { return a->seq < b->seq; });
+
+        string data;
+        for (const auto* rec : ordered)
+        {
+            Encode(rec->seq, rec->unix_ms, MutationRecord::Created, nullptr, &rec->after, data);
+        }
+
+        if (!WriteFileAtomically(sealed.front().path, data))
+        {
+            cerr << "Mutation log compaction failed: " << LastFileError() << "\n";
+            return;
+        }
+
+        {
+            lock_guard<mutex> lock(mtx_);
+            for (size_t i = 1; i < sealed.size(); ++i)
+            {
+                segments_.erase(sealed[i].first_seq);
+            }
+            ++compactions_;
+        }
+        for (size_t i = 1; i < sealed.size(); ++i)
+        {
+            error_code ec;
+            filesystem::remove(sealed[i].path, ec);
+        }
+        SyncDirectory(dir_);
+    }
+
+    // How often a batch that failed to reach the disk is retried
+    static constexpr chrono::milliseconds kRetryInterval{100};
+
+    string dir_;
+    MutationLogOptions options_;
+
+    mutable mutex mtx_;
+    condition_variable wake_;
+    condition_variable room_;            // pending_ drained after failed flushes
+    condition_variable compact_wake_;
+    bool compact_requested_ = false;
+    bool failing_ = false;               // the last flush failed; its batch is pending again
+    chrono::steady_clock::time_point failing_since_;
+    string pending_;
+    uint64_t next_seq_ = 1;
+    uint64_t pending_last_seq_ = 0;
+    bool stopping_ = false;
+    map<uint64_t, string> segments_;    // first seq -> path; the last one is active
+
+    atomic<uint64_t> durable_seq_{0};
+    atomic<uint64_t> retain_from_{UINT64_MAX};
+
+    // Owned by the flusher thread
+    AppendFile active_;
+    size_t active_bytes_ = 0;
+    thread flusher_;
+    thread compactor_;
+
+    uint64_t appended_ = 0;
+    uint64_t syncs_ = 0;
+    uint64_t compactions_ = 0;
+    uint64_t write_errors_ = 0;
+    uint64_t dropped_ = 0;
+};
+
+// Ships the log to a downstream consumer, standing in for a Kafka producer:
+// every durable record is handed to `sink` exactly in order, and the offset of
+// the last one accepted is persisted in `offset_path`, so a restart resumes
+// where it left off (at-least-once). Compaction keeps everything the sink has
+// not acknowledged yet.
+//
+class MutationForwarder
+{
+public:
+    using Sink = function<bool(const MutationRecord&)>;
+
+    MutationForwarder(MutationLog& log, Sink sink, const string& offset_path,
+                      chrono::milliseconds poll_interval = chrono::milliseconds(100))
+        : log_(log), sink_(move(sink)), offset_path_(offset_path), poll_interval_(poll_interval)
+    {
+        if (FILE* f = fopen(offset_path_.c_str(), "r"))
+        {
+            unsigned long long offset = 0;
+            if (fscanf(f, "%llu", &offset) == 1) offset_ = offset;
+            fclose(f);
+        }
+        log_.SetRetainFrom(offset_ + 1);
+        worker_ = thread([this] { Run(); });
+    }
+
+    ~MutationForwarder()
+    {
+        {
+            lock_guard<mutex> lock(mtx_);
+            stopping_ = true;
+        }
+        wake_.notify_all();
+        if (worker_.joinable())
+        {
+            worker_.join();
+        }
+    }
+
+    MutationForwarder(const MutationForwarder&) = delete;
+    MutationForwarder& operator=(const MutationForwarder&) = delete;
+
+    uint64_t Offset() const
+    {
+        return offset_.load();
+    }
+
+private:
+    void Run()
+    {
+        unique_lock<mutex> lock(mtx_);
+        while (!stopping_)
+        {
+            lock.unlock();
+            uint64_t before = offset_;
+            if (log_.DurableSeq() > before)
+            {
+                log_.Replay(before + 1, [&](const MutationRecord& rec) {
+                    if (!sink_(rec)) return false;  // retried on the next poll
+                    offset_ = rec.seq;
+                    return true;
+                });
+            }
+            if (offset_ != before)
+            {
+                SaveOffset();
+                log_.SetRetainFrom(offset_ + 1);
+            }
+            lock.lock();
+            wake_.wait_for(lock, poll_interval_, [this] { return stopping_; });
+        }
+    }
+
+    void SaveOffset()
+    {
+        if (!WriteFileAtomically(offset_path_, to_string(offset_.load()) + "\n"))
+        {
+            cerr << "Failed to save forwarder offset " << offset_path_ << ": " << LastFileError() << "\n";
+        }
+    }
+
+    MutationLog& log_;
+    Sink sink_;
+    string offset_path_;
+    chrono::milliseconds poll_interval_;
+    atomic<uint64_t> offset_{0};
+
+    mutex mtx_;
+    condition_variable wake_;
+    bool stopping_ = false;
+    thread worker_;
+};
+
+#endif
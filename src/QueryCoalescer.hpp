@@ -0,0 +1,230 @@
+#ifndef QUERY_COALESCER_HPP
+#define QUERY_COALESCER_HPP
+
+#include <boost/json.hpp>
+
+#include <chrono>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "ToDoObserver.hpp"
+
+using namespace std;
+
+// Singleflight for read queries: concurrent calls with the same key share one
+// execution and one serialized result. With a non-zero TTL a finished result
+// is also reused by later calls until it expires.
+//
+// Registered as a ToDoObserver, every committed mutation starts a new
+// generation: results and in-flight executions from before the write are no
+// longer handed out. That alone does not keep a client from reading behind
+// its own write when reads go to replicas: callers put the read routing in
+// the key (see ToDoService::GetAllToDos) and run `load` with a context of its
+// own, so no caller's deadline, socket or routing decides the shared result.
+//
+class QueryCoalescer : public ToDoObserver
+{
+public:
+    using Result = shared_ptr<const string>;
+
+    explicit QueryCoalescer(chrono::milliseconds ttl = chrono::milliseconds(0)) : ttl_(ttl) {}
+
+    // How long finished results are reused; 0 only shares in-flight queries.
+    // Results cached so far keep their expiry.
+    //
+    void SetTtl(chrono::milliseconds ttl)
+    {
+        lock_guard<mutex> lock(mtx_);
+        ttl_ = ttl;
+    }
+
+    // Returns the result for `key`: joins an identical execution that is in
+    // flight, reuses a cached one, or runs `load`. nullptr means `load` failed
+    // or `wait_until` passed while waiting for another caller's execution;
+    // failures are not cached. A caller whose joined execution failed runs
+    // (or joins) a fresh one once, so one failed flight does not fail every
+    // caller that happened to join it.
+    //
+    Result Do(const string& key, const function<Result()>& load,
+              chrono::steady_clock::time_point wait_until = chrono::steady_clock::time_point::max())
+    {
+        unique_lock<mutex> lock(mtx_);
+        auto now = chrono::steady_clock::now();
+        auto it = entries_.find(key);
+        if (it != entries_.end() && it->second.generation == generation_)
+        {
+            Entry& entry = it->second;
+            if (!entry.done)
+            {
+                ++coalesced_;
+                auto pending = entry.result;
+                uint64_t joined = entry.flight;
+                lock.unlock();
+                if (!Wait(pending, wait_until))
+                {
+                    return nullptr;
+                }
+                if (Result result = pending.get())
+                {
+                    return result;
+                }
+
+                lock.lock();
+                ++retries_;
+                now = chrono::steady_clock::now();
+                it = entries_.find(key);
+                if (it != entries_.end() && it->second.flight != joined && it->second.generation == generation_ &&
+                    (!it->second.done || now < it->second.expires))
+                {
+                    auto retried = it->second.result;
+                    lock.unlock();
+                    return Wait(retried, wait_until) ? retried.get() : nullptr;
+                }
+            }
+            else if (now < entry.expires)
+            {
+                ++cache_hits_;
+                return entry.result.get();
+            }
+        }
+
+        if (entries_.size() >= kSweepThreshold)
+        {
+            Sweep(now);
+        }
+        promise<Result> promised;
+        uint64_t flight = ++flights_;
+        uint64_t generation = generation_;
+        entries_[key] = Entry{promised.get_future().share(), generation, flight, false, {}};
+        ++executed_;
+        lock.unlock();
+
+        Result result;
+        try
+        {
+            result = load();
+        }
+        catch (...)
+        {
+            result = nullptr;
+        }
+        promised.set_value(result);
+
+        lock.lock();
+        it = entries_.find(key);
+        if (it != entries_.end() && it->second.flight == flight)
+        {
+            if (result && ttl_.count() > 0 && it->second.generation == generation_)
+            {
+                it->second.done = true;
+                it->second.expires = chrono::steady_clock::now() + ttl_;
+            }
+            else
+            {
+                entries_.erase(it);
+            }
+        }
+        return result;
+    }
+
+    boost::json::object Metrics() const
+    {
+        lock_guard<mutex> lock(mtx_);
+        return {
+            {"executed",   executed_},
+            {"coalesced",  coalesced_},
+            {"cache_hits", cache_hits_},
+            {"retries",    retries_},
+            {"wait_timeouts", wait_timeouts_},
+            {"ttl_ms",     static_cast<int64_t>(ttl_.count())}
+        };
+    }
+
+    void OnCreated(const ToDoItem&) override { Invalidate(); }
+
+    void OnUpdated(const ToDoItem&, const ToDoItem&) override { Invalidate(); }
+
+    void OnDeleted(const ToDoItem&) override { Invalidate(); }
+
+    // Import batches arrive before the commit; invalidating then would let a
+    // query cache the pre-import rows
+    void OnBulkImport(const vector<ToDoItem>&) override {}
+
+    void OnBulkImportCommitted() override { Invalidate(); }
+
+private:
+    struct Entry
+    {
+        shared_future<Result> result;
+        uint64_t generation;
+        uint64_t flight;    // tells a re-started execution for the same key apart
+        bool done;
+        chrono::steady_clock::time_point expires;
+    };
+
+    static constexpr size_t kSweepThreshold = 1024;
+
+    // Waits for another caller's execution until `wait_until`; false when
+    // the caller gave up first. Called without mtx_.
+    //
+    bool Wait(const shared_future<Result>& pending, chrono::steady_clock::time_point wait_until)
+    {
+        if (wait_until == chrono::steady_clock::time_point::max())
+        {
+            pending.wait();
+            return true;
+        }
+        if (pending.wait_until(wait_until) == future_status::ready)
+        {
+            return true;
+        }
+        lock_guard<mutex> lock(mtx_);
+        ++wait_timeouts_;
+        return false;
+    }
+
+    void Invalidate()
+    {
+        lock_guard<mutex> lock(mtx_);
+        ++generation_;
+        Sweep(chrono::steady_clock::now());
+    }
+
+    // Drops cached results that expired or belong to an older generation.
+    // In-flight entries are left for their owner to clean up. Caller holds mtx_.
+    //
+    void Sweep(chrono::steady_clock::time_point now)
+    {
+        for (auto it = entries_.begin(); it != entries_.end();)
+        {
+            if (it->second.done && (it->second.generation != generation_ || now >= it->second.expires))
+            {
+                it = entries_.erase(it);
+            }
+            else
+            {
+                ++it;
+            }
+        }
+    }
+
+    chrono::milliseconds ttl_;
+
+    mutable mutex mtx_;
+    unordered_map<string, Entry> entries_;
+    uint64_t generation_ = 0;
+    uint64_t flights_ = 0;
+
+    uint64_t executed_ = 0;
+    uint64_t coalesced_ = 0;
+    uint64_t cache_hits_ = 0;
+    uint64_t retries_ = 0;
+    uint64_t wait_timeouts_ = 0;
+};
+
+#endif
@@ -0,0 +1,204 @@
+#ifndef QUERY_WATCHDOG_HPP
+#define QUERY_WATCHDOG_HPP
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <winsock2.h>
+#else
+#include <poll.h>
+#include <sys/socket.h>
+#endif
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <iostream>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+
+#include <pqxx/pqxx>
+
+#include "RequestContext.hpp"
+
+using namespace std;
+
+// Cancels running statements whose request has passed its deadline or whose
+// client has disconnected. statement_timeout already bounds the statement on
+// the server; the watchdog also covers time spent outside the statement
+// (network stalls, COPY streams) and requests the client has abandoned.
+//
+class QueryWatchdog
+{
+public:
+    // Keeps a statement under watch while it is alive
+    //
+    class Watch
+    {
+    public:
+        Watch() = default;
+        Watch(QueryWatchdog* watchdog, uint64_t id) : watchdog_(watchdog), id_(id) {}
+        Watch(Watch&& other) noexcept : watchdog_(exchange(other.watchdog_, nullptr)), id_(other.id_) {}
+        Watch& operator=(Watch&&) = delete;
+        Watch(const Watch&) = delete;
+
+        ~Watch()
+        {
+            if (watchdog_ != nullptr) watchdog_->Unwatch(id_);
+        }
+
+    private:
+        QueryWatchdog* watchdog_ = nullptr;
+        uint64_t id_ = 0;
+    };
+
+    explicit QueryWatchdog(chrono::milliseconds poll_interval = chrono::milliseconds(20),
+                           chrono::milliseconds grace = chrono::milliseconds(100))
+        : poll_interval_(poll_interval), grace_(grace)
+    {
+    }
+
+    ~QueryWatchdog()
+    {
+        {
+            lock_guard<mutex> lock(mtx_);
+            stopping_ = true;
+        }
+        wake_.notify_all();
+        if (worker_.joinable())
+        {
+            worker_.join();
+        }
+    }
+
+    // Watches `conn` until the returned Watch is destroyed. Requests without
+    // a deadline or a client socket are not watched.
+    //
+    Watch Start(pqxx::connection& conn, const RequestContext* ctx)
+    {
+        if (ctx == nullptr || (!ctx->HasDeadline() && ctx->client_fd < 0))
+        {
+            return {};
+        }
+        lock_guard<mutex> lock(mtx_);
+        if (!worker_.joinable())
+        {
+            worker_ = thread([this] { Run(); });
+        }
+        uint64_t id = ++next_id_;
+        entries_[id] = Entry{&conn, ctx->deadline, ctx->client_fd, false};
+        return Watch(this, id);
+    }
+
+    size_t DeadlineCancels() const { return deadline_cancels_.load(); }
+
+    size_t DisconnectCancels() const { return disconnect_cancels_.load(); }
+
+private:
+    struct Entry
+    {
+        pqxx::connection* conn;
+        chrono::steady_clock::time_point deadline;
+        int client_fd;
+        bool cancelled;
+    };
+
+    void Unwatch(uint64_t id)
+    {
+        // Cancels run under the lock, so once this returns none can reach the
+        // connection any more
+        lock_guard<mutex> lock(mtx_);
+        entries_.erase(id);
+    }
+
+    // True once the peer has closed its end of `fd`: readable with nothing
+    // left to read, or hung up
+    //
+    static bool ClientGone(int fd)
+    {
+        if (fd < 0)
+        {
+            return false;
+        }
+#ifdef _WIN32
+        WSAPOLLFD p{static_cast<SOCKET>(fd), POLLRDNORM, 0};
+        if (WSAPoll(&p, 1, 0) <= 0)
+        {
+            return false;
+        }
+        if (p.revents & (POLLHUP | POLLERR))
+        {
+            return true;
+        }
+        // Readable, so the peek does not block
+        char c;
+        return recv(static_cast<SOCKET>(fd), &c, 1, MSG_PEEK) == 0;
+#else
+#ifdef POLLRDHUP
+        pollfd p{fd, POLLRDHUP, 0};
+#else
+        pollfd p{fd, POLLIN, 0};
+#endif
+        if (poll(&p, 1, 0) <= 0)
+        {
+            return false;
+        }
+        if (p.revents & (POLLHUP | POLLERR))
+        {
+            return true;
+        }
+        char c;
+        return recv(fd, &c, 1, MSG_PEEK | MSG_DONTWAIT) == 0;
+#endif
+    }
+
+    void Run()
+    {
+        unique_lock<mutex> lock(mtx_);
+        while (!stopping_)
+        {
+            wake_.wait_for(lock, poll_interval_, [this] { return stopping_; });
+            auto now = chrono::steady_clock::now();
+            for (auto& [id, entry] : entries_)
+            {
+                if (entry.cancelled) continue;
+
+                bool expired = entry.deadline != chrono::steady_clock::time_point::max() && now >= entry.deadline + grace_;
+                bool gone = !expired && ClientGone(entry.client_fd);
+                if (!expired && !gone) continue;
+
+                try
+                {
+                    entry.conn->cancel_query();
+                }
+                catch (const exception& e)
+                {
+                    cerr << "Query cancel failed: " << e.what() << "\n";
+                }
+                entry.cancelled = true;
+                ++(expired ? deadline_cancels_ : disconnect_cancels_);
+            }
+        }
+    }
+
+    chrono::milliseconds poll_interval_;
+    chrono::milliseconds grace_;    // leaves statement_timeout the first go
+
+    mutex mtx_;
+    condition_variable wake_;
+    unordered_map<uint64_t, Entry> entries_;
+    uint64_t next_id_ = 0;
+    bool stopping_ = false;
+    thread worker_;
+
+    atomic<size_t> deadline_cancels_{0};
+    atomic<size_t> disconnect_cancels_{0};
+};
+
+#endif
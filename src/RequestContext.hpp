@@ -0,0 +1,50 @@
+#ifndef REQUEST_CONTEXT_HPP
+#define REQUEST_CONTEXT_HPP
+
+#include <chrono>
+#include <string>
+
+#include "RequestTiming.hpp"
+
+using namespace std;
+
+// Per-request state passed from the HTTP layer through ToDoService into PgPool
+//
+class RequestContext
+{
+public:
+    string client_id;   // X-Client-Id header, or the peer address; keys read-your-writes routing
+    string list_id;     // from /lists/{listId}/...; empty for the unscoped /todos routes
+
+    // Per-stage durations, filled in by every layer the request passes through.
+    // Mutable because the layers below the HTTP handlers only see a const context.
+    mutable RequestTimings timings;
+
+    // When the client stops waiting for the answer; PgPool refuses to start
+    // work past it and bounds statements by what is left
+    chrono::steady_clock::time_point deadline = chrono::steady_clock::time_point::max();
+
+    // The client's socket, watched for a disconnect while a query runs; -1 for none
+    int client_fd = -1;
+
+    // Sends reads to the primary even when replicas are healthy; set for
+    // shared list loads that a caller's read-your-writes pins to the primary
+    bool read_primary = false;
+
+    // Set by PgPool when a statement was cancelled (statement_timeout or the
+    // watchdog) or refused for the deadline, so that the handler answers 504
+    // instead of reporting the failure as the client's
+    mutable bool cancelled = false;
+
+    bool HasDeadline() const
+    {
+        return deadline != chrono::steady_clock::time_point::max();
+    }
+
+    bool Expired() const
+    {
+        return HasDeadline() && chrono::steady_clock::now() >= deadline;
+    }
+};
+
+#endif
@@ -0,0 +1,224 @@
+#ifndef REQUEST_TIMING_HPP
+#define REQUEST_TIMING_HPP
+
+#include <boost/json.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <ctime>
+#include <mutex>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// Stages a request passes through, in order
+//
+enum class Stage { Read, Parse, Queue, PoolWait, Query, Serialize, Write, Count };
+
+static const char* StageName(Stage stage)
+{
+    static const char* names[] = {"read", "parse", "queue", "pool_wait", "query", "serialize", "write"};
+    return names[static_cast<int>(stage)];
+}
+
+// Time spent per stage by one request. Stages entered more than once (several
+// queries, several pool leases) accumulate.
+//
+class RequestTimings
+{
+public:
+    explicit RequestTimings(chrono::steady_clock::time_point started = chrono::steady_clock::now())
+        : started_(started)
+    {
+    }
+
+    void Add(Stage stage, chrono::steady_clock::duration elapsed)
+    {
+        stages_[static_cast<int>(stage)] += elapsed;
+    }
+
+    double Millis(Stage stage) const
+    {
+        return chrono::duration<double, milli>(stages_[static_cast<int>(stage)]).count();
+    }
+
+    double TotalMillis() const
+    {
+        return chrono::duration<double, milli>(chrono::steady_clock::now() - started_).count();
+    }
+
+    // Server-Timing header value: "read;dur=0.120, parse;dur=0.015, ..., total;dur=4.2".
+    // Stages that did not run are left out.
+    //
+    string ServerTimingHeader() const
+    {
+        string header;
+        char buf[64];
+        for (int i = 0; i < static_cast<int>(Stage::Count); ++i)
+        {
+            if (stages_[i].count() == 0) continue;
+            snprintf(buf, sizeof(buf), "%s;dur=%.3f, ", StageName(static_cast<Stage>(i)), Millis(static_cast<Stage>(i)));
+            header += buf;
+        }
+        snprintf(buf, sizeof(buf), "total;dur=%.3f", TotalMillis());
+        return header + buf;
+    }
+
+    boost::json::object ToJson() const
+    {
+        boost::json::object stages;
+        for (int i = 0; i < static_cast<int>(Stage::Count); ++i)
+        {
+            stages[StageName(static_cast<Stage>(i))] = Millis(static_cast<Stage>(i));
+        }
+        return stages;
+    }
+
+private:
+    chrono::steady_clock::time_point started_;
+    chrono::steady_clock::duration stages_[static_cast<int>(Stage::Count)] = {};
+};
+
+// Adds the time between construction and Stop() (or destruction) to a stage.
+// A null `timings` makes it a no-op, for calls made outside a request.
+//
+class ScopedStage
+{
+public:
+    ScopedStage(RequestTimings* timings, Stage stage)
+        : timings_(timings), stage_(stage), started_(chrono::steady_clock::now())
+    {
+    }
+
+    ~ScopedStage()
+    {
+        Stop();
+    }
+
+    void Stop()
+    {
+        if (timings_ != nullptr)
+        {
+            timings_->Add(stage_, chrono::steady_clock::now() - started_);
+            timings_ = nullptr;
+        }
+    }
+
+    ScopedStage(const ScopedStage&) = delete;
+    ScopedStage& operator=(const ScopedStage&) = delete;
+
+private:
+    RequestTimings* timings_;
+    Stage stage_;
+    chrono::steady_clock::time_point started_;
+};
+
+// Keeps the slowest `capacity` requests with their stage breakdown in a
+// fixed-size min-heap. Requests faster than the fastest retained entry are
+// rejected without taking the lock once the buffer is full.
+//
+class SlowRequestLog
+{
+public:
+    explicit SlowRequestLog(size_t capacity = 50) : capacity_(capacity)
+    {
+        entries_.reserve(capacity_);
+    }
+
+    // Set before requests are recorded; drops what was kept
+    //
+    void SetCapacity(size_t capacity)
+    {
+        lock_guard<mutex> lock(mtx_);
+        capacity_ = capacity;
+        entries_.clear();
+        entries_.reserve(capacity_);
+        threshold_ms_.store(0, memory_order_relaxed);
+    }
+
+    // With a capacity of 0 nothing is kept
+    //
+    void Record(const string& method, const string& target, unsigned status, const RequestTimings& timings)
+    {
+        if (capacity_ == 0)
+        {
+            return;
+        }
+        double total_ms = timings.TotalMillis();
+        if (total_ms <= threshold_ms_.load(memory_order_relaxed))
+        {
+            return;
+        }
+
+        Entry entry{total_ms, method, target, status, timings.ToJson(), time(nullptr)};
+        lock_guard<mutex> lock(mtx_);
+        if (entries_.size() < capacity_)
+        {
+            entries_.push_back(move(entry));
+            push_heap(entries_.begin(), entries_.end(), Faster);
+        }
+        else if (total_ms > entries_.front().total_ms)
+        {
+            pop_heap(entries_.begin(), entries_.end(), Faster);
+            entries_.back() = move(entry);
+            push_heap(entries_.begin(), entries_.end(), Faster);
+        }
+        if (entries_.size() == capacity_)
+        {
+            threshold_ms_.store(entries_.front().total_ms, memory_order_relaxed);
+        }
+    }
+
+    // Slowest first
+    //
+    boost::json::array ToJson() const
+    {
+        vector<Entry> sorted;
+        {
+            lock_guard<mutex> lock(mtx_);
+            sorted = entries_;
+        }
+        sort(sorted.begin(), sorted.end(), [](const Entry& a, const Entry& b) { return a.total_ms > b.total_ms; });
+
+        boost::json::array out;
+        for (const auto& e : sorted)
+        {
+            out.emplace_back(boost::json::object{
+                {"method",   e.method},
+                {"target",   e.target},
+                {"status",   e.status},
+                {"at",       static_cast<int64_t>(e.at)},
+                {"total_ms", e.total_ms},
+                {"stages",   e.stages}
+            });
+        }
+        return out;
+    }
+
+private:
+    struct Entry
+    {
+        double total_ms;
+        string method;
+        string target;
+        unsigned status;
+        boost::json::object stages;
+        time_t at;
+    };
+
+    // Heap order: the fastest retained request sits at the front
+    static bool Faster(const Entry& a, const Entry& b)
+    {
+        return a.total_ms > b.total_ms;
+    }
+
+    size_t capacity_;
+    mutable mutex mtx_;
+    vector<Entry> entries_;
+    atomic<double> threshold_ms_{0};
+};
+
+#endif
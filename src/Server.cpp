@@ -14,10 +14,25 @@
 #include <random>
 #include <sstream>
 #include <iomanip>
+#include <chrono>
+#include <atomic>
+#include <limits>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
 
 #include "Utility.hpp"
 #include "DbAccess.hpp"
 #include "ToDoService.hpp"
+#include "RequestContext.hpp"
+#include "ToDoStats.hpp"
+#include "DueTimerWheel.hpp"
+#include "RequestTiming.hpp"
+#include "MutationLog.hpp"
+#include "ToDoSnapshot.hpp"
+#include "LaneScheduler.hpp"
 
 namespace beast = boost::beast;
 namespace http = beast::http;
@@ -26,117 +41,754 @@ namespace json = boost::json;
 using tcp = net::ip::tcp;
 using namespace std;
 
-PgPool pg_pool("host=localhost dbname=todolist user=postgres password=12345", 5);
+// Returns the environment variable `name`, or `fallback` when it is unset
+//
+string env_or(const char* name, const string& fallback)
+{
+    const char* value = getenv(name);
+    return (value != nullptr && *value != '\0') ? string(value) : fallback;
+}
+
+// Returns the environment variable `name` as a whole number in [min_value,
+// max_value], or `fallback` when it is unset. Settings are read in main(), so
+// a malformed value stops the server with the variable's name.
+//
+long env_long(const char* name, long fallback, long min_value = 0, long max_value = numeric_limits<long>::max())
+{
+    string value = env_or(name, "");
+    if (value.empty()) 
+    {
+        return fallback;
+    }
+    size_t used = 0;
+    long parsed = 0;
+    try 
+    {
+        parsed = stol(value, &used);
+    }
+    catch (const exception&) 
+    {
+        used = 0;
+    }
+    if (used == 0 || used != value.size() || parsed < min_value || parsed > max_value) 
+    {
+        throw runtime_error(string(name) + "=" + value + " is not a whole number from " + to_string(min_value) +
+                            (max_value == numeric_limits<long>::max() ? " up" : " to " + to_string(max_value)));
+    }
+    return parsed;
+}
+
+// Primary connection string; read replicas are added in main() from TODO_PG_REPLICAS
+//
+PgPool pg_pool(env_or("TODO_PG_PRIMARY", "host=localhost dbname=todolist user=postgres password=12345"), 5, 20,
+               env_or("TODO_PG_THREAD_AFFINE", "0") == "1");
+
+// Aggregate counters for GET /todos/stats, kept current by ToDoService
+//
+ToDoStats todo_stats;
+
+// Open items by due date for GET /todos/due, firing reminders
+// TODO_REMINDER_LEAD_S before the due time (0 disables them) and overdue
+// events at it into the mutation log. The lead is set in main().
+//
+DueTimerWheel due_timers;
+
+// The slowest requests with their stage breakdown, for GET /admin/slow-requests;
+// sized from TODO_SLOW_REQUEST_LOG_SIZE in main()
+//
+SlowRequestLog slow_requests;
+
+// Durable log of every mutation (TODO_MUTATION_LOG_DIR) and the forwarder that
+// ships it downstream (TODO_MUTATION_FORWARD_FILE); both optional, set up in main()
+//
+unique_ptr<MutationLog> mutation_log;
+unique_ptr<MutationForwarder> mutation_forwarder;
+
+// Columnar image of the table saved to TODO_SNAPSHOT_FILE for fast warm-up;
+// optional, set up in main()
+//
+unique_ptr<ToDoSnapshot> todo_snapshot;
+
+// One listening socket with its own blocking accept thread. With more than
+// one shard every shard binds port 8080 with SO_REUSEPORT and the kernel
+// spreads incoming connections across them. Sessions still run one thread
+// per connection; shards only spread the accept path.
+//
+struct AcceptorShard
+{
+    int cpu = -1;   // core the accept thread and its sessions are pinned to; -1 when not pinned
+    unique_ptr<tcp::acceptor> acceptor;
+    atomic<size_t> accepted{0};
+    thread worker;
+};
+
+// Started in main(); read by GET /metrics
+//
+vector<unique_ptr<AcceptorShard>> acceptor_shards;
+
+// Shares identical concurrent GET /todos queries; TODO_LIST_CACHE_TTL_MS also
+// reuses finished results for that long (writes invalidate them); set in main()
+//
+QueryCoalescer list_coalescer;
+
+// Lane quotas: defaults overridden by TODO_LANE_<NAME>=reserved:max_in_flight:weight,
+// e.g. TODO_LANE_SCAN=2:6:2. Throws on a malformed quota.
+//
+LaneScheduler::Options lane_options()
+{
+    LaneScheduler::Options options;
+    options[static_cast<size_t>(Lane::Point)] = {4, 20, 8};
+    options[static_cast<size_t>(Lane::Write)] = {4, 20, 4};
+    options[static_cast<size_t>(Lane::Scan)]  = {2, 8, 2};
+    options[static_cast<size_t>(Lane::Bulk)]  = {1, 2, 1};
+    for (size_t i = 0; i < options.size(); ++i) 
+    {
+        string name = LaneName(static_cast<Lane>(i));
+        boost::algorithm::to_upper(name);
+        string spec = env_or(("TODO_LANE_" + name).c_str(), "");
+        if (spec.empty()) 
+        {
+            continue;
+        }
+        unsigned long reserved, max_in_flight, weight;
+        int used = 0;
+        if (spec.find_first_not_of("0123456789:") != string::npos ||
+            sscanf(spec.c_str(), "%lu:%lu:%lu%n", &reserved, &max_in_flight, &weight, &used) != 3 ||
+            used != static_cast<int>(spec.size())) 
+        {
+            throw runtime_error("TODO_LANE_" + name + "=" + spec + " is not reserved:max_in_flight:weight");
+        }
+        options[i] = {reserved, max_in_flight, static_cast<unsigned>(weight)};
+    }
+    return options;
+}
+
+// Admission to the database by lane, one slot per primary connection, so
+// scans and bulk transfers queue rather than crowd out point reads and
+// writes. Background work takes connections outside the lanes, so a reserved
+// slot does not guarantee a free connection. Set up in main().
+//
+unique_ptr<LaneScheduler> lanes;
+
+// Longest a request waits for its lane (TODO_LANE_MAX_WAIT_MS); read in main()
+//
+long lane_max_wait_ms = 10000;
+
+// Bulk transfers are flushed to the socket in chunks of roughly this size
+//
+constexpr size_t kStreamChunkSize = 64 * 1024;
+
+// Splits the query string of `target` into a simple param map
+//
+map<string, string> parse_query_params(const string& target)
+{
+    string query_string;
+    size_t qpos = target.find('?');
+    if (qpos != string::npos) {
+        query_string = target.substr(qpos + 1);
+    }
+
+    map<string, string> params;
+    if (!query_string.empty()) {
+        istringstream iss(query_string);
+        string token;
+        while (getline(iss, token, '&')) {
+            size_t eq = token.find('=');
+            if (eq != string::npos) {
+                string key = url_decode(token.substr(0, eq));
+                string val = url_decode(token.substr(eq + 1));
+                params[key] = val;
+            }
+        }
+    }
+    return params;
+}
+
+// Splits a /lists/{listId}/... target into the list id and the /todos route
+// below it. Unscoped targets are left alone. Returns false for a malformed
+// list id.
+//
+bool split_list_scope(string& target, string& list_id)
+{
+    const string prefix = "/lists/";
+    if (target.rfind(prefix, 0) != 0) 
+    {
+        return true;
+    }
+    size_t end = target.find('/', prefix.size());
+    list_id = target.substr(prefix.size(), end == string::npos ? string::npos : end - prefix.size());
+    target = (end == string::npos) ? "" : target.substr(end);
+    return is_uuid(list_id);
+}
+
+// Identifies the caller for read-your-writes routing: the X-Client-Id header
+// when present, the peer address otherwise
+//
+void identify_client(RequestContext& ctx, const http::fields& headers, beast::tcp_stream& stream)
+{
+    auto client_id = headers["X-Client-Id"];
+    if (!client_id.empty()) 
+    {
+        ctx.client_id = string(client_id);
+    }
+    else 
+    {
+        beast::error_code ec;
+        auto endpoint = stream.socket().remote_endpoint(ec);
+        if (!ec) 
+        {
+            ctx.client_id = endpoint.address().to_string();
+        }
+    }
+}
+
+// Route deadline defaults in ms (0 = none), from TODO_READ_TIMEOUT_MS,
+// TODO_WRITE_TIMEOUT_MS and TODO_BULK_TIMEOUT_MS; read in main()
+//
+long read_timeout_ms = 5000;
+long write_timeout_ms = 10000;
+long bulk_timeout_ms = 30000;
+
+// Per-route deadline: the X-Request-Timeout-Ms header when given, otherwise
+// the default for the kind of route. Streaming routes have no default.
+//
+void set_deadline(RequestContext& ctx, const http::request_header<>& req, const string& route)
+{
+    constexpr long kMaxTimeoutMs = 300000;
+
+    string path = route.substr(0, route.find('?'));
+    long timeout_ms = 0;
+    if (path == "/todos/export" || path == "/todos/import") 
+    {
+        timeout_ms = 0;
+    }
+    else if (req.method() == http::verb::get) 
+    {
+        timeout_ms = read_timeout_ms;
+    }
+    else if (path == "/todos" && req.method() != http::verb::post) 
+    {
+        timeout_ms = bulk_timeout_ms;
+    }
+    else 
+    {
+        timeout_ms = write_timeout_ms;
+    }
+
+    auto header = req["X-Request-Timeout-Ms"];
+    if (!header.empty()) 
+    {
+        try 
+        {
+            long requested = stol(string(header));
+            if (requested > 0) timeout_ms = min(requested, kMaxTimeoutMs);
+        }
+        catch (...) 
+        {
+            // a malformed header keeps the route default
+        }
+    }
+
+    if (timeout_ms > 0) 
+    {
+        ctx.deadline = chrono::steady_clock::now() + chrono::milliseconds(timeout_ms);
+    }
+}
+
+// Status for a failed service call: 504 when PgPool saw its statement
+// cancelled (deadline or watchdog) or the deadline has passed, since the
+// service reports both as plain errors; 400 otherwise
+//
+http::status failure_status(const RequestContext& ctx)
+{
+    return ctx.cancelled || ctx.Expired() ? http::status::gateway_timeout : http::status::bad_request;
+}
+
+// Lane a route runs in; false for routes served from memory
+//
+bool route_lane(http::verb method, const string& route, Lane& lane)
+{
+    string path = route.substr(0, route.find('?'));
+    if (path == "/todos/export" || path == "/todos/import") 
+    {
+        lane = Lane::Bulk;
+    }
+    else if (path == "/todos") 
+    {
+        lane = method == http::verb::get ? Lane::Scan : method == http::verb::post ? Lane::Write : Lane::Bulk;
+    }
+    else if (path == "/todos/stats" || path == "/todos/due") 
+    {
+        return false;
+    }
+    else if (path.rfind("/todos/", 0) == 0) 
+    {
+        lane = method == http::verb::get ? Lane::Point : Lane::Write;
+    }
+    else 
+    {
+        return false;
+    }
+    return true;
+}
+
+// Waits for a slot in `lane`, booked to the queue stage, until the request
+// deadline or TODO_LANE_MAX_WAIT_MS, whichever comes first
+//
+LaneScheduler::Ticket admit(Lane lane, RequestContext& ctx)
+{
+    ScopedStage queue_stage(&ctx.timings, Stage::Queue);
+    auto until = min(ctx.deadline, chrono::steady_clock::now() + chrono::milliseconds(lane_max_wait_ms));
+    return lanes->Acquire(lane, until);
+}
+
+// Response body that sends a shared, immutable string in place, such as a
+// cached GET /todos page; the message keeps the string alive while it is
+// being written
+//
+struct SharedStringBody
+{
+    using value_type = shared_ptr<const string>;
+
+    static uint64_t size(const value_type& body)
+    {
+        return body ? body->size() : 0;
+    }
+
+    class writer
+    {
+    public:
+        using const_buffers_type = net::const_buffer;
+
+        template <bool isRequest, class Fields>
+        writer(const http::header<isRequest, Fields>&, const value_type& body) : body_(body)
+        {
+        }
+
+        void init(beast::error_code& ec)
+        {
+            ec = {};
+        }
+
+        boost::optional<pair<const_buffers_type, bool>> get(beast::error_code& ec)
+        {
+            ec = {};
+            if (!body_ || body_->empty()) 
+            {
+                return boost::none;
+            }
+            return {{net::const_buffer(body_->data(), body_->size()), false}};
+        }
+
+    private:
+        const value_type& body_;
+    };
+};
+
+// Writes `res` to the client, timed as the write stage, and files the request
+// with the slow-request log. The Server-Timing header covers every stage up to
+// the write itself.
+//
+template <class Body>
+void write_response(http::response<Body>& res, const string& method, const string& target, RequestContext& ctx, beast::tcp_stream& stream)
+{
+    res.set("Server-Timing", ctx.timings.ServerTimingHeader());
+
+    beast::error_code ec;
+    {
+        ScopedStage write_stage(&ctx.timings, Stage::Write);
+        http::write(stream, res, ec);
+    }
+    if (ec) 
+    {
+        cerr << "Write failed: " << ec.message() << "\n";
+    }
+    cout << "Responded with status " << res.result_int() << "\n";
+    slow_requests.Record(method, target, res.result_int(), ctx.timings);
+}
+
+// Writes a complete JSON error response
+//
+void write_error(beast::tcp_stream& stream, unsigned version, bool keep_alive, http::status status, const string& message,
+                 const string& method, const string& target, RequestContext& ctx)
+{
+    http::response<http::string_body> res{status, version};
+    res.set(http::field::server, BOOST_BEAST_VERSION_STRING);
+    res.set(http::field::content_type, "application/json");
+    res.keep_alive(keep_alive);
+    json::object err{{"error", message}};
+    res.body() = json::serialize(err);
+    res.prepare_payload();
+    write_response(res, method, target, ctx, stream);
+}
+
+// GET /todos/export: streams the filtered items as NDJSON using chunked
+// transfer encoding. The header goes out with the first chunk, so filter
+// errors can still be answered with a regular 400. Throughput and the stage
+// timings are reported in the X-Rows-Per-Sec and Server-Timing trailers.
+//
+void handle_export(const http::request<http::string_body>& req, const string& target, RequestContext& ctx, beast::tcp_stream& stream)
+{
+    ToDoService service(pg_pool, &ctx);
+    auto params = parse_query_params(target);
+    auto started = chrono::steady_clock::now();
+
+    http::response<http::empty_body> res{http::status::ok, req.version()};
+    res.set(http::field::server, BOOST_BEAST_VERSION_STRING);
+    res.set(http::field::content_type, "application/x-ndjson");
+    res.set(http::field::trailer, "X-Rows-Per-Sec, Server-Timing");
+    res.keep_alive(req.keep_alive());
+    res.chunked(true);
+    http::response_serializer<http::empty_body> sr{res};
+
+    bool header_sent = false;
+    string chunk;
+    chunk.reserve(kStreamChunkSize + 1024);
+    beast::error_code ec;
+
+    auto flush = [&]() {
+        ScopedStage write_stage(&ctx.timings, Stage::Write);
+        if (!header_sent) 
+        {
+            http::write_header(stream, sr, ec);
+            header_sent = true;
+        }
+        if (!ec && !chunk.empty()) 
+        {
+            net::write(stream, http::make_chunk(net::buffer(chunk)), ec);
+        }
+        chunk.clear();
+        return !ec;
+    };
+
+    size_t exported = 0;
+    string error_msg;
+    bool ok = service.ExportToDos(params, [&](string_view line) {
+        chunk.append(line.data(), line.size());
+        chunk.push_back('\n');
+        return chunk.size() < kStreamChunkSize || flush();
+    }, exported, error_msg);
+
+    if (!ok && !header_sent) 
+    {
+        write_error(stream, req.version(), req.keep_alive(), failure_status(ctx), error_msg,
+                    string(req.method_string()), string(req.target()), ctx);
+        return;
+    }
+
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - started).count();
+    double rows_per_sec = seconds > 0 ? exported / seconds : 0;
+    cout << "Exported " << exported << " rows in " << seconds << "s (" << rows_per_sec << " rows/s)\n";
+
+    if (!ok) 
+    {
+        // Headers are already out; dropping the connection without the last
+        // chunk is the only way left to tell the client the export is incomplete.
+        cerr << "Export failed mid-stream: " << error_msg << "\n";
+        return;
+    }
+
+    if (flush()) 
+    {
+        http::fields trailer;
+        trailer.set("X-Rows-Per-Sec", to_string(static_cast<long long>(rows_per_sec)));
+        trailer.set("Server-Timing", ctx.timings.ServerTimingHeader());
+        net::write(stream, http::make_chunk_last(trailer), ec);
+    }
+    if (ec) 
+    {
+        cerr << "Write failed: " << ec.message() << "\n";
+    }
+    cout << "Responded with status 200\n";
+    slow_requests.Record(string(req.method_string()), string(req.target()), 200, ctx.timings);
+}
+
+// POST /todos/import: reads the NDJSON body incrementally from the socket and
+// hands it to the service line by line, so the body is never held in memory.
+//
+void handle_import(http::request_parser<http::buffer_body>& parser, beast::flat_buffer& buffer, RequestContext& ctx, beast::tcp_stream& stream)
+{
+    ToDoService service(pg_pool, &ctx);
+    auto started = chrono::steady_clock::now();
+    auto version = parser.get().version();
+    auto keep_alive = parser.get().keep_alive();
+    const string method = string(parser.get().method_string());
+    const string target = string(parser.get().target());
+
+    auto ticket = admit(Lane::Bulk, ctx);
+    if (!ticket) 
+    {
+        write_error(stream, version, false, http::status::service_unavailable, "Server busy, retry later", method, target, ctx);
+        return;
+    }
+
+    vector<char> read_buf(kStreamChunkSize);
+    string pending;     // bytes read but not yet returned as a line
+    size_t pending_pos = 0;
+    beast::error_code ec;
+
+    auto next_line = [&](string& line) {
+        for (;;) 
+        {
+            size_t nl = pending.find('\n', pending_pos);
+            if (nl != string::npos) 
+            {
+                line.assign(pending, pending_pos, nl - pending_pos);
+                pending_pos = nl + 1;
+                return true;
+            }
+            if (parser.is_done()) 
+            {
+                if (pending_pos >= pending.size()) return false;
+                line.assign(pending, pending_pos, string::npos);
+                pending_pos = pending.size();
+                return true;
+            }
+
+            pending.erase(0, pending_pos);
+            pending_pos = 0;
+
+            parser.get().body().data = read_buf.data();
+            parser.get().body().size = read_buf.size();
+            ScopedStage read_stage(&ctx.timings, Stage::Read);
+            http::read(stream, buffer, parser, ec);
+            if (ec == http::error::need_buffer) 
+            {
+                ec = {};
+            }
+            if (ec) 
+            {
+                throw runtime_error("Read error: " + ec.message());
+            }
+            pending.append(read_buf.data(), read_buf.size() - parser.get().body().size);
+        }
+    };
+
+    size_t imported = 0;
+    string error_msg;
+    if (!service.ImportToDos(next_line, imported, error_msg)) 
+    {
+        write_error(stream, version, false, failure_status(ctx), error_msg, method, target, ctx);
+        return;
+    }
+
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - started).count();
+    double rows_per_sec = seconds > 0 ? imported / seconds : 0;
+    cout << "Imported " << imported << " rows in " << seconds << "s (" << rows_per_sec << " rows/s)\n";
+
+    http::response<http::string_body> res{http::status::ok, version};
+    res.set(http::field::server, BOOST_BEAST_VERSION_STRING);
+    res.set(http::field::content_type, "application/json");
+    res.keep_alive(keep_alive);
+    json::object resp{{"imported", imported}, {"seconds", seconds}, {"rows_per_sec", rows_per_sec}};
+    res.body() = json::serialize(resp);
+    res.prepare_payload();
+    write_response(res, method, target, ctx, stream);
+}
 
 // This function produces an HTTP response for the given
 //
-void handle_request(http::request<http::string_body>&& req, beast::tcp_stream& stream) 
+void handle_request(http::request<http::string_body>&& req, RequestContext& ctx, beast::tcp_stream& stream) 
 {
+    // /lists/{listId}/todos... is served by the /todos routes, scoped to that list
+    string target = string(req.target());
+    const string method_name = string(req.method_string());
+    if (!split_list_scope(target, ctx.list_id)) 
+    {
+        write_error(stream, req.version(), req.keep_alive(), http::status::bad_request, "Invalid list id",
+                    method_name, string(req.target()), ctx);
+        return;
+    }
+
+    // Held until the response is built; exports keep it for the whole stream
+    Lane lane;
+    LaneScheduler::Ticket ticket;
+    if (route_lane(req.method(), target, lane)) 
+    {
+        ticket = admit(lane, ctx);
+        if (!ticket) 
+        {
+            bool expired = ctx.Expired();
+            write_error(stream, req.version(), req.keep_alive(),
+                        expired ? http::status::gateway_timeout : http::status::service_unavailable,
+                        expired ? "Request deadline exceeded" : "Server busy, retry later",
+                        method_name, string(req.target()), ctx);
+            return;
+        }
+    }
+
+    if (req.method() == http::verb::get && target.substr(0, target.find('?')) == "/todos/export") 
+    {
+        handle_export(req, target, ctx, stream);
+        return;
+    }
+
     http::response<http::string_body> res{http::status::ok, req.version()};
     res.set(http::field::server, BOOST_BEAST_VERSION_STRING);
     res.set(http::field::content_type, "application/json");
     res.keep_alive(req.keep_alive());
 
-    ToDoService service(pg_pool);
+    if (ctx.Expired()) 
+    {
+        // Reading the body used up the time; the client has stopped waiting
+        write_error(stream, req.version(), req.keep_alive(), http::status::gateway_timeout, "Request deadline exceeded",
+                    method_name, string(req.target()), ctx);
+        return;
+    }
+
+    ToDoService service(pg_pool, &ctx);
+
+    // Response bodies are serialized through here so that the time is booked
+    // to the serialize stage
+    auto serialize = [&ctx](const auto& value) {
+        ScopedStage serialize_stage(&ctx.timings, Stage::Serialize);
+        return json::serialize(value);
+    };
 
     try 
     {
-        string target = string(req.target());
         auto method = req.method();
-
-        json::value body_val;
-        if (!req.body().empty()) {
-            body_val = json::parse(req.body());
-        }
+        bool scoped = !ctx.list_id.empty();
 
         string error_msg = "";
 
-        if (method == http::verb::post && target == "/todos") 
+        if (method == http::verb::get && target == "/metrics" && !scoped) 
+        {
+            json::array acceptors;
+            for (const auto& shard : acceptor_shards) 
+            {
+                acceptors.emplace_back(json::object{{"cpu", shard->cpu}, {"accepted", shard->accepted.load()}});
+            }
+            json::object metrics{
+                {"database",  pg_pool.Metrics()},
+                {"acceptors", move(acceptors)},
+                {"list_coalescing", list_coalescer.Metrics()},
+                {"lanes",     lanes->Metrics()}
+            };
+            if (mutation_log) 
+            {
+                metrics["mutation_log"] = mutation_log->Metrics();
+                if (mutation_forwarder) 
+                {
+                    metrics["mutation_log"].as_object()["forwarded_seq"] = mutation_forwarder->Offset();
+                }
+            }
+            if (todo_snapshot) 
+            {
+                metrics["snapshot"] = todo_snapshot->Metrics();
+            }
+            metrics["due_timers"] = due_timers.Metrics();
+            res.body() = serialize(metrics);
+        }
+        else if (method == http::verb::get && target == "/todos/stats") 
+        {
+            res.body() = serialize(scoped ? todo_stats.ListJson(ctx.list_id) : todo_stats.ToJson());
+        }
+        else if (method == http::verb::get && target.substr(0, target.find('?')) == "/todos/due") 
+        {
+            auto params = parse_query_params(target);
+            json::object resp;
+            if (service.GetDueToDos(params, resp, error_msg)) 
+            {
+                res.body() = serialize(resp);
+            }
+            else 
+            {
+                res.result(http::status::bad_request);
+                json::object err{{"error", error_msg}};
+                res.body() = serialize(err);
+            }
+        }
+        else if (method == http::verb::get && target == "/admin/slow-requests" && !scoped) 
+        {
+            json::object resp{{"slowest", slow_requests.ToJson()}};
+            res.body() = serialize(resp);
+        }
+        else if (method == http::verb::post && target == "/todos") 
         {
             string new_id;
-            if (service.CreateToDo(body_val, new_id, error_msg)) 
+            if (service.CreateToDo(req.body(), new_id, error_msg)) 
             {
                 json::object resp{{"id", new_id}};
-                res.body() = json::serialize(resp);
+                res.body() = serialize(resp);
             } 
             else 
             {
                 res.result(http::status::bad_request);
                 json::object err{{"error", error_msg}};
-                res.body() = json::serialize(err);
+                res.body() = serialize(err);
             }
         }
         else if (method == http::verb::get && target.rfind("/todos/", 0) == 0) 
         {
-            string id = target.substr(7);
+            string id = target.substr(7, target.find('?') - 7);
+            auto params = parse_query_params(target);
             json::object item;
-            if (service.GetToDoById(id, item, error_msg))
+            if (service.GetToDoById(id, item, error_msg, params["fields"]))
             {
-                res.body() = json::serialize(item);
+                res.body() = serialize(item);
             }
             else
             {
                 res.result(http::status::bad_request);
                 json::object err{{"error", error_msg}};
-                res.body() = json::serialize(err);
+                res.body() = serialize(err);
             }
         }
         else if (method == http::verb::get && target.find("/todos") == 0) 
         {
-            // Parse query string if present
-            string query_string;
-            size_t qpos = target.find('?');
-            if (qpos != string::npos) {
-                query_string = target.substr(qpos + 1);
-            }
-
-            // Simple query param map
-            map<string, string> params;
-            if (!query_string.empty()) {
-                istringstream iss(query_string);
-                string token;
-                while (getline(iss, token, '&')) {
-                    size_t eq = token.find('=');
-                    if (eq != string::npos) {
-                        string key = token.substr(0, eq);
-                        string val = token.substr(eq + 1);
-                        boost::algorithm::replace_all(val, "%20", " ");
-                        params[key] = val;
-                    }
-                }
-            }
+            map<string, string> params = parse_query_params(target);
 
-            json::array out_items;
-            if (service.GetAllToDos(params, out_items, error_msg))
+            shared_ptr<const string> body;
+            if (service.GetAllToDos(params, body, error_msg))
             {
-                json::object resp{{"todos", move(out_items)}};
-                res.body() = json::serialize(resp);
+                // Sent straight from the shared page instead of copied into res
+                http::response<SharedStringBody> page{res.base(), move(body)};
+                ticket.Release();
+                page.prepare_payload();
+                write_response(page, method_name, string(req.target()), ctx, stream);
+                return;
             }
             else
             {
                 res.result(http::status::bad_request);
                 json::object err{{"error", error_msg}};
-                res.body() = json::serialize(err);
+                res.body() = serialize(err);
             }
         }
-        else if (method == http::verb::patch && target.rfind("/todos/", 0) == 0) 
+        else if ((method == http::verb::patch || method == http::verb::delete_) && 
+                 target.substr(0, target.find('?')) == "/todos") 
         {
-            string id = target.substr(7);
-
-            if (!body_val.is_object()) 
+            auto params = parse_query_params(target);
+            size_t affected = 0;
+            bool ok = (method == http::verb::patch)
+                ? service.BulkUpdateToDos(params, req.body(), affected, error_msg)
+                : service.BulkDeleteToDos(params, req.body(), affected, error_msg);
+            if (ok) 
+            {
+                json::object resp{{method == http::verb::patch ? "updated" : "deleted", affected}};
+                res.body() = serialize(resp);
+            } 
+            else 
             {
-                throw runtime_error("Request body must be a JSON object");
+                res.result(http::status::bad_request);
+                json::object err{{"error", error_msg}};
+                res.body() = serialize(err);
             }
-            if (service.UpdateToDo(id, body_val.as_object(), error_msg)) 
+        }
+        else if (method == http::verb::patch && target.rfind("/todos/", 0) == 0) 
+        {
+            string id = target.substr(7);
+            if (service.UpdateToDo(id, req.body(), error_msg)) 
             {
                 json::object resp{{"success", true}};
-                res.body() = json::serialize(resp);
+                res.body() = serialize(resp);
             } 
             else 
             {
                 res.result(http::status::bad_request);
                 json::object err{{"error", error_msg}};
-                res.body() = json::serialize(err);
+                res.body() = serialize(err);
             }
         }
         else if (method == http::verb::delete_ && target.rfind("/todos/", 0) == 0) 
@@ -145,50 +797,51 @@ void handle_request(http::request<http::string_body>&& req, beast::tcp_stream& s
             if (service.DeleteToDo(id, error_msg)) 
             {
                 json::object resp{{"success", true}};
-                res.body() = json::serialize(resp);
+                res.body() = serialize(resp);
             }
             else
             {
                 res.result(http::status::bad_request);
                 json::object err{{"error", error_msg}};
-                res.body() = json::serialize(err);
+                res.body() = serialize(err);
             }
         }
         else 
         {
             res.result(http::status::not_found);
             json::object err{{"error", "Not Found"}};
-            res.body() = json::serialize(err);
+            res.body() = serialize(err);
         }
     }
     catch (const json::system_error& je) 
     {
         res.result(http::status::bad_request);
         json::object err{{"error", string("Invalid JSON: ") + je.what()}};
-        res.body() = json::serialize(err);
+        res.body() = serialize(err);
     }
     catch (const pqxx::sql_error& se)
     {
         res.result(http::status::internal_server_error);
         json::object err{{"error", string("Database error: ") + se.what()}};
-        res.body() = json::serialize(err);
+        res.body() = serialize(err);
     }
     catch (const exception& e) 
     {
         res.result(http::status::bad_request);
         json::object err{{"error", e.what()}};
-        res.body() = json::serialize(err);
+        res.body() = serialize(err);
     }
 
-    res.prepare_payload();
-
-    beast::error_code ec;
-    http::write(stream, res, ec);
-    if (ec) 
+    if (res.result_int() >= 400 && failure_status(ctx) == http::status::gateway_timeout) 
     {
-        cerr << "Write failed: " << ec.message() << "\n";
+        res.result(http::status::gateway_timeout);
+        json::object err{{"error", ctx.Expired() ? "Request deadline exceeded" : "Query cancelled"}};
+        res.body() = serialize(err);
     }
-    cout << "Responded with status " << res.result_int() << "\n";
+
+    ticket.Release();
+    res.prepare_payload();
+    write_response(res, method_name, string(req.target()), ctx, stream);
 }
 
 
@@ -198,40 +851,245 @@ void do_session(beast::tcp_stream stream)
 {
     beast::error_code ec;
     beast::flat_buffer buffer;
-    http::request<http::string_body> req;
-    http::read(stream, buffer, req, ec);
+    RequestContext ctx;
+    ScopedStage read_stage(&ctx.timings, Stage::Read);
+
+    // Read the header first so that bulk imports can stream their body
+    http::request_parser<http::empty_body> header_parser;
+    http::read_header(stream, buffer, header_parser, ec);
     if (ec) 
     {
         cerr << "Read error: " << ec.message() << "\n";
         return;
     }
-    cout << "Received request: " << req.method_string() << " " << req.target() << "\n";
-    handle_request(move(req), stream);
+    cout << "Received request: " << header_parser.get().method_string() << " " << header_parser.get().target() << "\n";
+
+    string target = string(header_parser.get().target());
+    identify_client(ctx, header_parser.get(), stream);
+    // SOCKET handles on Windows fit in an int, like file descriptors
+    ctx.client_fd = static_cast<int>(stream.socket().native_handle());
+    string route = target;
+    string route_list_id;
+    split_list_scope(route, route_list_id);
+    set_deadline(ctx, header_parser.get(), route);
+    if (header_parser.get().method() == http::verb::post && split_list_scope(target, ctx.list_id) && target == "/todos/import") 
+    {
+        read_stage.Stop();  // the body is read, and timed, line by line
+        http::request_parser<http::buffer_body> parser{move(header_parser)};
+        parser.body_limit(boost::none);
+        handle_import(parser, buffer, ctx, stream);
+        stream.close();
+        return;
+    }
+
+    http::request_parser<http::string_body> parser{move(header_parser)};
+    http::read(stream, buffer, parser, ec);
+    if (ec) 
+    {
+        cerr << "Read error: " << ec.message() << "\n";
+        return;
+    }
+    read_stage.Stop();
+    handle_request(parser.release(), ctx, stream);
     stream.close();
 }
 
-// Accepts incoming connections and launches the sessions
+// Stand-in for a Kafka topic: appends each forwarded mutation to `path` as one
+// JSON message per line, keyed by list and item id
 //
-void do_accept(net::io_context& ioc, tcp::acceptor& acceptor) 
+MutationForwarder::Sink ndjson_topic_sink(const string& path)
 {
+    shared_ptr<FILE> file(fopen(path.c_str(), "a"), [](FILE* f) { if (f != nullptr) fclose(f); });
+    if (!file) 
+    {
+        throw runtime_error("Cannot open mutation topic file " + path);
+    }
+
+    auto item_json = [](const ToDoItem& item) {
+        json::array tags;
+        for (const auto& tag : item.tags) tags.emplace_back(json::string_view(tag));
+        return json::object{
+            {"id",          item.id},
+            {"list_id",     item.list_id},
+            {"name",        item.name},
+            {"description", item.description},
+            {"due_date",    item.due_date},
+            {"status",      item.status},
+            {"priority",    item.priority},
+            {"tags",        move(tags)}
+        };
+    };
+
+    return [file, item_json](const MutationRecord& rec) {
+        static const char* ops[] = {"", "created", "updated", "deleted", "", "reminder", "overdue"};
+        const ToDoItem& keyed = (rec.op == MutationRecord::Deleted) ? rec.before : rec.after;
+        json::object message{
+            {"offset",    rec.seq},
+            {"timestamp", rec.unix_ms},
+            {"op",        ops[rec.op]},
+            {"key",       keyed.id.empty() ? string() : keyed.list_id + "/" + keyed.id}
+        };
+        if (rec.op == MutationRecord::Updated || rec.op == MutationRecord::Deleted) 
+        {
+            message["before"] = item_json(rec.before);
+        }
+        if (rec.op != MutationRecord::Deleted) 
+        {
+            message["after"] = item_json(rec.after);
+        }
+        string line = json::serialize(message) + "\n";
+        return fwrite(line.data(), 1, line.size(), file.get()) == line.size() && fflush(file.get()) == 0;
+    };
+}
+
+// Pins the calling thread to `cpu`. A no-op for cpu < 0 and off Linux.
+//
+void pin_to_cpu(int cpu)
+{
+#ifdef __linux__
+    if (cpu < 0) 
+    {
+        return;
+    }
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    int rc = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    if (rc != 0) 
+    {
+        cerr << "Failed to pin thread to CPU " << cpu << ": error " << rc << "\n";
+    }
+#else
+    (void)cpu;
+#endif
+}
+
+// Opens a listening socket on `endpoint`. `reuse_port` sets SO_REUSEPORT so
+// that several acceptors can bind the same port.
+//
+unique_ptr<tcp::acceptor> open_acceptor(net::io_context& ioc, const tcp::endpoint& endpoint, bool reuse_port)
+{
+    auto acceptor = make_unique<tcp::acceptor>(ioc);
+    acceptor->open(endpoint.protocol());
+    acceptor->set_option(net::socket_base::reuse_address(true));
+    if (reuse_port) 
+    {
+#ifdef SO_REUSEPORT
+        acceptor->set_option(net::detail::socket_option::boolean<SOL_SOCKET, SO_REUSEPORT>(true));
+#else
+        throw runtime_error("SO_REUSEPORT is not supported on this platform");
+#endif
+    }
+    acceptor->bind(endpoint);
+    acceptor->listen(net::socket_base::max_listen_connections);
+    return acceptor;
+}
+
+// Accepts incoming connections on one shard and launches the sessions. Session
+// threads inherit the shard's CPU, so a connection is served on the core that
+// accepted it.
+//
+void do_accept(net::io_context& ioc, AcceptorShard& shard) 
+{
+    pin_to_cpu(shard.cpu);
     for (;;) 
     {
         tcp::socket socket(ioc);
         beast::error_code ec;
-        acceptor.accept(socket, ec);
+        shard.acceptor->accept(socket, ec);
         if (ec) 
         {
             cerr << "Accept error: " << ec.message() << "\n";
             continue;
         }
+        ++shard.accepted;
         cout << "Accepted connection from " << socket.remote_endpoint() << "\n";
-        thread([s = beast::tcp_stream(move(socket))]() mutable 
+        thread([s = beast::tcp_stream(move(socket)), cpu = shard.cpu]() mutable 
         {
+            pin_to_cpu(cpu);
             do_session(move(s));
         }).detach();
     }
 }
 
+// Number of acceptor shards from TODO_ACCEPTOR_SHARDS: a count, or "auto" for
+// one per core
+//
+size_t acceptor_shard_count()
+{
+    if (env_or("TODO_ACCEPTOR_SHARDS", "") == "auto") 
+    {
+        return max(1u, thread::hardware_concurrency());
+    }
+    return static_cast<size_t>(env_long("TODO_ACCEPTOR_SHARDS", 1, 1, 1024));
+}
+
+// Loads ToDoStats and the due-date wheel from one pass of `scan`
+//
+bool load_in_memory_views(const ToDoStats::ItemScan& scan)
+{
+    return todo_stats.Load([&scan](const function<void(const ToDoItem&)>& to_stats) 
+    {
+        return due_timers.Load([&](const function<void(const ToDoItem&)>& to_wheel) 
+        {
+            return scan([&](const ToDoItem& item) 
+            {
+                to_stats(item);
+                to_wheel(item);
+            });
+        });
+    });
+}
+
+// Loads ToDoStats and the due-date wheel from the snapshot at `path` plus what changed in the table
+// since it was written (everything, when there is no usable file). The image
+// stays loaded and is caught up and saved again every `interval_s` seconds
+// (TODO_SNAPSHOT_INTERVAL_S; 0 = once), starting right away, so the next start
+// has little to catch up on.
+//
+bool warm_up_from_snapshot(const string& path, long interval_s)
+{
+    auto started = chrono::steady_clock::now();
+    todo_snapshot = make_unique<ToDoSnapshot>();
+    bool from_file = todo_snapshot->Load(path);
+    if (!todo_snapshot->CatchUp(pg_pool)) 
+    {
+        cerr << "Snapshot catch-up failed\n";
+        todo_snapshot.reset();
+        return false;
+    }
+    size_t items = 0;
+    load_in_memory_views([&items](const function<void(const ToDoItem&)>& on_item) 
+    {
+        todo_snapshot->ForEach([&](const ToDoItem& item) 
+        {
+            ++items;
+            on_item(item);
+        });
+        return true;
+    });
+    auto elapsed = chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - started);
+    cout << "Warmed up " << items << " items from " << (from_file ? path : "a full table read")
+         << " in " << elapsed.count() << " ms\n";
+
+    thread([path, interval_s] 
+    {
+        while (true) 
+        {
+            if (todo_snapshot->CatchUp(pg_pool)) 
+            {
+                todo_snapshot->Save(path);
+            }
+            if (interval_s <= 0) 
+            {
+                return;
+            }
+            this_thread::sleep_for(chrono::seconds(interval_s));
+        }
+    }).detach();
+    return true;
+}
+
 // Main function: setup server and run
 //
 int main() 
@@ -239,14 +1097,94 @@ int main()
     try 
     {
         cout << "Starting ToDoService...\n";
+
+        read_timeout_ms = env_long("TODO_READ_TIMEOUT_MS", read_timeout_ms);
+        write_timeout_ms = env_long("TODO_WRITE_TIMEOUT_MS", write_timeout_ms);
+        bulk_timeout_ms = env_long("TODO_BULK_TIMEOUT_MS", bulk_timeout_ms);
+        lane_max_wait_ms = env_long("TODO_LANE_MAX_WAIT_MS", lane_max_wait_ms);
+        lanes = make_unique<LaneScheduler>(pg_pool.MaxConnections(), lane_options());
+        due_timers.SetReminderLead(env_long("TODO_REMINDER_LEAD_S", 3600));
+        slow_requests.SetCapacity(env_long("TODO_SLOW_REQUEST_LOG_SIZE", 50));
+        list_coalescer.SetTtl(chrono::milliseconds(env_long("TODO_LIST_CACHE_TTL_MS", 0)));
+
+        // Read replicas: semicolon-separated libpq connection strings
+        istringstream replicas(env_or("TODO_PG_REPLICAS", ""));
+        string replica;
+        while (getline(replicas, replica, ';')) 
+        {
+            boost::algorithm::trim(replica);
+            if (!replica.empty()) 
+            {
+                pg_pool.AddReplica(replica);
+                cout << "Routing reads to a read replica\n";
+            }
+        }
+        pg_pool.SetReadYourWrites(env_or("TODO_READ_YOUR_WRITES", "1") == "1");
+
+        string snapshot_path = env_or("TODO_SNAPSHOT_FILE", "");
+        long snapshot_interval_s = env_long("TODO_SNAPSHOT_INTERVAL_S", 300);
+        bool warmed_up = !snapshot_path.empty() && warm_up_from_snapshot(snapshot_path, snapshot_interval_s);
+        auto scan_table = [](const function<void(const ToDoItem&)>& on_item) { return pg_pool.ScanToDoItems(on_item); };
+        if (!warmed_up && !load_in_memory_views(scan_table)) 
+        {
+            cerr << "Failed to load ToDo stats and due dates; both start empty\n";
+        }
+        ToDoService::AddObserver(&todo_stats);
+        ToDoService::AddObserver(&due_timers);
+        ToDoService::SetDueTimers(&due_timers);
+        ToDoService::AddObserver(&list_coalescer);
+
+        string log_dir = env_or("TODO_MUTATION_LOG_DIR", "");
+        if (!log_dir.empty()) 
+        {
+            mutation_log = make_unique<MutationLog>(log_dir);
+            cout << "Mutation log in " << log_dir << " recovered up to #" << mutation_log->DurableSeq() << "\n";
+            ToDoService::AddObserver(mutation_log.get());
+
+            string topic = env_or("TODO_MUTATION_FORWARD_FILE", "");
+            if (!topic.empty()) 
+            {
+                mutation_forwarder = make_unique<MutationForwarder>(
+                    *mutation_log, ndjson_topic_sink(topic), (filesystem::path(log_dir) / "forwarder.offset").string());
+            }
+        }
+        ToDoService::SetListCoalescer(&list_coalescer);
+
+        due_timers.SetSink([](DueTimerWheel::Event event, const ToDoItem& item) 
+        {
+            if (mutation_log) 
+            {
+                mutation_log->OnEvent(event == DueTimerWheel::Event::Reminder ? MutationRecord::Reminder
+                                                                              : MutationRecord::Overdue, item);
+            }
+        });
+        due_timers.Start();
+
+        // One acceptor by default; with TODO_ACCEPTOR_SHARDS > 1 each shard gets
+        // its own SO_REUSEPORT socket and accept thread, optionally pinned to a core
+        size_t shard_count = acceptor_shard_count();
+        bool pin = env_or("TODO_PIN_CPUS", "0") == "1";
+        size_t cores = max(1u, thread::hardware_concurrency());
         net::io_context ioc{1};
-        tcp::acceptor acceptor(ioc, tcp::endpoint(tcp::v4(), 8080));
+        tcp::endpoint endpoint(tcp::v4(), 8080);
+        for (size_t i = 0; i < shard_count; ++i) 
+        {
+            auto shard = make_unique<AcceptorShard>();
+            shard->cpu = pin ? static_cast<int>(i % cores) : -1;
+            shard->acceptor = open_acceptor(ioc, endpoint, shard_count > 1);
+            acceptor_shards.push_back(move(shard));
+        }
 
-        cout << "ToDoService listening on http://localhost:8080\n";
+        cout << "ToDoService listening on http://localhost:8080 with " << shard_count << " acceptor(s)\n";
 
-        thread t([&] { do_accept(ioc, acceptor); });
-        ioc.run();
-        t.join();
+        for (auto& shard : acceptor_shards) 
+        {
+            shard->worker = thread([&ioc, s = shard.get()] { do_accept(ioc, *s); });
+        }
+        for (auto& shard : acceptor_shards) 
+        {
+            shard->worker.join();
+        }
     }
     catch (const exception& e) 
     {
@@ -0,0 +1,148 @@
+#ifndef TAG_DICTIONARY_HPP
+#define TAG_DICTIONARY_HPP
+
+#include <boost/json.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <shared_mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+using namespace std;
+
+// In-process cache of the Tags table (see create_db.sql). Rows store tags as
+// an INTEGER[] of dictionary ids; this maps them back to names for responses
+// and item images, and tag-name filters to ids.
+//
+// Ids are never reused (they come from a sequence), so an id -> name entry
+// never goes stale and may be learned from any transaction, even one that
+// later rolls back. A name -> id entry is only trusted once it was read
+// back committed (FindCommitted), otherwise a rolled-back id could shadow
+// the one the name is eventually given.
+//
+class TagDictionary
+{
+public:
+    using TagId = int32_t;
+
+    // Parses an INTEGER[] in PostgreSQL text form ("{3,17}")
+    //
+    static vector<TagId> ParseIds(const string& text)
+    {
+        vector<TagId> ids;
+        TagId value = 0;
+        bool in_number = false;
+        for (char c : text)
+        {
+            if (c >= '0' && c <= '9')
+            {
+                value = value * 10 + (c - '0');
+                in_number = true;
+            }
+            else if (in_number)
+            {
+                ids.push_back(value);
+                value = 0;
+                in_number = false;
+            }
+        }
+        if (in_number) ids.push_back(value);
+        return ids;
+    }
+
+    // The inverse of ParseIds; safe to inline into SQL
+    //
+    static string FormatIds(const vector<TagId>& ids)
+    {
+        string text = "{";
+        for (size_t i = 0; i < ids.size(); ++i)
+        {
+            if (i > 0) text += ',';
+            text += to_string(ids[i]);
+        }
+        return text + "}";
+    }
+
+    void Learn(TagId id, const string& name)
+    {
+        unique_lock<shared_mutex> lock(mtx_);
+        names_.emplace(id, name);
+    }
+
+    // Also makes the name findable; only for rows read back committed
+    //
+    void LearnCommitted(TagId id, const string& name)
+    {
+        unique_lock<shared_mutex> lock(mtx_);
+        names_.emplace(id, name);
+        ids_.emplace(name, id);
+    }
+
+    // Ids of `ids` without a known name, without duplicates
+    //
+    vector<TagId> Missing(const vector<TagId>& ids) const
+    {
+        vector<TagId> missing;
+        shared_lock<shared_mutex> lock(mtx_);
+        for (TagId id : ids)
+        {
+            if (names_.count(id) == 0 && find(missing.begin(), missing.end(), id) == missing.end())
+            {
+                missing.push_back(id);
+            }
+        }
+        misses_ += missing.size();
+        return missing;
+    }
+
+    // Names for `ids`, in order. Ids that were never learned are skipped.
+    //
+    vector<string> Names(const vector<TagId>& ids) const
+    {
+        vector<string> names;
+        names.reserve(ids.size());
+        shared_lock<shared_mutex> lock(mtx_);
+        for (TagId id : ids)
+        {
+            auto it = names_.find(id);
+            if (it != names_.end()) names.push_back(it->second);
+        }
+        return names;
+    }
+
+    // Id of a committed tag name; false when not known (yet)
+    //
+    bool FindCommitted(const string& name, TagId& id) const
+    {
+        shared_lock<shared_mutex> lock(mtx_);
+        auto it = ids_.find(name);
+        if (it == ids_.end()) return false;
+        id = it->second;
+        return true;
+    }
+
+    size_t Size() const
+    {
+        shared_lock<shared_mutex> lock(mtx_);
+        return names_.size();
+    }
+
+    boost::json::object Metrics() const
+    {
+        return {
+            {"known",  Size()},
+            {"misses", misses_.load()}
+        };
+    }
+
+private:
+    mutable shared_mutex mtx_;
+    unordered_map<TagId, string> names_;
+    unordered_map<string, TagId> ids_;
+    mutable atomic<uint64_t> misses_{0};
+};
+
+#endif
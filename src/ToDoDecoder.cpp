@@ -0,0 +1,451 @@
+#include "ToDoDecoder.hpp"
+#include "Utility.hpp"
+
+#include <boost/json/basic_parser_impl.hpp>
+
+#include <algorithm>
+
+map<string, string> ToDoUpdate::Columns() const
+{
+    map<string, string> columns;
+    if (name) columns["name"] = *name;
+    if (description) columns["description"] = *description;
+    if (due_date) columns["due_date"] = *due_date;
+    if (status) columns["status"] = *status;
+    if (priority) columns["priority"] = to_string(*priority);
+    if (tags) columns["tags"] = format_pg_array(*tags);
+    return columns;
+}
+
+namespace {
+
+using boost::json::error_code;
+using json_view = boost::json::string_view;
+
+enum class Field { None, Skip, Id, Name, Description, DueDate, Status, Priority, Tags, Ids };
+
+// basic_parser handler that writes each top-level member of the body into
+// either a ToDoItem or a ToDoUpdate. Values of unknown keys are skipped by
+// depth; "tags" and "ids" are the only arrays that are descended into.
+//
+class ToDoHandler
+{
+public:
+    static constexpr size_t max_object_size = size_t(-1);
+    static constexpr size_t max_array_size = size_t(-1);
+    static constexpr size_t max_key_size = size_t(-1);
+    static constexpr size_t max_string_size = size_t(-1);
+
+    // Exactly one of `item` / `update` is given
+    ToDoHandler(ToDoItem* item, ToDoUpdate* update, bool allow_ids)
+        : item_(item), update_(update), allow_ids_(allow_ids)
+    {
+    }
+
+    // Why a callback refused the body; empty for JSON syntax errors
+    string problem;
+
+    bool on_document_begin(error_code&) { return true; }
+    bool on_document_end(error_code&) { return true; }
+
+    bool on_object_begin(error_code& ec)
+    {
+        if (depth_ == 0 || field_ == Field::Skip)
+        {
+            ++depth_;
+            return true;
+        }
+        return Fail(ec, TypeError());
+    }
+
+    bool on_object_end(size_t, error_code& ec)
+    {
+        if (--depth_ == 0)
+        {
+            return Finish(ec);
+        }
+        if (depth_ == 1)
+        {
+            field_ = Field::None;
+        }
+        return true;
+    }
+
+    bool on_array_begin(error_code& ec)
+    {
+        if (depth_ == 0)
+        {
+            return Fail(ec, NotObject());
+        }
+        if (field_ == Field::Skip || (depth_ == 1 && (field_ == Field::Tags || field_ == Field::Ids)))
+        {
+            if (field_ == Field::Tags) Tags().clear();
+            if (field_ == Field::Ids) update_->ids.emplace();
+            ++depth_;
+            return true;
+        }
+        return Fail(ec, TypeError());
+    }
+
+    bool on_array_end(size_t n, error_code& ec)
+    {
+        if (--depth_ == 1)
+        {
+            if (field_ == Field::Ids && n == 0)
+            {
+                return Fail(ec, "ids must be a non-empty array of item ids");
+            }
+            field_ = Field::None;
+        }
+        return true;
+    }
+
+    bool on_key_part(json_view s, size_t, error_code&)
+    {
+        if (depth_ == 1) key_.append(s.data(), s.size());
+        return true;
+    }
+
+    bool on_key(json_view s, size_t, error_code&)
+    {
+        if (depth_ == 1)
+        {
+            key_.append(s.data(), s.size());
+            field_ = Lookup(key_);
+            key_.clear();
+        }
+        return true;
+    }
+
+    bool on_string_part(json_view s, size_t, error_code&)
+    {
+        if (field_ != Field::Skip) text_.append(s.data(), s.size());
+        return true;
+    }
+
+    bool on_string(json_view s, size_t, error_code& ec)
+    {
+        if (!Accept(ec)) return false;
+        if (field_ == Field::Skip) return Skipped();
+
+        string value;
+        if (text_.empty())
+        {
+            value.assign(s.data(), s.size());
+        }
+        else
+        {
+            text_.append(s.data(), s.size());
+            value = move(text_);
+            text_.clear();
+        }
+
+        if (depth_ == 2)
+        {
+            return field_ == Field::Tags ? AddTag(move(value), ec) : AddId(move(value), ec);
+        }
+
+        switch (field_)
+        {
+        case Field::Id:
+            if (item_ != nullptr) item_->id = move(value);
+            break;
+        case Field::Name:
+            seen_name_ = true;
+            Set(item_ != nullptr ? &item_->name : nullptr, update_ != nullptr ? &update_->name : nullptr, move(value));
+            break;
+        case Field::Description:
+            Set(item_ != nullptr ? &item_->description : nullptr, update_ != nullptr ? &update_->description : nullptr, move(value));
+            break;
+        case Field::DueDate:
+            Set(item_ != nullptr ? &item_->due_date : nullptr, update_ != nullptr ? &update_->due_date : nullptr, move(value));
+            break;
+        case Field::Status:
+            if (value != "Not Started" && value != "In Progress" && value != "Completed")
+            {
+                return Fail(ec, "Invalid status value");
+            }
+            Set(item_ != nullptr ? &item_->status : nullptr, update_ != nullptr ? &update_->status : nullptr, move(value));
+            break;
+        case Field::Priority:
+        {
+            // The request format sends the number as a string
+            if (value.empty() || value.size() > 9 || value.find_first_not_of("0123456789") != string::npos)
+            {
+                return Fail(ec, "Priority must be an integer between 1 and 5");
+            }
+            if (!SetPriority(stoll(value), ec)) return false;
+            break;
+        }
+        case Field::Tags:
+        {
+            Tags().clear();
+            size_t start = 0;
+            while (!value.empty())
+            {
+                size_t end = value.find(',', start);
+                if (!AddTag(value.substr(start, end - start), ec)) return false;
+                if (end == string::npos) break;
+                start = end + 1;
+            }
+            break;
+        }
+        default:
+            return Fail(ec, TypeError());
+        }
+        field_ = Field::None;
+        return true;
+    }
+
+    bool on_number_part(json_view, error_code&) { return true; }
+
+    bool on_int64(int64_t i, json_view, error_code& ec)
+    {
+        if (!Accept(ec)) return false;
+        if (field_ == Field::Skip) return Skipped();
+        if (depth_ != 1 || field_ != Field::Priority) return Fail(ec, TypeError());
+        if (!SetPriority(i, ec)) return false;
+        field_ = Field::None;
+        return true;
+    }
+
+    bool on_uint64(uint64_t, json_view, error_code& ec)
+    {
+        // Only reached above INT64_MAX
+        if (!Accept(ec)) return false;
+        if (field_ == Field::Skip) return Skipped();
+        return Fail(ec, field_ == Field::Priority && depth_ == 1 ? "Priority must be between 1 and 5" : TypeError());
+    }
+
+    bool on_double(double, json_view, error_code& ec)
+    {
+        if (!Accept(ec)) return false;
+        if (field_ == Field::Skip) return Skipped();
+        return Fail(ec, TypeError());
+    }
+
+    bool on_bool(bool, error_code& ec)
+    {
+        if (!Accept(ec)) return false;
+        if (field_ == Field::Skip) return Skipped();
+        return Fail(ec, TypeError());
+    }
+
+    bool on_null(error_code& ec)
+    {
+        if (!Accept(ec)) return false;
+        if (field_ == Field::Skip) return Skipped();
+
+        // The export format writes nulls for missing values; updates cannot
+        // clear a column
+        if (item_ == nullptr || depth_ != 1 || field_ == Field::Name)
+        {
+            return Fail(ec, TypeError());
+        }
+        switch (field_)
+        {
+        case Field::Id: item_->id.clear(); break;
+        case Field::Description: item_->description.clear(); break;
+        case Field::DueDate: item_->due_date.clear(); break;
+        case Field::Status: item_->status = "Not Started"; break;
+        case Field::Priority: item_->priority = 3; break;
+        case Field::Tags: item_->tags.clear(); break;
+        default: break;
+        }
+        field_ = Field::None;
+        return true;
+    }
+
+    bool on_comment_part(json_view, error_code&) { return true; }
+    bool on_comment(json_view, error_code&) { return true; }
+
+private:
+    bool Fail(error_code& ec, string message)
+    {
+        problem = move(message);
+        ec = boost::system::errc::make_error_code(boost::system::errc::invalid_argument);
+        return false;
+    }
+
+    string NotObject() const
+    {
+        return item_ != nullptr ? "Item must be a JSON object" : "Request body must be a JSON object";
+    }
+
+    string TypeError() const
+    {
+        switch (field_)
+        {
+        case Field::Id: return "id must be a string";
+        case Field::Name: return "name must be a string";
+        case Field::Description: return "description must be a string";
+        case Field::DueDate: return "due_date must be a string";
+        case Field::Status: return "status must be a string";
+        case Field::Priority: return "Priority must be an integer between 1 and 5";
+        case Field::Tags: return "Tags must be an array of strings or a comma-separated string";
+        case Field::Ids: return depth_ == 2 ? "ids must contain item ids (UUIDs)" : "ids must be a non-empty array of item ids";
+        default: return NotObject();
+        }
+    }
+
+    // Scalars are only valid as member values
+    bool Accept(error_code& ec)
+    {
+        return depth_ != 0 || Fail(ec, NotObject());
+    }
+
+    // A skipped member ends with its value unless the value is a container
+    bool Skipped()
+    {
+        if (depth_ == 1) field_ = Field::None;
+        return true;
+    }
+
+    Field Lookup(const string& key) const
+    {
+        if (key == "name") return Field::Name;
+        if (key == "description") return Field::Description;
+        if (key == "due_date") return Field::DueDate;
+        if (key == "status") return Field::Status;
+        if (key == "priority") return Field::Priority;
+        if (key == "tags") return Field::Tags;
+        if (key == "id" && item_ != nullptr) return Field::Id;
+        if (key == "ids" && update_ != nullptr && allow_ids_) return Field::Ids;
+        return Field::Skip;
+    }
+
+    static void Set(string* item_field, optional<string>* update_field, string value)
+    {
+        if (item_field != nullptr) *item_field = move(value);
+        else *update_field = move(value);
+    }
+
+    bool SetPriority(int64_t value, error_code& ec)
+    {
+        if (value < 1 || value > 5)
+        {
+            return Fail(ec, "Priority must be between 1 and 5");
+        }
+        if (item_ != nullptr) item_->priority = static_cast<int>(value);
+        else update_->priority = static_cast<int>(value);
+        return true;
+    }
+
+    vector<string>& Tags()
+    {
+        if (item_ != nullptr) return item_->tags;
+        if (!update_->tags) update_->tags.emplace();
+        return *update_->tags;
+    }
+
+    bool AddTag(string tag, error_code& ec)
+    {
+        if (tag.empty() || tag.size() > ToDoDecoder::kMaxTagLength)
+        {
+            return Fail(ec, "Tags must be non-empty and at most " + to_string(ToDoDecoder::kMaxTagLength) + " characters");
+        }
+        vector<string>& tags = Tags();
+        if (tags.size() == ToDoDecoder::kMaxTags)
+        {
+            return Fail(ec, "At most " + to_string(ToDoDecoder::kMaxTags) + " tags per item");
+        }
+        tags.push_back(move(tag));
+        return true;
+    }
+
+    bool AddId(string id, error_code& ec)
+    {
+        if (!is_uuid(id))
+        {
+            return Fail(ec, "ids must contain item ids (UUIDs)");
+        }
+        if (update_->ids->size() == ToDoDecoder::kMaxIds)
+        {
+            return Fail(ec, "At most " + to_string(ToDoDecoder::kMaxIds) + " ids per request");
+        }
+        update_->ids->push_back(move(id));
+        return true;
+    }
+
+    bool Finish(error_code& ec)
+    {
+        if (item_ != nullptr && !seen_name_)
+        {
+            return Fail(ec, "name is required");
+        }
+        return true;
+    }
+
+    ToDoItem* item_;
+    ToDoUpdate* update_;
+    bool allow_ids_;
+    bool seen_name_ = false;
+
+    int depth_ = 0;
+    Field field_ = Field::None;
+    string key_;
+    string text_;
+};
+
+void Locate(string_view body, size_t offset, DecodeError& error)
+{
+    error.offset = min(offset, body.size());
+    error.line = 1;
+    size_t line_start = 0;
+    for (size_t i = 0; i < error.offset; ++i)
+    {
+        if (body[i] == '\n')
+        {
+            ++error.line;
+            line_start = i + 1;
+        }
+    }
+    error.column = error.offset - line_start + 1;
+}
+
+bool Decode(string_view body, ToDoItem* item, ToDoUpdate* update, bool allow_ids, DecodeError& error)
+{
+    boost::json::basic_parser<ToDoHandler> parser(boost::json::parse_options{}, item, update, allow_ids);
+    error_code ec;
+    size_t used = parser.write_some(false, body.data(), body.size(), ec);
+    if (!ec && used == body.size())
+    {
+        return true;
+    }
+
+    const string& problem = parser.handler().problem;
+    error.message = !problem.empty() ? problem
+                  : ec ? "Invalid JSON: " + ec.message()
+                  : "Invalid JSON: extra data after the document";
+    Locate(body, used, error);
+    return false;
+}
+
+bool IsBlank(string_view body)
+{
+    return body.find_first_not_of(" \t\r\n") == string_view::npos;
+}
+
+}
+
+bool ToDoDecoder::DecodeItem(string_view body, ToDoItem& item, DecodeError& error)
+{
+    if (IsBlank(body))
+    {
+        error.message = "Item must be a JSON object";
+        Locate(body, body.size(), error);
+        return false;
+    }
+    item.status = "Not Started";
+    item.priority = 3;
+    return Decode(body, &item, nullptr, false, error);
+}
+
+bool ToDoDecoder::DecodeUpdate(string_view body, ToDoUpdate& update, bool allow_ids, DecodeError& error)
+{
+    if (IsBlank(body))
+    {
+        return true;
+    }
+    return Decode(body, nullptr, &update, allow_ids, error);
+}
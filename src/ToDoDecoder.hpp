@@ -0,0 +1,78 @@
+#ifndef TODO_DECODER_HPP
+#define TODO_DECODER_HPP
+
+#include <cstddef>
+#include <map>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "DbAccess.hpp"  // ToDoItem
+
+using namespace std;
+
+// Fields of a PATCH body; members left unset are not changed
+//
+struct ToDoUpdate
+{
+    optional<string> name;
+    optional<string> description;
+    optional<string> due_date;
+    optional<string> status;
+    optional<int> priority;
+    optional<vector<string>> tags;
+
+    // Bulk requests only: the items to change or delete
+    optional<vector<string>> ids;
+
+    bool Empty() const
+    {
+        return !name && !description && !due_date && !status && !priority && !tags;
+    }
+
+    // Column -> value pairs for PgPool::UpdateToDoItem(s)
+    map<string, string> Columns() const;
+};
+
+// Where and why a body was rejected. The location is where the parser stood
+// when the value was refused: the closing quote of a string, just past a
+// number or literal (1-based line and byte column).
+//
+struct DecodeError
+{
+    string message;
+    size_t offset = 0;
+    size_t line = 1;
+    size_t column = 1;
+
+    string Describe() const
+    {
+        return message + " at line " + to_string(line) + ", column " + to_string(column);
+    }
+};
+
+// Decodes request bodies straight into the typed structures in one pass of a
+// SAX parser: no JSON DOM is built, fields are matched by key as they stream
+// past, and status, priority, tags and ids are validated as they are read.
+// Unknown keys are skipped.
+//
+class ToDoDecoder
+{
+public:
+    static constexpr size_t kMaxTags = 50;
+    static constexpr size_t kMaxTagLength = 100;
+    static constexpr size_t kMaxIds = 10000;
+
+    // POST bodies and import lines. Accepts both the request format (priority
+    // as a string, tags as a comma-separated string) and the export format
+    // (priority as a number, tags as an array, nulls for missing values).
+    //
+    static bool DecodeItem(string_view body, ToDoItem& item, DecodeError& error);
+
+    // PATCH bodies. `allow_ids` admits the "ids" selector of the bulk routes;
+    // an empty body decodes to an empty update.
+    //
+    static bool DecodeUpdate(string_view body, ToDoUpdate& update, bool allow_ids, DecodeError& error);
+};
+
+#endif
@@ -0,0 +1,39 @@
+#ifndef TODO_OBSERVER_HPP
+#define TODO_OBSERVER_HPP
+
+#include <vector>
+
+#include "DbAccess.hpp"  // ToDoItem
+
+// Receives every mutation that goes through ToDoService once it has been
+// committed. Callbacks run on the request thread, so they must be cheap.
+//
+// Callbacks for different requests arrive in whatever order their threads
+// get here, not in commit order. Every image carries its row version
+// (ToDoItem::version), which orders the images of one item; a deleted item
+// carries the version of its last image. Observers that keep per-item state
+// ignore images older than the one they hold.
+//
+class ToDoObserver
+{
+public:
+    virtual ~ToDoObserver() = default;
+
+    virtual void OnCreated(const ToDoItem& item) = 0;
+
+    virtual void OnUpdated(const ToDoItem& before, const ToDoItem& after) = 0;
+
+    virtual void OnDeleted(const ToDoItem& item) = 0;
+
+    // Rows of a bulk import, in batches of up to kImportBatchRows, so that
+    // observers can apply each batch under one lock
+    virtual void OnBulkImport(const std::vector<ToDoItem>& items)
+    {
+        for (const auto& item : items) OnCreated(item);
+    }
+
+    // After the import that delivered the batches has committed
+    virtual void OnBulkImportCommitted() {}
+};
+
+#endif
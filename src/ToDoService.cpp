@@ -1,45 +1,98 @@
 #include "ToDoService.hpp"
 #include "Utility.hpp"
 
-bool ToDoService::CreateToDo(const boost::json::value& body, std::string& out_id, std::string& error) 
+#include <algorithm>
+#include <chrono>
+#include <ctime>
+
+std::vector<ToDoObserver*>& ToDoService::Observers()
 {
-    try 
+    static std::vector<ToDoObserver*> observers;
+    return observers;
+}
+
+void ToDoService::AddObserver(ToDoObserver* observer)
+{
+    Observers().push_back(observer);
+}
+
+// Bound on a coalesced list query, which runs on behalf of every caller that
+// joins it rather than under any one request's deadline
+//
+static const std::chrono::seconds kSharedListTimeout(30);
+
+QueryCoalescer*& ToDoService::ListCoalescer()
+{
+    static QueryCoalescer* coalescer = nullptr;
+    return coalescer;
+}
+
+void ToDoService::SetListCoalescer(QueryCoalescer* coalescer)
+{
+    ListCoalescer() = coalescer;
+}
+
+DueTimerWheel*& ToDoService::DueTimers()
+{
+    static DueTimerWheel* wheel = nullptr;
+    return wheel;
+}
+
+void ToDoService::SetDueTimers(DueTimerWheel* wheel)
+{
+    DueTimers() = wheel;
+}
+
+// Decodes a request body, booking the time to the parse stage. `error`
+// receives the message with its location.
+//
+bool ToDoService::DecodeItem(std::string_view body, ToDoItem& item, std::string& error)
+{
+    ScopedStage parse_stage(ctx_ != nullptr ? &ctx_->timings : nullptr, Stage::Parse);
+    DecodeError decode_error;
+    if (!ToDoDecoder::DecodeItem(body, item, decode_error)) 
+    {
+        error = decode_error.Describe();
+        return false;
+    }
+    return true;
+}
+
+bool ToDoService::DecodeUpdate(std::string_view body, ToDoUpdate& update, bool allow_ids, std::string& error)
+{
+    ScopedStage parse_stage(ctx_ != nullptr ? &ctx_->timings : nullptr, Stage::Parse);
+    DecodeError decode_error;
+    if (!ToDoDecoder::DecodeUpdate(body, update, allow_ids, decode_error)) 
     {
-        std::string name = body.at("name").as_string().c_str();
-        std::string description = (body.is_object() && body.as_object().count("description") > 0) ? body.at("description").as_string().c_str() : "";
-        std::string due_date_str = (body.is_object() && body.as_object().count("due_date") > 0) ? body.at("due_date").as_string().c_str() : "";
-        std::string status_str = (body.is_object() && body.as_object().count("status") > 0) ? body.at("status").as_string().c_str() : "Not Started";
-        std::string priority_str = (body.is_object() && body.as_object().count("priority") > 0) ? body.at("priority").as_string().c_str() : "3";
-        std::string tags_str = (body.is_object() && body.as_object().count("tags") > 0) ? body.at("tags").as_string().c_str() : "";
+        error = decode_error.Describe();
+        return false;
+    }
+    return true;
+}
 
-        if (status_str != "Not Started" && status_str != "In Progress" && status_str != "Completed") 
+bool ToDoService::CreateToDo(std::string_view body, std::string& out_id, std::string& error) 
+{
+    try 
+    {
+        ToDoItem item;
+        if (!DecodeItem(body, item, error)) 
         {
-            error = "Invalid status value";
             return false;
         }
 
         std::string new_id = generate_id();
-        ToDoItem item{new_id, name, description, due_date_str, status_str, stoi(priority_str), {}};
-
-        if (!tags_str.empty()) {
-            // Parse tags string into vector of strings
-            std::vector<std::string> tags;
-            size_t start = 0;
-            size_t end = 0;
-            while ((end = tags_str.find(',', start)) != std::string::npos) {
-                tags.push_back(tags_str.substr(start, end - start));
-                start = end + 1;
-            }
-            tags.push_back(tags_str.substr(start)); // Add the last tag
+        item.id = new_id;
 
-            item.tags = tags;
-        }
-
-        if (!pool_.CreateToDoItem(item)) 
+        ToDoItem created;
+        if (!pool_.CreateToDoItem(item, ctx_, &created)) 
         {
             error = "Failed to create ToDo item in database";
             return false;
         }
+        for (auto observer : Observers()) 
+        {
+            observer->OnCreated(created);
+        }
 
         out_id = new_id;
         return true;
@@ -51,136 +104,286 @@ bool ToDoService::CreateToDo(const boost::json::value& body, std::string& out_id
     }
 }
 
-bool ToDoService::GetAllToDos(
-    std::map<std::string, std::string> params,
-    boost::json::array& out_items,
+// Splits a comma-separated tag filter (?tags_all=, ?tags_any=) into a sorted
+// set, so that equivalent filters share a coalescing key
+//
+static bool ParseTagList(const std::string& key, const std::string& value, std::vector<std::string>& tags, std::string& error)
+{
+    size_t start = 0;
+    while (start <= value.size()) 
+    {
+        size_t end = value.find(',', start);
+        if (end == std::string::npos) end = value.size();
+        std::string tag = value.substr(start, end - start);
+        tag.erase(0, tag.find_first_not_of(' '));
+        tag.erase(tag.find_last_not_of(' ') + 1);
+        if (tag.empty() || tag.size() > ToDoDecoder::kMaxTagLength) 
+        {
+            error = key + " must be a comma-separated list of tags";
+            return false;
+        }
+        tags.push_back(tag);
+        start = end + 1;
+    }
+    std::sort(tags.begin(), tags.end());
+    tags.erase(std::unique(tags.begin(), tags.end()), tags.end());
+    if (tags.size() > ToDoDecoder::kMaxTags) 
+    {
+        error = key + " accepts at most " + std::to_string(ToDoDecoder::kMaxTags) + " tags";
+        return false;
+    }
+    return true;
+}
+
+bool ToDoService::ParseListParams(
+    std::map<std::string, std::string>& params,
+    ToDoFilter& filter,
+    std::optional<std::string>& sort_by,
+    std::optional<std::string>& sort_order,
     std::string& error
-) 
+)
 {
-    try 
+    if (params.count("status")) {
+        std::string s = params["status"];
+        if (s != "Not Started" && s != "In Progress" && s != "Completed") 
+        {
+            error = "Invalid status filter value";
+            return false;
+        }
+        filter.status = s;
+    }
+
+    if (params.count("due_date_after")) 
     {
-        std::optional<std::string> status_filter;
-        std::optional<std::string> due_after;
-        std::optional<std::string> due_before;
+        filter.due_date_after = params["due_date_after"];
+    }
+    if (params.count("due_date_before")) 
+    {
+        filter.due_date_before = params["due_date_before"];
+    }
 
-        std::optional<int> min_priority;
-        std::optional<int> max_priority;
-        std::optional<std::string> tag_contains;
+    if (params.count("min_priority")) 
+    {
+        try 
+        {
+            filter.min_priority = std::stoi(params["min_priority"]);
+            if (*filter.min_priority < 1 || *filter.min_priority > 5) 
+            {
+                error = "min_priority must be between 1 and 5";
+                return false;
+            }
+        } 
+        catch (...) 
+        {
+            error = "Invalid min_priority value";
+            return false;
+        }
+    }
 
-        if (params.count("status")) {
-            std::string s = params["status"];
-            if (s != "Not Started" && s != "In Progress" && s != "Completed") 
+    if (params.count("max_priority")) 
+    {
+        try 
+        {
+            filter.max_priority = std::stoi(params["max_priority"]);
+            if (*filter.max_priority < 1 || *filter.max_priority > 5) 
             {
-                error = "Invalid status filter value";
+                error = "max_priority must be between 1 and 5";
                 return false;
             }
-            status_filter = s;
+        } 
+        catch (...) 
+        {
+            error = "Invalid max_priority value";
+            return false;
+        }
+    }
+
+    if (params.count("tag")) 
+    {
+        filter.tag = params["tag"];
+    }
+
+    for (auto [key, tags] : {std::make_pair("tags_all", &filter.tags_all), std::make_pair("tags_any", &filter.tags_any)}) 
+    {
+        if (params.count(key) && !ParseTagList(key, params[key], *tags, error)) 
+        {
+            return false;
+        }
+    }
+
+    if (params.count("q")) 
+    {
+        std::string q = params["q"];
+        if (q.size() > 200) 
+        {
+            error = "q must be at most 200 characters";
+            return false;
         }
+        std::string query = build_prefix_tsquery(q);
+        if (query.empty()) 
+        {
+            error = "q must contain at least one word";
+            return false;
+        }
+        filter.search = query;
+    }
 
-        if (params.count("due_date_after")) 
+    if (params.count("sort")) 
+    {
+        std::string field = params["sort"];
+        if (field == "name" || field == "due_date" || field == "status" ||
+            field == "id" || field == "priority" || (field == "rank" && filter.search.has_value())) 
+        {
+            sort_by = field;
+        } 
+        else 
         {
-            due_after = params["due_date_after"];
+            error = "Invalid sort field. Allowed: name, due_date, status, id, priority, rank (with q)";
+            return false;
         }
-        if (params.count("due_date_before")) 
+    }
+
+    if (params.count("order")) 
+    {
+        std::string ord = params["order"];
+        if (ord == "asc" || ord == "desc") 
+        {
+            sort_order = ord;
+        } 
+        else 
+        {
+            error = "Invalid sort order. Use 'asc' or 'desc'";
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool ToDoService::GetAllToDos(
+    std::map<std::string, std::string> params,
+    std::shared_ptr<const std::string>& out_body,
+    std::string& error
+) 
+{
+    try 
+    {
+        ToDoFilter filter;
+        std::optional<std::string> sort_by;
+        std::optional<std::string> sort_order;
+
+        if (!ParseListParams(params, filter, sort_by, sort_order, error)) 
         {
-            due_before = params["due_date_before"];
+            return false;
         }
 
-        if (params.count("min_priority")) 
+        ToDoPage page;
+        if (params.count("limit")) 
         {
             try 
             {
-                min_priority = std::stoi(params["min_priority"]);
-                if (*min_priority < 1 || *min_priority > 5) 
+                page.limit = std::stoi(params["limit"]);
+                if (*page.limit < 1 || *page.limit > 1000) 
                 {
-                    error = "min_priority must be between 1 and 5";
+                    error = "limit must be between 1 and 1000";
                     return false;
                 }
             } 
             catch (...) 
             {
-                error = "Invalid min_priority value";
+                error = "Invalid limit value";
                 return false;
             }
         }
 
-        if (params.count("max_priority")) 
+        if (params.count("offset")) 
         {
             try 
             {
-                max_priority = std::stoi(params["max_priority"]);
-                if (*max_priority < 1 || *max_priority > 5) 
+                page.offset = std::stoi(params["offset"]);
+                if (*page.offset < 0) 
                 {
-                    error = "max_priority must be between 1 and 5";
+                    error = "offset must not be negative";
                     return false;
                 }
             } 
             catch (...) 
             {
-                error = "Invalid max_priority value";
+                error = "Invalid offset value";
                 return false;
             }
         }
 
-        if (params.count("tag")) 
+        ToDoFields fields;
+        if (params.count("fields") && !ToDoFields::Parse(params["fields"], fields, error)) 
         {
-            tag_contains = params["tag"];
+            return false;
         }
 
-        std::optional<std::string> sort_by;
-        std::optional<std::string> sort_order;
-
-        if (params.count("sort")) 
+        // Search results default to best match first
+        if (!sort_by.has_value()) 
         {
-            std::string field = params["sort"];
-            if (field == "name" || field == "due_date" || field == "status" ||
-                field == "id" || field == "priority") 
-            {
-                sort_by = field;
-            } 
-            else 
-            {
-                error = "Invalid sort field. Allowed: name, due_date, status, id, priority";
-                return false;
-            }
+            sort_by = filter.search.has_value() ? "rank" : "due_date";
         }
-
-        if (params.count("order")) 
+        if (!sort_order.has_value()) 
         {
-            std::string ord = params["order"];
-            if (ord == "asc" || ord == "desc") 
-            {
-                sort_order = ord;
-            } 
-            else 
+            sort_order = (*sort_by == "rank") ? "desc" : "asc";
+        }
+
+        auto load = [&](const RequestContext* query_ctx) -> QueryCoalescer::Result {
+            boost::json::array out_items;
+            bool dbResult = pool_.GetAllToDoItems(
+                out_items,
+                filter,
+                sort_by,
+                sort_order,
+                page,
+                fields,
+                query_ctx
+            );
+            if (!dbResult) 
             {
-                error = "Invalid sort order. Use 'asc' or 'desc'";
-                return false;
+                return nullptr;
             }
-        }
+            ScopedStage serialize_stage(query_ctx != nullptr ? &query_ctx->timings : nullptr, Stage::Serialize);
+            boost::json::object resp{{"todos", std::move(out_items)}};
+            return std::make_shared<const std::string>(boost::json::serialize(resp));
+        };
 
-        if (!sort_by.has_value()) 
+        QueryCoalescer* coalescer = ListCoalescer();
+        if (coalescer != nullptr) 
         {
-            sort_by = "due_date";
+            // Everything that shapes the result: the list, the normalized
+            // filter, ordering, page, projection and where the read may go
+            const std::string& list_id = ctx_ != nullptr && !ctx_->list_id.empty() ? ctx_->list_id : kDefaultListId;
+            bool primary = pool_.ReadNeedsPrimary(ctx_);
+            std::string key = list_id
+                + '|' + filter.Key()
+                + '|' + *sort_by + '|' + *sort_order
+                + '|' + (page.limit ? std::to_string(*page.limit) : "-")
+                + '|' + (page.offset ? std::to_string(*page.offset) : "-")
+                + '|' + std::to_string(fields.mask)
+                + '|' + (primary ? "primary" : "any");
+
+            // The shared execution belongs to no caller: it runs with its own
+            // bound instead of the leader's deadline and socket, and each
+            // caller only waits for it until its own deadline. The wait is
+            // booked to the caller's query stage.
+            ScopedStage query_stage(ctx_ != nullptr ? &ctx_->timings : nullptr, Stage::Query);
+            out_body = coalescer->Do(key, [&]() {
+                RequestContext shared;
+                shared.list_id = list_id;
+                shared.read_primary = primary;
+                shared.deadline = std::chrono::steady_clock::now() + kSharedListTimeout;
+                return load(&shared);
+            }, ctx_ != nullptr ? ctx_->deadline : std::chrono::steady_clock::time_point::max());
         }
-        if (!sort_order.has_value()) 
+        else 
         {
-            sort_order = "asc";
+            out_body = load(ctx_);
         }
 
-        bool dbResult = pool_.GetAllToDoItems(
-            out_items,
-            status_filter,
-            due_after,
-            due_before,
-            min_priority,
-            max_priority,
-            tag_contains,
-            sort_by,
-            sort_order
-        );
-
-        if (!dbResult) 
+        if (!out_body) 
         {
             error = "Failed to retrieve ToDo items from database";
             return false;
@@ -194,14 +397,35 @@ bool ToDoService::GetAllToDos(
     }
 }
 
-bool ToDoService::GetToDoById(const std::string& id, boost::json::object& out_item, std::string& error) 
+bool ToDoService::ExportToDos(
+    std::map<std::string, std::string> params,
+    const std::function<bool(std::string_view)>& on_line,
+    size_t& exported,
+    std::string& error
+)
 {
     try 
     {
-        bool dbResult = pool_.GetToDoItemById(id, out_item);
-        if (!dbResult) 
+        ToDoFilter filter;
+        std::optional<std::string> sort_by;
+        std::optional<std::string> sort_order;
+
+        if (!ParseListParams(params, filter, sort_by, sort_order, error)) 
         {
-            error = "Failed to retrieve ToDo item from database";
+            return false;
+        }
+
+        ToDoFields fields;
+        if (params.count("fields") && !ToDoFields::Parse(params["fields"], fields, error)) 
+        {
+            return false;
+        }
+
+        // Unlike the list endpoint, rows are only ordered when asked for, so a
+        // plain export can stream straight off the scan.
+        if (!pool_.ExportToDoItems(filter, on_line, exported, sort_by, sort_order, fields, ctx_)) 
+        {
+            error = "Failed to export ToDo items from database";
             return false;
         }
         return true;
@@ -213,66 +437,211 @@ bool ToDoService::GetToDoById(const std::string& id, boost::json::object& out_it
     }
 }
 
-bool ToDoService::UpdateToDo(const std::string& id, const boost::json::value& body, std::string& error) 
+bool ToDoService::ImportToDos(
+    const std::function<bool(std::string&)>& next_line,
+    size_t& imported,
+    std::string& error
+)
 {
     try 
     {
-        map<string, string> updates;
+        size_t line_no = 0;
+        std::string line;
+        std::string line_error;
+
+        auto next_item = [&](ToDoItem& item) {
+            while (next_line(line)) 
+            {
+                ++line_no;
+                if (line.find_first_not_of(" \t\r") == std::string::npos) 
+                {
+                    continue;  // blank line
+                }
+
+                ScopedStage parse_stage(ctx_ != nullptr ? &ctx_->timings : nullptr, Stage::Parse);
+                DecodeError decode_error;
+                item = ToDoItem{};
+                if (!ToDoDecoder::DecodeItem(line, item, decode_error)) 
+                {
+                    line_error = "Line " + std::to_string(line_no) + ", column " + std::to_string(decode_error.column) +
+                                 ": " + decode_error.message;
+                    throw std::runtime_error(line_error);
+                }
+                if (item.id.empty()) 
+                {
+                    item.id = generate_id();
+                }
+                return true;
+            }
+            return false;
+        };
 
-        if (body.is_object() && body.as_object().count("name") > 0)        
+        std::function<void(const std::vector<ToDoItem>&)> on_inserted;
+        if (!Observers().empty()) 
         {
-            updates["name"] = body.at("name").as_string().c_str();
+            on_inserted = [](const std::vector<ToDoItem>& batch) {
+                for (auto observer : Observers()) 
+                {
+                    observer->OnBulkImport(batch);
+                }
+            };
         }
-        if (body.is_object() && body.as_object().count("description") > 0) 
+        if (!pool_.ImportToDoItems(next_item, imported, on_inserted, ctx_)) 
         {
-            updates["description"] = body.at("description").as_string().c_str();
+            error = line_error.empty() ? "Failed to import ToDo items into database" : line_error;
+            return false;
         }
-        if (body.is_object() && body.as_object().count("due_date") > 0)
+        for (auto observer : Observers()) 
         {
-            updates["due_date"] = body.at("due_date").as_string().c_str();
+            observer->OnBulkImportCommitted();
         }
-        if (body.is_object() && body.as_object().count("status") > 0) 
+        return true;
+    } 
+    catch (const std::exception& e) 
+    {
+        error = e.what();
+        return false;
+    }
+}
+
+bool ToDoService::GetToDoById(const std::string& id, boost::json::object& out_item, std::string& error, const std::string& fields_param) 
+{
+    try 
+    {
+        ToDoFields fields;
+        if (!fields_param.empty() && !ToDoFields::Parse(fields_param, fields, error)) 
         {
-            string s = body.at("status").as_string().c_str();
-            if (s != "Not Started" && s != "In Progress" && s != "Completed")
-            {
-                throw runtime_error("Invalid status value");
-            }
-            updates["status"] = s;
+            return false;
         }
-        if (body.is_object() && body.as_object().count("priority") > 0) 
+
+        bool dbResult = pool_.GetToDoItemById(id, out_item, fields, ctx_);
+        if (!dbResult) 
         {
-            // Check if priority is between 1 and 5
-            //
-            string p_str = body.at("priority").as_string().c_str();
-            int p = stoi(p_str);
-            if (p < 1 || p > 5) 
-            {
-                throw runtime_error("Priority must be between 1 and 5");
-            }
-            updates["priority"] = body.at("priority").as_string().c_str();
+            error = "Failed to retrieve ToDo item from database";
+            return false;
+        }
+        return true;
+    } 
+    catch (const std::exception& e) 
+    {
+        error = e.what();
+        return false;
+    }
+}
+
+bool ToDoService::GetDueToDos(map<string, string> params, boost::json::object& out, std::string& error) 
+{
+    static const int64_t kMaxWithin = 366 * 86400;
+    DueTimerWheel* wheel = DueTimers();
+    if (wheel == nullptr) 
+    {
+        error = "Due-date scheduling is not enabled";
+        return false;
+    }
+
+    int64_t within = 86400;
+    if (params.count("within")) 
+    {
+        const std::string& text = params["within"];
+        size_t used = 0;
+        try 
+        {
+            within = std::stoll(text, &used);
+        } 
+        catch (...) 
+        {
+            used = 0;
         }
-        if (body.is_object() && body.as_object().count("tags") > 0) 
+        std::string unit = text.substr(used);
+        int64_t scale = unit.empty() || unit == "s" ? 1 : unit == "m" ? 60 : unit == "h" ? 3600 : unit == "d" ? 86400 : 0;
+        if (used == 0 || scale == 0 || within < 0 || within > kMaxWithin / scale) 
         {
-            if (!body.at("tags").is_string()) 
+            error = "within must be a duration of up to 366d, e.g. 3600, 90m, 12h or 7d";
+            return false;
+        }
+        within *= scale;
+    }
+
+    size_t limit = 100;
+    if (params.count("limit")) 
+    {
+        try 
+        {
+            int value = std::stoi(params["limit"]);
+            if (value < 1 || value > 1000) 
             {
-                throw runtime_error("Tags must be a comma-separated string");
+                error = "limit must be between 1 and 1000";
+                return false;
             }
-            updates["tags"] = "{" + std::string(body.at("tags").as_string().c_str()) + "}";
+            limit = static_cast<size_t>(value);
+        } 
+        catch (...) 
+        {
+            error = "Invalid limit value";
+            return false;
         }
+    }
+
+    int64_t now = time(nullptr);
+    size_t matched = 0;
+    const std::string& list_id = ctx_ != nullptr && !ctx_->list_id.empty() ? ctx_->list_id : kDefaultListId;
+    auto due = wheel->Due(list_id, within, limit, matched, now);
+
+    boost::json::array todos;
+    for (const auto& entry : due) 
+    {
+        boost::json::array tags;
+        for (const auto& tag : entry.item.tags) tags.emplace_back(boost::json::string_view(tag));
+        todos.emplace_back(boost::json::object{
+            {"id",          entry.item.id},
+            {"name",        entry.item.name},
+            {"description", entry.item.description},
+            {"due_date",    entry.item.due_date},
+            {"status",      entry.item.status},
+            {"priority",    entry.item.priority},
+            {"tags",        std::move(tags)},
+            {"overdue",     entry.overdue}
+        });
+    }
+    out = boost::json::object{
+        {"now",     format_timestamp(now)},
+        {"within",  within},
+        {"matched", matched},
+        {"todos",   std::move(todos)}
+    };
+    return true;
+}
 
-        if (updates.empty()) 
+bool ToDoService::UpdateToDo(const std::string& id, std::string_view body, std::string& error) 
+{
+    try 
+    {
+        ToDoUpdate update;
+        if (!DecodeUpdate(body, update, false, error)) 
+        {
+            return false;
+        }
+        if (update.Empty()) 
         {
             error = "No fields to update";
             return false;
         }
 
-        bool dbResult = pool_.UpdateToDoItem(id, updates);
+        ToDoItem before;
+        ToDoItem after;
+        bool dbResult = pool_.UpdateToDoItem(id, update.Columns(), ctx_, &before, &after);
         if (!dbResult)
         {
             error = "Failed to update ToDo item in database";
             return false;
         }
+        if (!before.id.empty()) 
+        {
+            for (auto observer : Observers()) 
+            {
+                observer->OnUpdated(before, after);
+            }
+        }
 
         return true;
     } 
@@ -283,16 +652,144 @@ bool ToDoService::UpdateToDo(const std::string& id, const boost::json::value& bo
     }
 }
 
+// Bulk operations select rows either by an "ids" array in the body (checked
+// by the decoder) or by the list filters in the query string. At least one of them is required so that
+// a bare request cannot touch the whole table.
+//
+bool ToDoService::ParseBulkSelector(
+    std::map<std::string, std::string>& params,
+    const std::vector<std::string>& ids,
+    ToDoFilter& filter,
+    std::string& error
+)
+{
+    std::optional<std::string> sort_by;
+    std::optional<std::string> sort_order;
+    if (!ParseListParams(params, filter, sort_by, sort_order, error)) 
+    {
+        return false;
+    }
+
+    if (!ids.empty() && !filter.Empty()) 
+    {
+        error = "Select items either by ids or by filters, not both";
+        return false;
+    }
+    if (ids.empty() && filter.Empty()) 
+    {
+        error = "Bulk operations need ids or at least one filter";
+        return false;
+    }
+    return true;
+}
+
+bool ToDoService::BulkUpdateToDos(
+    std::map<std::string, std::string> params,
+    std::string_view body,
+    size_t& affected,
+    std::string& error
+)
+{
+    try 
+    {
+        ToDoUpdate update;
+        if (!DecodeUpdate(body, update, true, error)) 
+        {
+            return false;
+        }
+        const std::vector<std::string> ids = update.ids.value_or(std::vector<std::string>{});
+        ToDoFilter filter;
+        if (!ParseBulkSelector(params, ids, filter, error)) 
+        {
+            return false;
+        }
+        if (update.Empty()) 
+        {
+            error = "No fields to update";
+            return false;
+        }
+
+        std::vector<std::pair<ToDoItem, ToDoItem>> images;
+        if (!pool_.UpdateToDoItems(ids, filter, update.Columns(), affected, ctx_, &images)) 
+        {
+            error = "Failed to update ToDo items in database";
+            return false;
+        }
+        for (const auto& [before, after] : images) 
+        {
+            for (auto observer : Observers()) 
+            {
+                observer->OnUpdated(before, after);
+            }
+        }
+        return true;
+    } 
+    catch (const std::exception& e) 
+    {
+        error = e.what();
+        return false;
+    }
+}
+
+bool ToDoService::BulkDeleteToDos(
+    std::map<std::string, std::string> params,
+    std::string_view body,
+    size_t& affected,
+    std::string& error
+)
+{
+    try 
+    {
+        // Only the selector is read from the body
+        ToDoUpdate selector;
+        if (!DecodeUpdate(body, selector, true, error)) 
+        {
+            return false;
+        }
+        const std::vector<std::string> ids = selector.ids.value_or(std::vector<std::string>{});
+        ToDoFilter filter;
+        if (!ParseBulkSelector(params, ids, filter, error)) 
+        {
+            return false;
+        }
+
+        std::vector<ToDoItem> deleted;
+        if (!pool_.DeleteToDoItems(ids, filter, affected, ctx_, &deleted)) 
+        {
+            error = "Failed to delete ToDo items from database";
+            return false;
+        }
+        for (const auto& item : deleted) 
+        {
+            for (auto observer : Observers()) 
+            {
+                observer->OnDeleted(item);
+            }
+        }
+        return true;
+    } 
+    catch (const std::exception& e) 
+    {
+        error = e.what();
+        return false;
+    }
+}
+
 bool ToDoService::DeleteToDo(const std::string& id, std::string& error) 
 {
     try 
     {
-        bool dbResult = pool_.DeleteToDoItem(id);
+        ToDoItem deleted;
+        bool dbResult = pool_.DeleteToDoItem(id, ctx_, &deleted);
         if (!dbResult)
         {
             error = "Failed to delete ToDo item from database";
             return false;
         }
+        for (auto observer : Observers()) 
+        {
+            observer->OnDeleted(deleted);
+        }
         return true;
     } 
     catch (const std::exception& e) 
@@ -5,25 +5,80 @@
 #include <string>
 #include <map>
 #include <optional>
+#include <functional>
+#include <string_view>
+#include <memory>
 #include "DbAccess.hpp"  // PgPool + ToDoItem
+#include "ToDoDecoder.hpp"
+#include "RequestContext.hpp"
+#include "ToDoObserver.hpp"
+#include "QueryCoalescer.hpp"
+#include "DueTimerWheel.hpp"
 
 class ToDoService 
 {
 public:
-    explicit ToDoService(PgPool& pool) : pool_(pool) {}
+    explicit ToDoService(PgPool& pool, const RequestContext* ctx = nullptr) : pool_(pool), ctx_(ctx) {}
 
-    bool CreateToDo(const boost::json::value& body, std::string& out_id, std::string& error);
+    // Registers a process-wide mutation observer. Call at startup, before
+    // requests are served; observers must outlive every ToDoService.
+    static void AddObserver(ToDoObserver* observer);
 
-    bool GetAllToDos(map<string, string> params, boost::json::array& out_items, std::string& error);
+    // Lets identical concurrent GET /todos queries share one execution. Set at
+    // startup like the observers; the coalescer must also be registered as an
+    // observer so that writes invalidate it.
+    static void SetListCoalescer(QueryCoalescer* coalescer);
 
-    bool GetToDoById(const std::string& id, boost::json::object& out_item, std::string& error);
+    // Answers GET /todos/due from memory. Set at startup; the wheel must also
+    // be registered as an observer so that writes reschedule it.
+    static void SetDueTimers(DueTimerWheel* wheel);
 
-    bool UpdateToDo(const std::string& id, const boost::json::value& body, std::string& error);
+    // Bodies are raw request JSON, decoded in one pass without a DOM
+    bool CreateToDo(std::string_view body, std::string& out_id, std::string& error);
+
+    // `out_body` receives the serialized {"todos": [...]} response; it may be
+    // shared with concurrent identical requests
+    bool GetAllToDos(map<string, string> params, std::shared_ptr<const std::string>& out_body, std::string& error);
+
+    // `fields` is an optional comma-separated projection, as in ?fields=
+    bool GetToDoById(const std::string& id, boost::json::object& out_item, std::string& error, const std::string& fields = "");
+
+    // Open items that are overdue or due within ?within= (seconds, or with an
+    // s/m/h/d suffix; default 1d), earliest first, up to ?limit=
+    bool GetDueToDos(map<string, string> params, boost::json::object& out, std::string& error);
+
+    bool UpdateToDo(const std::string& id, std::string_view body, std::string& error);
 
     bool DeleteToDo(const std::string& id, std::string& error);
 
+    // Bulk PATCH/DELETE: rows are selected by an "ids" array in the body or by
+    // the list filters in `params`; everything runs in one transaction.
+    bool BulkUpdateToDos(map<string, string> params, std::string_view body, size_t& affected, std::string& error);
+
+    bool BulkDeleteToDos(map<string, string> params, std::string_view body, size_t& affected, std::string& error);
+
+    // NDJSON bulk transfer: one JSON document per line, streamed in constant memory
+    bool ExportToDos(map<string, string> params, const std::function<bool(std::string_view)>& on_line, size_t& exported, std::string& error);
+
+    bool ImportToDos(const std::function<bool(std::string&)>& next_line, size_t& imported, std::string& error);
+
 private:
+    static std::vector<ToDoObserver*>& Observers();
+
+    static QueryCoalescer*& ListCoalescer();
+
+    static DueTimerWheel*& DueTimers();
+
+    bool ParseListParams(map<string, string>& params, ToDoFilter& filter, std::optional<std::string>& sort_by, std::optional<std::string>& sort_order, std::string& error);
+
+    bool ParseBulkSelector(map<string, string>& params, const std::vector<std::string>& ids, ToDoFilter& filter, std::string& error);
+
+    bool DecodeItem(std::string_view body, ToDoItem& item, std::string& error);
+
+    bool DecodeUpdate(std::string_view body, ToDoUpdate& update, bool allow_ids, std::string& error);
+
     PgPool& pool_;
+    const RequestContext* ctx_;
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,763 @@
+#ifndef TODO_SNAPSHOT_HPP
+#define TODO_SNAPSHOT_HPP
+
+#include <boost/json.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <functional>
+#include <iostream>
+#include <limits>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "DbAccess.hpp"
+#include "FileIO.hpp"
+#include "Utility.hpp"
+
+using namespace std;
+
+// Image of ToDoItems kept in a columnar snapshot file, so a restarted
+// instance can warm its read structures (ToDoStats) from the file and a
+// catch-up query instead of a full table read.
+//
+// Every row carries the version the database gave it on its last insert or
+// update (todoitems_version_seq, see create_db.sql); deletes leave a tombstone
+// with a version of their own. The watermark is the version up to which the
+// image is known to be complete, and CatchUp() reads what changed above it.
+//
+// Versions are drawn when a row is written but only become visible at
+// commit, so rows above the watermark can still show up below the highest
+// version seen. Each scan records a VersionFence; the watermark moves up to
+// it once a later scan finds every transaction the fence waited on finished.
+// A long transaction holds the watermark back (and makes catch-ups reread
+// more) rather than having its rows missed; "pending_fence_version" and
+// "unsettled_catch_ups" in Metrics() show when that happens.
+//
+// The loaded file stays mapped and is read in place; rows changed since then
+// sit in a small overlay ordered like the file, and ForEach() merges the two.
+// Save() serves the merged image from memory while it writes it (Windows
+// will not replace a mapped file), then maps the new file as the base.
+//
+// File layout (integers in host byte order, like the mutation log):
+//
+//     header   = magic "TODOSNP2" | u32 rows | u32 section count | u64 watermark
+//                | i64 written unix_ms | u32 crc32(sections) | u32 reserved
+//                | u64 pending fence version | u64 pending fence xmax (0: none)
+//                | u64 offsets[section count + 1]   (section i: [offsets[i], offsets[i+1]))
+//     versions      u64 per row
+//     lists         u32 per row, code into the list dictionary
+//     statuses      u8 per row, code into the status dictionary
+//     priorities    u8 per row
+//     due_dates     i64 Unix seconds per row, kNoDueDate when unset
+//     ids, names, descriptions          string columns
+//     tag_offsets   u32 per row + 1: the row's range in tag_codes
+//     tag_codes     u32 per tag, code into the tag dictionary
+//     list, status and tag dictionaries string columns
+//     string column = u32 count | u32 offsets[count + 1] | bytes
+//
+// Rows are sorted by list_id + '/' + id and sections start 8-byte aligned.
+// Due dates are kept to the second.
+//
+class ToDoSnapshot
+{
+public:
+    using ItemSink = function<void(const ToDoItem&, uint64_t version)>;
+    using DeleteSink = function<void(const string& list_id, const string& id, uint64_t version)>;
+
+    // Reads the rows and tombstones above `since` into the sinks, filling in
+    // the fence before taking the snapshot they are read from
+    using ChangeScan = function<bool(uint64_t since, const ItemSink&, const DeleteSink&, VersionFence&)>;
+
+    static constexpr int64_t kNoDueDate = numeric_limits<int64_t>::min();
+
+    ToDoSnapshot() = default;
+    ToDoSnapshot(const ToDoSnapshot&) = delete;
+    ToDoSnapshot& operator=(const ToDoSnapshot&) = delete;
+
+    // Replaces the image with the snapshot at `path`. Returns false, leaving
+    // the image as it was, when the file is missing, of another format or
+    // corrupt.
+    //
+    bool Load(const string& path)
+    {
+        auto started = chrono::steady_clock::now();
+        auto base = Map(path);
+        if (!base)
+        {
+            return false;
+        }
+
+        lock_guard<mutex> lock(mtx_);
+        watermark_ = base->watermark;
+        pending_fence_ = base->pending_fence;
+        base_ = move(base);
+        overlay_.clear();
+        load_ms_ = chrono::duration<double, milli>(chrono::steady_clock::now() - started).count();
+        return true;
+    }
+
+    // Applies what changed in the database since the watermark; on an empty
+    // image that is the whole table. CatchUp() and Save() are meant to be
+    // called from one thread at a time.
+    //
+    bool CatchUp(PgPool& pool)
+    {
+        return CatchUp([&pool](uint64_t since, const ItemSink& on_item, const DeleteSink& on_deleted, VersionFence& fence) {
+            return pool.ScanToDoItemsSince(since, on_item, on_deleted, fence);
+        });
+    }
+
+    // Rows between the watermark and the highest version seen are read
+    // again; applying a row again is a no-op
+    //
+    bool CatchUp(const ChangeScan& scan)
+    {
+        uint64_t since = Watermark();
+
+        // Rows arrive in no particular order, so the watermark only moves
+        // once the whole scan has gone through
+        VersionFence fence;
+        uint64_t seen = 0;
+        size_t applied = 0;
+        size_t deleted = 0;
+        bool ok = scan(since,
+            [&](const ToDoItem& item, uint64_t version) {
+                seen = max(seen, version);
+                applied += Apply(item, version);
+            },
+            [&](const string& list_id, const string& id, uint64_t version) {
+                seen = max(seen, version);
+                deleted += ApplyDelete(list_id, id, version);
+            },
+            fence);
+
+        lock_guard<mutex> lock(mtx_);
+        caught_up_rows_ += applied;
+        caught_up_deletes_ += deleted;
+        if (!ok)
+        {
+            return false;
+        }
+        highest_version_ = max(highest_version_, seen);
+
+        // The fence was taken before this scan's snapshot, so a fence whose
+        // transactions had all finished by then is covered by the scan. One
+        // with nothing running covers itself.
+        if (pending_fence_ && pending_fence_->xmax <= fence.xmin)
+        {
+            watermark_ = max(watermark_, pending_fence_->version);
+            pending_fence_.reset();
+            unsettled_catch_ups_ = 0;
+        }
+        else if (pending_fence_)
+        {
+            ++unsettled_catch_ups_;
+        }
+        if (fence.xmax <= fence.xmin)
+        {
+            watermark_ = max(watermark_, fence.version);
+            pending_fence_.reset();
+        }
+        else if (!pending_fence_)
+        {
+            pending_fence_ = fence;
+        }
+        return true;
+    }
+
+    // Writes the image to `path` through a temporary file and a rename, so
+    // readers see the old or the new snapshot, never a partial one, then
+    // serves from the new file
+    //
+    bool Save(const string& path)
+    {
+        shared_ptr<const string> data;
+        const Base* image = nullptr;
+        unique_ptr<Base> previous;
+        {
+            lock_guard<mutex> lock(mtx_);
+            data = make_shared<const string>(Encode());
+            auto base = FromBytes(data);
+            if (!base)
+            {
+                cerr << "Encoded snapshot failed validation; not writing " << path << "\n";
+                ++save_errors_;
+                return false;
+            }
+            image = base.get();
+            previous = move(base_);
+            base_ = move(base);
+            overlay_.clear();
+        }
+        previous.reset();   // drops the mapping of the file being replaced
+
+        if (!WriteFileAtomically(path, *data))
+        {
+            cerr << "Writing snapshot " << path << " failed: " << LastFileError() << "\n";
+            lock_guard<mutex> lock(mtx_);
+            ++save_errors_;
+            return false;
+        }
+
+        // Same rows as the in-memory image, so the overlay stays valid
+        auto base = Map(path);
+        lock_guard<mutex> lock(mtx_);
+        ++saves_;
+        saved_bytes_ = data->size();
+        if (base && base_.get() == image)
+        {
+            base_ = move(base);
+        }
+        return true;
+    }
+
+    void ForEach(const function<void(const ToDoItem&)>& on_item) const
+    {
+        lock_guard<mutex> lock(mtx_);
+        Merge([&](const ToDoItem& item, uint64_t) { on_item(item); });
+    }
+
+    uint64_t Watermark() const
+    {
+        lock_guard<mutex> lock(mtx_);
+        return watermark_;
+    }
+
+    size_t Size() const
+    {
+        lock_guard<mutex> lock(mtx_);
+        size_t count = 0;
+        Merge([&](const ToDoItem&, uint64_t) { ++count; });
+        return count;
+    }
+
+    boost::json::object Metrics() const
+    {
+        lock_guard<mutex> lock(mtx_);
+        return {
+            {"base_rows",             base_ ? base_->rows : 0},
+            {"overlay_rows",          overlay_.size()},
+            {"watermark",             watermark_},
+            {"highest_version",       highest_version_},
+            {"pending_fence_version", pending_fence_ ? pending_fence_->version : 0},
+            {"unsettled_catch_ups",   unsettled_catch_ups_},
+            {"load_ms",               load_ms_},
+            {"caught_up_rows",        caught_up_rows_},
+            {"caught_up_deletes",     caught_up_deletes_},
+            {"saves",                 saves_},
+            {"save_errors",           save_errors_},
+            {"file_bytes",            saved_bytes_}
+        };
+    }
+
+private:
+    enum Section : uint32_t
+    {
+        Versions, Lists, Statuses, Priorities, DueDates, Ids, Names, Descriptions,
+        TagOffsets, TagCodes, ListDictionary, StatusDictionary, TagDictionary, SectionCount
+    };
+
+    struct Header
+    {
+        char magic[8];
+        uint32_t rows;
+        uint32_t sections;
+        uint64_t watermark;
+        int64_t written_unix_ms;
+        uint32_t crc;
+        uint32_t reserved;
+        uint64_t fence_version;
+        uint64_t fence_xmax;
+        uint64_t offsets[SectionCount + 1];
+    };
+
+    static constexpr char kMagic[8] = {'T', 'O', 'D', 'O', 'S', 'N', 'P', '2'};
+
+    // A row changed since the base was written; `deleted` rows keep the
+    // tombstone version so older images of the item are not taken back
+    //
+    struct Row
+    {
+        uint64_t version = 0;
+        bool deleted = false;
+        ToDoItem item;
+    };
+
+    // Section contents read in place; Map() has checked every bound
+    //
+    struct SectionView
+    {
+        const char* data = nullptr;
+        size_t size = 0;
+
+        template <class T>
+        size_t Count() const { return size / sizeof(T); }
+
+        template <class T>
+        T At(size_t index) const
+        {
+            T value;
+            memcpy(&value, data + index * sizeof(T), sizeof(T));
+            return value;
+        }
+    };
+
+    struct StringColumn
+    {
+        SectionView offsets;
+        const char* bytes = nullptr;
+        uint32_t count = 0;
+
+        // Checks the layout and that the offsets ascend within the bytes
+        //
+        bool Init(const SectionView& section)
+        {
+            if (section.size < 4)
+            {
+                return false;
+            }
+            count = section.At<uint32_t>(0);
+            if ((section.size - 4) / 4 < static_cast<size_t>(count) + 1)
+            {
+                return false;
+            }
+            offsets = SectionView{section.data + 4, (static_cast<size_t>(count) + 1) * 4};
+            bytes = offsets.data + offsets.size;
+            size_t bytes_size = section.size - 4 - offsets.size;
+            uint32_t previous = 0;
+            for (uint32_t i = 0; i <= count; ++i)
+            {
+                uint32_t offset = offsets.At<uint32_t>(i);
+                if (offset < previous || offset > bytes_size) return false;
+                previous = offset;
+            }
+            return offsets.At<uint32_t>(0) == 0;
+        }
+
+        string_view Get(uint32_t index) const
+        {
+            uint32_t begin = offsets.At<uint32_t>(index);
+            return string_view(bytes + begin, offsets.At<uint32_t>(index + 1) - begin);
+        }
+    };
+
+    // A validated snapshot image: a mapped file, or the bytes Save() is
+    // writing out
+    //
+    struct Base
+    {
+        unique_ptr<MappedFile> file;
+        shared_ptr<const string> bytes;
+        const char* data = nullptr;
+        size_t size = 0;
+        uint32_t rows = 0;
+        uint64_t watermark = 0;
+        optional<VersionFence> pending_fence;
+        SectionView sections[SectionCount];
+        StringColumn ids, names, descriptions;
+        vector<string> lists, statuses, tags;
+
+        string Key(uint32_t row) const
+        {
+            return ToDoSnapshot::Key(lists[sections[Lists].At<uint32_t>(row)], ids.Get(row));
+        }
+
+        uint64_t Version(uint32_t row) const
+        {
+            return sections[Versions].At<uint64_t>(row);
+        }
+
+        // Fills `item`, reusing its buffers
+        //
+        void Decode(uint32_t row, ToDoItem& item) const
+        {
+            item.list_id = lists[sections[Lists].At<uint32_t>(row)];
+            item.id = ids.Get(row);
+            item.name = names.Get(row);
+            item.description = descriptions.Get(row);
+            item.status = statuses[sections[Statuses].At<uint8_t>(row)];
+            item.priority = sections[Priorities].At<uint8_t>(row);
+            int64_t due = sections[DueDates].At<int64_t>(row);
+            item.due_date = due == kNoDueDate ? "" : format_timestamp(due);
+            uint32_t tag_begin = sections[TagOffsets].At<uint32_t>(row);
+            uint32_t tag_end = sections[TagOffsets].At<uint32_t>(row + 1);
+            item.tags.resize(tag_end - tag_begin);
+            for (uint32_t t = tag_begin; t < tag_end; ++t)
+            {
+                item.tags[t - tag_begin] = tags[sections[TagCodes].At<uint32_t>(t)];
+            }
+        }
+
+        // Binary search over the sorted rows; rows when `key` is absent
+        //
+        uint32_t Find(const string& key) const
+        {
+            uint32_t lo = 0, hi = rows;
+            while (lo < hi)
+            {
+                uint32_t mid = lo + (hi - lo) / 2;
+                int cmp = Key(mid).compare(key);
+                if (cmp == 0) return mid;
+                if (cmp < 0) lo = mid + 1;
+                else hi = mid;
+            }
+            return rows;
+        }
+    };
+
+    static string Key(string_view list_id, string_view id)
+    {
+        string key;
+        key.reserve(list_id.size() + 1 + id.size());
+        key.append(list_id).append(1, '/').append(id);
+        return key;
+    }
+
+    // Maps and validates `path`: checksum, section sizes against the row
+    // count and every dictionary code, so rows can be decoded unchecked
+    //
+    static unique_ptr<Base> Map(const string& path)
+    {
+        auto base = make_unique<Base>();
+        base->file = MappedFile::Open(path);
+        if (!base->file)
+        {
+            return nullptr;
+        }
+        base->data = base->file->data();
+        base->size = base->file->size();
+        if (!Validate(*base))
+        {
+            cerr << "Ignoring unreadable snapshot " << path << "\n";
+            return nullptr;
+        }
+        return base;
+    }
+
+    // The same over an encoded image held in memory
+    //
+    static unique_ptr<Base> FromBytes(shared_ptr<const string> bytes)
+    {
+        auto base = make_unique<Base>();
+        base->data = bytes->data();
+        base->size = bytes->size();
+        base->bytes = move(bytes);
+        if (!Validate(*base))
+        {
+            return nullptr;
+        }
+        return base;
+    }
+
+    static bool Validate(Base& base)
+    {
+        if (base.size < sizeof(Header))
+        {
+            return false;
+        }
+        const char* data = base.data;
+        Header header;
+        memcpy(&header, data, sizeof(Header));
+        if (memcmp(header.magic, kMagic, sizeof(kMagic)) != 0 || header.sections != SectionCount)
+        {
+            return false;
+        }
+        for (uint32_t i = 0; i < SectionCount; ++i)
+        {
+            uint64_t begin = header.offsets[i], end = header.offsets[i + 1];
+            if (begin < sizeof(Header) || begin > end || end > base.size)
+            {
+                return false;
+            }
+            base.sections[i] = SectionView{data + begin, static_cast<size_t>(end - begin)};
+        }
+        const uint64_t end = header.offsets[SectionCount];
+        if (crc32(data + sizeof(Header), end - sizeof(Header)) != header.crc)
+        {
+            return false;
+        }
+
+        const size_t rows = header.rows;
+        const auto* s = base.sections;
+        StringColumn list_column, status_column, tag_column;
+        if (s[Versions].Count<uint64_t>() < rows || s[Lists].Count<uint32_t>() < rows
+            || s[Statuses].Count<uint8_t>() < rows || s[Priorities].Count<uint8_t>() < rows
+            || s[DueDates].Count<int64_t>() < rows || s[TagOffsets].Count<uint32_t>() < rows + 1
+            || !base.ids.Init(s[Ids]) || base.ids.count != rows
+            || !base.names.Init(s[Names]) || base.names.count != rows
+            || !base.descriptions.Init(s[Descriptions]) || base.descriptions.count != rows
+            || !list_column.Init(s[ListDictionary]) || !status_column.Init(s[StatusDictionary])
+            || !tag_column.Init(s[TagDictionary]))
+        {
+            return false;
+        }
+        for (uint32_t i = 0; i < list_column.count; ++i) base.lists.emplace_back(list_column.Get(i));
+        for (uint32_t i = 0; i < status_column.count; ++i) base.statuses.emplace_back(status_column.Get(i));
+        for (uint32_t i = 0; i < tag_column.count; ++i) base.tags.emplace_back(tag_column.Get(i));
+
+        uint32_t previous_tag = 0;
+        for (size_t r = 0; r < rows; ++r)
+        {
+            uint32_t tag_begin = s[TagOffsets].At<uint32_t>(r);
+            if (s[Lists].At<uint32_t>(r) >= base.lists.size() || s[Statuses].At<uint8_t>(r) >= base.statuses.size()
+                || tag_begin < previous_tag)
+            {
+                return false;
+            }
+            previous_tag = tag_begin;
+        }
+        uint32_t tag_count = s[TagOffsets].At<uint32_t>(rows);
+        if (tag_count < previous_tag || s[TagCodes].Count<uint32_t>() < tag_count)
+        {
+            return false;
+        }
+        for (uint32_t t = 0; t < tag_count; ++t)
+        {
+            if (s[TagCodes].At<uint32_t>(t) >= base.tags.size()) return false;
+        }
+
+        base.rows = header.rows;
+        base.watermark = header.watermark;
+        if (header.fence_xmax != 0)
+        {
+            base.pending_fence = VersionFence{header.fence_version, 0, header.fence_xmax};
+        }
+        return true;
+    }
+
+    // Latest known state of `key`: false when neither the overlay nor the
+    // base has it, otherwise its version and whether it is deleted. Caller
+    // holds mtx_.
+    //
+    bool Current(const string& key, uint64_t& version, bool& deleted) const
+    {
+        auto it = overlay_.find(key);
+        if (it != overlay_.end())
+        {
+            version = it->second.version;
+            deleted = it->second.deleted;
+            return true;
+        }
+        if (base_)
+        {
+            uint32_t row = base_->Find(key);
+            if (row < base_->rows)
+            {
+                version = base_->Version(row);
+                deleted = false;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Keeps the newer of the stored and the given image
+    //
+    bool Apply(const ToDoItem& item, uint64_t version)
+    {
+        string key = Key(item.list_id, item.id);
+        lock_guard<mutex> lock(mtx_);
+        uint64_t current = 0;
+        bool deleted = false;
+        if (Current(key, current, deleted) && current >= version)
+        {
+            return false;
+        }
+        Row& row = overlay_[move(key)];
+        row = Row{version, false, item};
+        row.item.version = version;
+        return true;
+    }
+
+    bool ApplyDelete(const string& list_id, const string& id, uint64_t version)
+    {
+        string key = Key(list_id, id);
+        lock_guard<mutex> lock(mtx_);
+        uint64_t current = 0;
+        bool deleted = false;
+        if (!Current(key, current, deleted) || deleted || current >= version)
+        {
+            return false;
+        }
+        overlay_[move(key)] = Row{version, true, {}};
+        return true;
+    }
+
+    // Visits the live rows in key order: the base, with rows the overlay
+    // replaces or deletes swapped for the overlay's. Caller holds mtx_.
+    //
+    void Merge(const ItemSink& on_item) const
+    {
+        const uint32_t rows = base_ ? base_->rows : 0;
+        ToDoItem item;
+        auto next = overlay_.begin();
+        string key;
+        for (uint32_t r = 0; r < rows; ++r)
+        {
+            if (next != overlay_.end())
+            {
+                key = base_->Key(r);
+                for (; next != overlay_.end() && next->first < key; ++next)
+                {
+                    if (!next->second.deleted) on_item(next->second.item, next->second.version);
+                }
+                if (next != overlay_.end() && next->first == key)
+                {
+                    if (!next->second.deleted) on_item(next->second.item, next->second.version);
+                    ++next;
+                    continue;
+                }
+            }
+            base_->Decode(r, item);
+            item.version = base_->Version(r);
+            on_item(item, item.version);
+        }
+        for (; next != overlay_.end(); ++next)
+        {
+            if (!next->second.deleted) on_item(next->second.item, next->second.version);
+        }
+    }
+
+    // Assigns dense codes to repeated strings (lists, statuses, tags)
+    //
+    struct Dictionary
+    {
+        unordered_map<string, uint32_t> codes;
+        vector<string_view> values;
+
+        uint32_t Code(const string& value)
+        {
+            auto [it, added] = codes.emplace(value, static_cast<uint32_t>(values.size()));
+            if (added) values.push_back(it->first);
+            return it->second;
+        }
+    };
+
+    // Builds a string column one value at a time
+    //
+    struct StringColumnWriter
+    {
+        string offsets;
+        string bytes;
+        uint32_t count = 0;
+
+        StringColumnWriter() { Put(offsets, uint32_t{0}); }
+
+        void Add(string_view value)
+        {
+            bytes.append(value);
+            Put(offsets, static_cast<uint32_t>(bytes.size()));
+            ++count;
+        }
+
+        void WriteTo(string& out) const
+        {
+            Put(out, count);
+            out += offsets;
+            out += bytes;
+        }
+    };
+
+    template <class T>
+    static void Put(string& out, T value)
+    {
+        out.append(reinterpret_cast<const char*>(&value), sizeof(T));
+    }
+
+    // Caller holds mtx_
+    //
+    string Encode() const
+    {
+        vector<string> sections(SectionCount);
+        Dictionary lists, statuses, tags;
+        StringColumnWriter ids, names, descriptions;
+
+        uint32_t count = 0;
+        uint32_t tag_count = 0;
+        Put(sections[TagOffsets], tag_count);
+        Merge([&](const ToDoItem& item, uint64_t version) {
+            Put(sections[Versions], version);
+            Put(sections[Lists], lists.Code(item.list_id));
+            Put(sections[Statuses], static_cast<uint8_t>(statuses.Code(item.status)));
+            Put(sections[Priorities], static_cast<uint8_t>(item.priority));
+
+            int64_t due = kNoDueDate;
+            if (!item.due_date.empty() && !parse_timestamp(item.due_date, due))
+            {
+                due = kNoDueDate;
+            }
+            Put(sections[DueDates], due);
+
+            ids.Add(item.id);
+            names.Add(item.name);
+            descriptions.Add(item.description);
+
+            for (const auto& tag : item.tags)
+            {
+                Put(sections[TagCodes], tags.Code(tag));
+            }
+            tag_count += static_cast<uint32_t>(item.tags.size());
+            Put(sections[TagOffsets], tag_count);
+            ++count;
+        });
+
+        ids.WriteTo(sections[Ids]);
+        names.WriteTo(sections[Names]);
+        descriptions.WriteTo(sections[Descriptions]);
+        StringColumnWriter list_column, status_column, tag_column;
+        for (auto value : lists.values) list_column.Add(value);
+        for (auto value : statuses.values) status_column.Add(value);
+        for (auto value : tags.values) tag_column.Add(value);
+        list_column.WriteTo(sections[ListDictionary]);
+        status_column.WriteTo(sections[StatusDictionary]);
+        tag_column.WriteTo(sections[TagDictionary]);
+
+        Header header{};
+        memcpy(header.magic, kMagic, sizeof(kMagic));
+        header.rows = count;
+        header.sections = SectionCount;
+        header.watermark = watermark_;
+        header.fence_version = pending_fence_ ? pending_fence_->version : 0;
+        header.fence_xmax = pending_fence_ ? pending_fence_->xmax : 0;
+        header.written_unix_ms = chrono::duration_cast<chrono::milliseconds>(
+            chrono::system_clock::now().time_since_epoch()).count();
+
+        string out(sizeof(Header), '\0');
+        for (uint32_t i = 0; i < SectionCount; ++i)
+        {
+            out.append((8 - out.size() % 8) % 8, '\0');
+            header.offsets[i] = out.size();
+            out += sections[i];
+        }
+        header.offsets[SectionCount] = out.size();
+        header.crc = crc32(out.data() + sizeof(Header), out.size() - sizeof(Header));
+        memcpy(&out[0], &header, sizeof(Header));
+        return out;
+    }
+
+    mutable mutex mtx_;
+    unique_ptr<Base> base_;
+    map<string, Row> overlay_;
+    uint64_t watermark_ = 0;
+    uint64_t highest_version_ = 0;
+    optional<VersionFence> pending_fence_;
+    size_t unsettled_catch_ups_ = 0;
+
+    double load_ms_ = 0;
+    size_t caught_up_rows_ = 0;
+    size_t caught_up_deletes_ = 0;
+    size_t saves_ = 0;
+    size_t save_errors_ = 0;
+    size_t saved_bytes_ = 0;
+};
+
+#endif
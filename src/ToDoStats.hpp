@@ -0,0 +1,235 @@
+#ifndef TODO_STATS_HPP
+#define TODO_STATS_HPP
+
+#include <boost/json.hpp>
+
+#include <ctime>
+#include <functional>
+#include <limits>
+#include <map>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "DbAccess.hpp"
+#include "ToDoObserver.hpp"
+#include "Utility.hpp"
+
+using namespace std;
+
+// In-memory aggregate counters behind GET /todos/stats and its list-scoped
+// form GET /lists/{listId}/todos/stats.
+//
+// Built with one scan at startup and then kept current by the ToDoService
+// mutation hooks, so a stats query never touches the database. Overdue items
+// (open, due before now) are tracked with a watermark: open items due after it
+// sit in a map keyed by due time and move into the overdue count as the
+// watermark advances, so each item is moved at most once. Every list keeps
+// its own counters next to the table-wide ones; a list's are dropped when its
+// last item goes.
+//
+class ToDoStats : public ToDoObserver
+{
+public:
+    // Hands every item to the callback; false when the scan failed
+    using ItemScan = function<bool(const function<void(const ToDoItem&)>&)>;
+
+    // Replaces the counters with a fresh scan of the table
+    //
+    bool Load(PgPool& pool, int64_t now = time(nullptr))
+    {
+        return Load([&pool](const function<void(const ToDoItem&)>& on_item) { return pool.ScanToDoItems(on_item); },
+                    now);
+    }
+
+    // Replaces the counters with the items `scan` yields, e.g. from a snapshot
+    //
+    bool Load(const ItemScan& scan, int64_t now = time(nullptr))
+    {
+        ToDoStats fresh;
+        fresh.all_.watermark = now;
+        if (!scan([&](const ToDoItem& item) { fresh.Apply(item, +1); })) 
+        {
+            return false;
+        }
+
+        lock_guard<mutex> lock(mtx_);
+        all_ = move(fresh.all_);
+        by_list_ = move(fresh.by_list_);
+        return true;
+    }
+
+    void OnCreated(const ToDoItem& item) override
+    {
+        lock_guard<mutex> lock(mtx_);
+        Apply(item, +1);
+    }
+
+    void OnUpdated(const ToDoItem& before, const ToDoItem& after) override
+    {
+        lock_guard<mutex> lock(mtx_);
+        Apply(before, -1);
+        Apply(after, +1);
+    }
+
+    void OnDeleted(const ToDoItem& item) override
+    {
+        lock_guard<mutex> lock(mtx_);
+        Apply(item, -1);
+    }
+
+    void OnBulkImport(const vector<ToDoItem>& items) override
+    {
+        lock_guard<mutex> lock(mtx_);
+        for (const auto& item : items) 
+        {
+            Apply(item, +1);
+        }
+    }
+
+    // Counters over every list
+    //
+    boost::json::object ToJson(int64_t now = time(nullptr))
+    {
+        lock_guard<mutex> lock(mtx_);
+        all_.AdvanceTo(now);
+        return all_.ToJson();
+    }
+
+    // Counters of one list; all zero for a list without items
+    //
+    boost::json::object ListJson(const string& list_id, int64_t now = time(nullptr))
+    {
+        lock_guard<mutex> lock(mtx_);
+        auto it = by_list_.find(list_id);
+        if (it == by_list_.end()) 
+        {
+            return Counters().ToJson();
+        }
+        it->second.AdvanceTo(now);
+        return it->second.ToJson();
+    }
+
+    int64_t Overdue(int64_t now = time(nullptr))
+    {
+        lock_guard<mutex> lock(mtx_);
+        all_.AdvanceTo(now);
+        return all_.overdue;
+    }
+
+private:
+    // One set of counters: the whole table, or one list
+    struct Counters
+    {
+        int64_t total = 0;
+        map<string, int64_t> by_status;
+        int64_t by_priority[6] = {0, 0, 0, 0, 0, 0};
+        unordered_map<string, int64_t> by_tag;
+        map<int64_t, int64_t> upcoming_due;   // open items due at or after watermark, by due time
+        int64_t overdue = 0;
+        int64_t watermark = numeric_limits<int64_t>::min();
+
+        void Apply(const ToDoItem& item, int delta)
+        {
+            total += delta;
+            Bump(by_status, item.status, delta);
+            if (item.priority >= 1 && item.priority <= 5) 
+            {
+                by_priority[item.priority] += delta;
+            }
+            for (const auto& tag : item.tags) 
+            {
+                Bump(by_tag, tag, delta);
+            }
+
+            int64_t due = 0;
+            if (item.status != "Completed" && !item.due_date.empty() && parse_timestamp(item.due_date, due)) 
+            {
+                if (due < watermark) 
+                {
+                    overdue += delta;
+                }
+                else 
+                {
+                    Bump(upcoming_due, due, delta);
+                }
+            }
+        }
+
+        void AdvanceTo(int64_t now)
+        {
+            if (now <= watermark) return;
+            auto end = upcoming_due.lower_bound(now);
+            for (auto it = upcoming_due.begin(); it != end; ++it) 
+            {
+                overdue += it->second;
+            }
+            upcoming_due.erase(upcoming_due.begin(), end);
+            watermark = now;
+        }
+
+        boost::json::object ToJson() const
+        {
+            boost::json::object statuses;
+            for (const auto& [status, count] : by_status) 
+            {
+                statuses[status] = count;
+            }
+            boost::json::object priorities;
+            for (int p = 1; p <= 5; ++p) 
+            {
+                priorities[to_string(p)] = by_priority[p];
+            }
+            boost::json::object tags;
+            for (const auto& [tag, count] : by_tag) 
+            {
+                tags[tag] = count;
+            }
+
+            return boost::json::object{
+                {"total",       total},
+                {"by_status",   move(statuses)},
+                {"by_priority", move(priorities)},
+                {"by_tag",      move(tags)},
+                {"overdue",     overdue}
+            };
+        }
+    };
+
+    // Caller holds mtx_ (or owns the object exclusively). A list seen for the
+    // first time starts at the table-wide overdue watermark.
+    void Apply(const ToDoItem& item, int delta)
+    {
+        all_.Apply(item, delta);
+
+        auto it = by_list_.find(item.list_id);
+        if (it == by_list_.end()) 
+        {
+            it = by_list_.emplace(item.list_id, Counters()).first;
+            it->second.watermark = all_.watermark;
+        }
+        it->second.Apply(item, delta);
+        if (it->second.total == 0) 
+        {
+            by_list_.erase(it);
+        }
+    }
+
+    template <class Map, class Key>
+    static void Bump(Map& counts, const Key& key, int delta)
+    {
+        auto& count = counts[key];
+        count += delta;
+        if (count == 0) 
+        {
+            counts.erase(key);
+        }
+    }
+
+    mutex mtx_;
+    Counters all_;
+    unordered_map<string, Counters> by_list_;
+};
+
+#endif
@@ -6,6 +6,10 @@
 #include <sstream>
 #include <iomanip>
 #include <limits>
+#include <cstdint>
+#include <cctype>
+#include <cstdio>
+#include <vector>
 
 using namespace std;
 
@@ -39,4 +43,268 @@ static string generate_id() {
     return id;
 }
 
+// True for the canonical 8-4-4-4-12 hex form produced by generate_id()
+//
+static bool is_uuid(const string& id) {
+    if (id.size() != 36) {
+        return false;
+    }
+    for (size_t i = 0; i < id.size(); ++i) {
+        bool hyphen = (i == 8 || i == 13 || i == 18 || i == 23);
+        if (hyphen ? id[i] != '-' : !isxdigit(static_cast<unsigned char>(id[i]))) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Converts a PostgreSQL LSN ("16/B374D848") into a comparable integer.
+// Returns 0 for an empty or malformed value.
+//
+static uint64_t parse_lsn(const string& lsn) {
+    size_t slash = lsn.find('/');
+    if (slash == string::npos || slash == 0 || slash + 1 == lsn.size()) {
+        return 0;
+    }
+    try {
+        size_t hi_end = 0;
+        size_t lo_end = 0;
+        uint64_t hi = stoull(lsn.substr(0, slash), &hi_end, 16);
+        uint64_t lo = stoull(lsn.substr(slash + 1), &lo_end, 16);
+        if (hi_end != slash || lo_end != lsn.size() - slash - 1 || hi > 0xFFFFFFFFULL || lo > 0xFFFFFFFFULL) {
+            return 0;
+        }
+        return (hi << 32) | lo;
+    }
+    catch (...) {
+        return 0;
+    }
+}
+
+// Days since 1970-01-01 for a proleptic Gregorian date
+//
+static int64_t days_from_civil(int64_t y, unsigned m, unsigned d) {
+    y -= m <= 2;
+    const int64_t era = (y >= 0 ? y : y - 399) / 400;
+    const unsigned yoe = static_cast<unsigned>(y - era * 400);
+    const unsigned doy = (153 * (m > 2 ? m - 3 : m + 9) + 2) / 5 + d - 1;
+    const unsigned doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    return era * 146097 + static_cast<int64_t>(doe) - 719468;
+}
+
+// Parses an ISO 8601 / PostgreSQL timestamp ("2026-02-01", "2026-02-01T10:00:00Z",
+// "2026-02-01 10:00:00.5+05:30") into Unix seconds. A missing zone means UTC.
+//
+static bool parse_timestamp(const string& text, int64_t& out) {
+    size_t pos = 0;
+    auto read_int = [&](size_t digits, int& value) {
+        if (pos + digits > text.size()) return false;
+        value = 0;
+        for (size_t i = 0; i < digits; ++i) {
+            char c = text[pos + i];
+            if (!isdigit(static_cast<unsigned char>(c))) return false;
+            value = value * 10 + (c - '0');
+        }
+        pos += digits;
+        return true;
+    };
+    auto expect = [&](char c) {
+        if (pos < text.size() && text[pos] == c) { ++pos; return true; }
+        return false;
+    };
+
+    int year, month, day, hour = 0, minute = 0, second = 0;
+    if (!read_int(4, year) || !expect('-') || !read_int(2, month) || !expect('-') || !read_int(2, day)) {
+        return false;
+    }
+    if (month < 1 || month > 12 || day < 1 || day > 31) {
+        return false;
+    }
+
+    if (pos < text.size() && (text[pos] == 'T' || text[pos] == ' ')) {
+        ++pos;
+        if (!read_int(2, hour) || !expect(':') || !read_int(2, minute)) return false;
+        if (expect(':') && !read_int(2, second)) return false;
+        if (expect('.')) {
+            while (pos < text.size() && isdigit(static_cast<unsigned char>(text[pos]))) ++pos;
+        }
+    }
+
+    int64_t offset = 0;
+    if (pos < text.size()) {
+        char sign = text[pos];
+        if (sign == 'Z' || sign == 'z') {
+            ++pos;
+        }
+        else if (sign == '+' || sign == '-') {
+            ++pos;
+            int oh = 0, om = 0;
+            if (!read_int(2, oh)) return false;
+            if (expect(':')) {
+                if (!read_int(2, om)) return false;
+            }
+            else if (pos < text.size()) {
+                if (!read_int(2, om)) return false;
+            }
+            offset = (oh * 3600 + om * 60) * (sign == '-' ? -1 : 1);
+        }
+    }
+    if (pos != text.size() || hour > 23 || minute > 59 || second > 60) {
+        return false;
+    }
+
+    out = days_from_civil(year, month, day) * 86400 + hour * 3600 + minute * 60 + second - offset;
+    return true;
+}
+
+// Formats Unix seconds the way PostgreSQL prints a UTC timestamptz
+// ("2026-02-01 10:00:00+00"); parse_timestamp() reads it back.
+//
+static string format_timestamp(int64_t seconds) {
+    int64_t days = seconds / 86400;
+    int64_t rem = seconds % 86400;
+    if (rem < 0) {
+        rem += 86400;
+        --days;
+    }
+
+    // Inverse of days_from_civil
+    days += 719468;
+    const int64_t era = (days >= 0 ? days : days - 146096) / 146097;
+    const unsigned doe = static_cast<unsigned>(days - era * 146097);
+    const unsigned yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+    const unsigned doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+    const unsigned mp = (5 * doy + 2) / 153;
+    const unsigned day = doy - (153 * mp + 2) / 5 + 1;
+    const unsigned month = mp < 10 ? mp + 3 : mp - 9;
+    const int64_t year = static_cast<int64_t>(yoe) + era * 400 + (month <= 2);
+
+    char buf[64];
+    snprintf(buf, sizeof(buf), "%04lld-%02u-%02u %02d:%02d:%02d+00", static_cast<long long>(year), month, day,
+             static_cast<int>(rem / 3600), static_cast<int>(rem / 60 % 60), static_cast<int>(rem % 60));
+    return buf;
+}
+
+// Splits a PostgreSQL text[] literal ({a,"b c","d\"e"}) into its elements.
+// NULL elements are skipped.
+//
+static vector<string> parse_pg_array(const string& text) {
+    vector<string> out;
+    if (text.size() < 2 || text.front() != '{' || text.back() != '}') {
+        return out;
+    }
+
+    size_t pos = 1;
+    const size_t end = text.size() - 1;
+    while (pos < end) {
+        string element;
+        bool quoted = text[pos] == '"';
+        if (quoted) {
+            ++pos;
+            while (pos < end && text[pos] != '"') {
+                if (text[pos] == '\\' && pos + 1 < end) ++pos;
+                element += text[pos++];
+            }
+            ++pos;  // closing quote
+        }
+        else {
+            while (pos < end && text[pos] != ',') element += text[pos++];
+        }
+        if (quoted || element != "NULL") {
+            out.push_back(move(element));
+        }
+        ++pos;  // separator
+    }
+    return out;
+}
+
+// Builds a PostgreSQL text[] literal, quoting every element
+//
+static string format_pg_array(const vector<string>& elements) {
+    string out = "{";
+    for (const auto& element : elements) {
+        if (out.size() > 1) out += ',';
+        out += '"';
+        for (char c : element) {
+            if (c == '"' || c == '\\') out += '\\';
+            out += c;
+        }
+        out += '"';
+    }
+    out += '}';
+    return out;
+}
+
+// Decodes %XX escapes and '+' in a URL query component
+//
+static string url_decode(const string& text) {
+    string out;
+    out.reserve(text.size());
+    for (size_t i = 0; i < text.size(); ++i) {
+        char c = text[i];
+        if (c == '+') {
+            out += ' ';
+        }
+        else if (c == '%' && i + 2 < text.size() &&
+                 isxdigit(static_cast<unsigned char>(text[i + 1])) &&
+                 isxdigit(static_cast<unsigned char>(text[i + 2]))) {
+            out += static_cast<char>(stoi(text.substr(i + 1, 2), nullptr, 16));
+            i += 2;
+        }
+        else {
+            out += c;
+        }
+    }
+    return out;
+}
+
+// Turns free text into a prefix-matching tsquery: "buy mil" -> "buy:* & mil:*".
+// Anything that is not a letter, digit or non-ASCII byte separates words, so
+// tsquery operators in user input are never interpreted. Returns "" when the
+// text holds no words.
+//
+static string build_prefix_tsquery(const string& text) {
+    string query;
+    string word;
+    auto flush = [&]() {
+        if (word.empty()) return;
+        if (!query.empty()) query += " & ";
+        query += word + ":*";
+        word.clear();
+    };
+    for (char c : text) {
+        unsigned char uc = static_cast<unsigned char>(c);
+        if (isalnum(uc) || uc >= 0x80) {
+            word += static_cast<char>(tolower(uc));
+        }
+        else {
+            flush();
+        }
+    }
+    flush();
+    return query;
+}
+
+// CRC-32 (IEEE 802.3 polynomial, as in zlib) of `size` bytes at `data`
+//
+static uint32_t crc32(const char* data, size_t size) {
+    static const vector<uint32_t> table = [] {
+        vector<uint32_t> t(256);
+        for (uint32_t i = 0; i < 256; ++i) {
+            uint32_t c = i;
+            for (int k = 0; k < 8; ++k) {
+                c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : (c >> 1);
+            }
+            t[i] = c;
+        }
+        return t;
+    }();
+
+    uint32_t crc = 0xFFFFFFFFu;
+    for (size_t i = 0; i < size; ++i) {
+        crc = table[(crc ^ static_cast<unsigned char>(data[i])) & 0xFF] ^ (crc >> 8);
+    }
+    return crc ^ 0xFFFFFFFFu;
+}
+
 #endif
\ No newline at end of file
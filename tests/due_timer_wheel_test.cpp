@@ -0,0 +1,230 @@
+// tests/due_timer_wheel_test.cpp
+// Unit tests for the due-date timing wheel behind reminders, overdue events
+// and GET /todos/due
+
+#include <gtest/gtest.h>
+
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "../src/DueTimerWheel.hpp"
+#include "test_items.hpp"
+
+namespace {
+
+const int64_t kNow = 1767225600;  // 2026-01-01T00:00:00Z
+
+// Collects what the wheel fires as "reminder:<id>" / "overdue:<id>"
+struct Recorder
+{
+    std::vector<std::string> events;
+
+    DueTimerWheel::Sink Sink()
+    {
+        return [this](DueTimerWheel::Event event, const ToDoItem& item) {
+            events.push_back((event == DueTimerWheel::Event::Reminder ? "reminder:" : "overdue:") + item.id);
+        };
+    }
+};
+
+}
+
+TEST(DueTimerWheelTest, FiresReminderThenOverdue) {
+    DueTimerWheel wheel(600, kNow);
+    Recorder recorder;
+    wheel.SetSink(recorder.Sink());
+    wheel.OnCreated(MakeItem("a").Due(kNow + 3600));
+
+    wheel.Advance(kNow + 2999);
+    EXPECT_TRUE(recorder.events.empty());
+    wheel.Advance(kNow + 3000);
+    EXPECT_EQ(recorder.events, std::vector<std::string>{"reminder:a"});
+    wheel.Advance(kNow + 3599);
+    EXPECT_EQ(recorder.events.size(), 1u);
+    wheel.Advance(kNow + 3600);
+    EXPECT_EQ(recorder.events, (std::vector<std::string>{"reminder:a", "overdue:a"}));
+
+    // Overdue items stay listed but do not fire again
+    wheel.Advance(kNow + 100000);
+    EXPECT_EQ(recorder.events.size(), 2u);
+    size_t matched = 0;
+    auto due = wheel.Due(kDefaultListId, 0, 10, matched, kNow + 100000);
+    ASSERT_EQ(due.size(), 1u);
+    EXPECT_TRUE(due[0].overdue);
+}
+
+TEST(DueTimerWheelTest, CascadesFarTimersAcrossLevels) {
+    DueTimerWheel wheel(0, kNow);
+    Recorder recorder;
+    wheel.SetSink(recorder.Sink());
+    std::vector<int64_t> offsets = {1, 255, 256, 257, 65535, 65536, 65537, 16777300};
+    for (size_t i = 0; i < offsets.size(); ++i)
+    {
+        wheel.OnCreated(MakeItem(std::to_string(i)).Due(kNow + offsets[i]));
+    }
+
+    for (size_t i = 0; i < offsets.size(); ++i)
+    {
+        wheel.Advance(kNow + offsets[i] - 1);
+        EXPECT_EQ(recorder.events.size(), i) << "offset " << offsets[i];
+        wheel.Advance(kNow + offsets[i]);
+        ASSERT_EQ(recorder.events.size(), i + 1) << "offset " << offsets[i];
+        EXPECT_EQ(recorder.events.back(), "overdue:" + std::to_string(i));
+    }
+}
+
+TEST(DueTimerWheelTest, UpdatesRescheduleAndDeletesCancel) {
+    DueTimerWheel wheel(0, kNow);
+    Recorder recorder;
+    wheel.SetSink(recorder.Sink());
+    ToDoItem a = MakeItem("a").Due(kNow + 10);
+    ToDoItem b = MakeItem("b").Due(kNow + 10);
+    ToDoItem c = MakeItem("c").Due(kNow + 10);
+    wheel.OnCreated(a);
+    wheel.OnCreated(b);
+    wheel.OnCreated(c);
+
+    auto later = a;
+    later.due_date = format_timestamp(kNow + 20);
+    wheel.OnUpdated(a, later);
+    auto done = b;
+    done.status = "Completed";
+    wheel.OnUpdated(b, done);
+    wheel.OnDeleted(c);
+    EXPECT_EQ(wheel.Size(), 1u);
+
+    wheel.Advance(kNow + 15);
+    EXPECT_TRUE(recorder.events.empty());
+    wheel.Advance(kNow + 20);
+    EXPECT_EQ(recorder.events, std::vector<std::string>{"overdue:a"});
+
+    // Renaming keeps the deadline and does not fire again
+    auto renamed = later;
+    renamed.name = "renamed";
+    wheel.OnUpdated(later, renamed);
+    wheel.Advance(kNow + 30);
+    EXPECT_EQ(recorder.events.size(), 1u);
+    size_t matched = 0;
+    auto due = wheel.Due(kDefaultListId, 0, 10, matched, kNow + 30);
+    ASSERT_EQ(due.size(), 1u);
+    EXPECT_EQ(due[0].item.name, "renamed");
+    EXPECT_EQ(due[0].due, kNow + 20);
+}
+
+TEST(DueTimerWheelTest, OlderImagesArriveLateAndAreIgnored) {
+    DueTimerWheel wheel(0, kNow);
+    Recorder recorder;
+    wheel.SetSink(recorder.Sink());
+    ToDoItem v1 = MakeItem("a").Due(kNow + 10).Version(1);
+    ToDoItem v2 = MakeItem("a").Due(kNow + 5).Version(2);
+    ToDoItem v3 = MakeItem("a").Due(kNow + 20).Version(3);
+
+    // Two updates whose callbacks run in the opposite order of their commits
+    wheel.OnCreated(v1);
+    wheel.OnUpdated(v2, v3);
+    wheel.OnUpdated(v1, v2);
+    size_t matched = 0;
+    auto due = wheel.Due(kDefaultListId, 60, 10, matched, kNow);
+    ASSERT_EQ(due.size(), 1u);
+    EXPECT_EQ(due[0].due, kNow + 20);
+
+    // A delete that overtakes the update it followed
+    wheel.OnDeleted(v3);
+    ToDoItem v4 = MakeItem("a").Due(kNow + 30).Version(3);
+    wheel.OnUpdated(v2, v4);
+    EXPECT_EQ(wheel.Size(), 0u);
+    wheel.Advance(kNow + 100);
+    EXPECT_TRUE(recorder.events.empty());
+
+    // A newer image (the id written again) is scheduled
+    ToDoItem v5 = MakeItem("a").Due(kNow + 200).Version(5);
+    wheel.OnCreated(v5);
+    EXPECT_EQ(wheel.Size(), 1u);
+}
+
+TEST(DueTimerWheelTest, BulkImportSchedulesTheImportedRows) {
+    DueTimerWheel wheel(0, kNow);
+    Recorder recorder;
+    wheel.SetSink(recorder.Sink());
+    wheel.OnCreated(MakeItem("a").Due(kNow + 10));
+    wheel.OnBulkImport({MakeItem("b").Due(kNow + 5), MakeItem("c").Due(kNow - 5), MakeItem("d", "Completed").Due(kNow + 5)});
+    EXPECT_EQ(wheel.Size(), 3u);
+
+    wheel.Advance(kNow + 10);
+    EXPECT_EQ(recorder.events, (std::vector<std::string>{"overdue:c", "overdue:b", "overdue:a"}));
+}
+
+TEST(DueTimerWheelTest, PastDeadlinesFireOnceWhenWrittenButNotWhenLoaded) {
+    DueTimerWheel wheel(3600, kNow);
+    Recorder recorder;
+    wheel.SetSink(recorder.Sink());
+    ASSERT_TRUE(wheel.Load([](const std::function<void(const ToDoItem&)>& on_item) {
+        on_item(MakeItem("old").Due(kNow - 60));
+        on_item(MakeItem("soon").Due(kNow + 60));
+        return true;
+    }, kNow));
+
+    wheel.OnCreated(MakeItem("late").Due(kNow - 60));
+    wheel.OnCreated(MakeItem("close").Due(kNow + 60));
+    wheel.Advance(kNow);
+    EXPECT_EQ(recorder.events, (std::vector<std::string>{"reminder:close", "overdue:late"}));
+    wheel.Advance(kNow + 60);
+    EXPECT_EQ(recorder.events.size(), 4u);
+    EXPECT_EQ(wheel.Overdue(), 4);
+}
+
+TEST(DueTimerWheelTest, DueListsOverdueAndUpcomingByList) {
+    DueTimerWheel wheel(0, kNow);
+    wheel.OnCreated(MakeItem("late").Due(kNow - 5));
+    wheel.OnCreated(MakeItem("hour").Due(kNow + 3600));
+    wheel.OnCreated(MakeItem("day").Due(kNow + 86400));
+    wheel.OnCreated(MakeItem("month").Due(kNow + 30 * 86400));
+    ToDoItem other = MakeItem("other").Due(kNow + 60).List("11111111-1111-1111-1111-111111111111");
+    wheel.OnCreated(other);
+    wheel.OnCreated(MakeItem("epoch").Due(0));
+    wheel.OnCreated(MakeItem("none"));
+    wheel.Advance(kNow);
+
+    size_t matched = 0;
+    auto due = wheel.Due(kDefaultListId, 2 * 86400, 10, matched, kNow);
+    std::vector<std::string> ids;
+    for (const auto& entry : due) ids.push_back(entry.item.id);
+    EXPECT_EQ(ids, (std::vector<std::string>{"epoch", "late", "hour", "day"}));
+    EXPECT_EQ(matched, 4u);
+    EXPECT_TRUE(due[1].overdue);
+    EXPECT_FALSE(due[2].overdue);
+
+    due = wheel.Due(kDefaultListId, 2 * 86400, 2, matched, kNow);
+    EXPECT_EQ(due.size(), 2u);
+    EXPECT_EQ(matched, 4u);
+
+    EXPECT_EQ(wheel.Due(other.list_id, 60, 10, matched, kNow).size(), 1u);
+    EXPECT_EQ(wheel.Due(kDefaultListId, 40 * 86400, 10, matched, kNow).size(), 5u);
+}
+
+TEST(DueTimerWheelTest, ManyTimersFireInOrder) {
+    DueTimerWheel wheel(0, kNow);
+    int64_t last_due = 0;
+    bool ordered = true;
+    size_t fired = 0;
+    wheel.SetSink([&](DueTimerWheel::Event, const ToDoItem& item) {
+        int64_t due = 0;
+        parse_timestamp(item.due_date, due);
+        ordered = ordered && due >= last_due;
+        last_due = due;
+        ++fired;
+    });
+    const int kTimers = 100000;
+    for (int i = 0; i < kTimers; ++i)
+    {
+        wheel.OnCreated(MakeItem(std::to_string(i)).Due(kNow + 1 + (i * 7919) % 200000));
+    }
+    for (int64_t t = kNow; t <= kNow + 200000; t += 1000)
+    {
+        wheel.Advance(t);
+    }
+    EXPECT_EQ(fired, static_cast<size_t>(kTimers));
+    EXPECT_TRUE(ordered);
+    EXPECT_EQ(wheel.Overdue(), kTimers);
+}
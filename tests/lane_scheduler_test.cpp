@@ -0,0 +1,121 @@
+// tests/lane_scheduler_test.cpp
+// Unit tests for lane admission: reservations, worker budgets and weighted fair queueing
+
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../src/LaneScheduler.hpp"
+
+namespace {
+
+LaneScheduler::Options MakeOptions(LaneOptions point, LaneOptions write, LaneOptions scan, LaneOptions bulk)
+{
+    LaneScheduler::Options options;
+    options[static_cast<size_t>(Lane::Point)] = point;
+    options[static_cast<size_t>(Lane::Write)] = write;
+    options[static_cast<size_t>(Lane::Scan)] = scan;
+    options[static_cast<size_t>(Lane::Bulk)] = bulk;
+    return options;
+}
+
+std::chrono::steady_clock::time_point In(int ms)
+{
+    return std::chrono::steady_clock::now() + std::chrono::milliseconds(ms);
+}
+
+void WaitQueued(const LaneScheduler& scheduler, Lane lane, size_t count)
+{
+    for (int i = 0; i < 2000 && scheduler.Queued(lane) < count; ++i)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    ASSERT_EQ(scheduler.Queued(lane), count);
+}
+
+}
+
+TEST(LaneSchedulerTest, ReservedSlotsStayFreeWhileScansSaturate) {
+    // 4 slots: one reserved for point reads, scans may take the other three
+    LaneScheduler scheduler(4, MakeOptions({1, 4, 1}, {0, 4, 1}, {0, 4, 1}, {0, 1, 1}));
+    std::vector<LaneScheduler::Ticket> scans;
+    for (int i = 0; i < 3; ++i)
+    {
+        scans.push_back(scheduler.Acquire(Lane::Scan, In(100)));
+        ASSERT_TRUE(scans.back());
+    }
+    EXPECT_FALSE(scheduler.Acquire(Lane::Scan, In(10)));
+
+    auto point = scheduler.Acquire(Lane::Point, In(10));
+    EXPECT_TRUE(point);
+    EXPECT_EQ(scheduler.InFlight(Lane::Point), 1u);
+}
+
+TEST(LaneSchedulerTest, WorkerBudgetCapsALane) {
+    LaneScheduler scheduler(8, MakeOptions({0, 8, 1}, {0, 8, 1}, {0, 2, 1}, {0, 1, 1}));
+    auto a = scheduler.Acquire(Lane::Scan);
+    auto b = scheduler.Acquire(Lane::Scan);
+    EXPECT_FALSE(scheduler.Acquire(Lane::Scan, In(10)));
+    EXPECT_EQ(scheduler.Queued(Lane::Scan), 0u);
+
+    a.Release();
+    EXPECT_TRUE(scheduler.Acquire(Lane::Scan, In(10)));
+}
+
+TEST(LaneSchedulerTest, ReleaseAdmitsAWaiter) {
+    LaneScheduler scheduler(1, MakeOptions({0, 1, 1}, {0, 1, 1}, {0, 1, 1}, {0, 1, 1}));
+    auto held = scheduler.Acquire(Lane::Bulk);
+    bool admitted = false;
+    std::thread waiter([&] { admitted = static_cast<bool>(scheduler.Acquire(Lane::Point, In(2000))); });
+    WaitQueued(scheduler, Lane::Point, 1);
+    held.Release();
+    waiter.join();
+    EXPECT_TRUE(admitted);
+}
+
+TEST(LaneSchedulerTest, BackloggedLanesAreServedByWeight) {
+    // One slot; points weigh 5, scans 2. With the slot held, four of each
+    // queue up; virtual finish tags put them in the order checked below.
+    LaneScheduler scheduler(1, MakeOptions({0, 1, 5}, {0, 1, 1}, {0, 1, 2}, {0, 1, 1}));
+    auto held = scheduler.Acquire(Lane::Bulk);
+
+    std::mutex order_mtx;
+    std::vector<std::string> order;
+    std::vector<std::thread> threads;
+    auto enqueue = [&](Lane lane, const std::string& name, size_t position) {
+        threads.emplace_back([&, lane, name] {
+            auto ticket = scheduler.Acquire(lane);
+            std::lock_guard<std::mutex> lock(order_mtx);
+            order.push_back(name);
+        });
+        WaitQueued(scheduler, lane, position);
+    };
+    for (size_t i = 1; i <= 4; ++i) enqueue(Lane::Scan, "s" + std::to_string(i), i);
+    for (size_t i = 1; i <= 4; ++i) enqueue(Lane::Point, "p" + std::to_string(i), i);
+
+    held.Release();
+    for (auto& t : threads) t.join();
+    EXPECT_EQ(order, (std::vector<std::string>{"p1", "p2", "s1", "p3", "p4", "s2", "s3", "s4"}));
+}
+
+TEST(LaneSchedulerTest, ReservationsAreCutToTheSlotCount) {
+    LaneScheduler scheduler(2, MakeOptions({2, 2, 1}, {2, 2, 1}, {0, 2, 1}, {0, 1, 1}));
+    auto a = scheduler.Acquire(Lane::Point, In(10));
+    auto b = scheduler.Acquire(Lane::Point, In(10));
+    EXPECT_TRUE(a);
+    EXPECT_TRUE(b);
+    EXPECT_FALSE(scheduler.Acquire(Lane::Write, In(10)));
+}
+
+TEST(LatencyHistogramTest, PercentilesWithinABucket) {
+    LatencyHistogram histogram;
+    for (int i = 0; i < 99; ++i) histogram.Add(1.0);
+    histogram.Add(500.0);
+    EXPECT_LE(histogram.Percentile(0.5), 1.28);
+    EXPECT_GE(histogram.Percentile(0.5), 1.0);
+    EXPECT_DOUBLE_EQ(histogram.Percentile(1.0), 500.0);
+}
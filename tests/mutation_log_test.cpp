@@ -0,0 +1,282 @@
+// tests/mutation_log_test.cpp
+// Unit tests for the durable mutation log: encoding, recovery and compaction
+
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../src/MutationLog.hpp"
+#include "test_items.hpp"
+
+namespace {
+
+// A fresh, empty log directory per test
+std::string TempDir(const std::string& name)
+{
+    auto dir = std::filesystem::temp_directory_path() / ("mutation_log_test_" + name);
+    std::filesystem::remove_all(dir);
+    return dir.string();
+}
+
+// Writes a segment by hand, numbering `records` from `first_seq`. The item
+// is the record's after image, or its before image for a delete.
+void WriteSegment(const std::string& dir, uint64_t first_seq,
+                  const std::vector<std::pair<MutationRecord::Op, ToDoItem>>& records)
+{
+    std::filesystem::create_directories(dir);
+    std::string data;
+    uint64_t seq = first_seq;
+    for (const auto& [op, item] : records) 
+    {
+        const ToDoItem* before = op == MutationRecord::Created ? nullptr : &item;
+        const ToDoItem* after = op == MutationRecord::Deleted ? nullptr : &item;
+        MutationLog::Encode(seq++, 0, op, before, after, data);
+    }
+    char name[64];
+    snprintf(name, sizeof(name), "mutations-%020llu.log", static_cast<unsigned long long>(first_seq));
+    std::ofstream out((std::filesystem::path(dir) / name).string(), std::ios::binary);
+    out << data;
+}
+
+void WaitDurable(const MutationLog& log, uint64_t seq)
+{
+    for (int i = 0; i < 2000 && log.DurableSeq() < seq; ++i) 
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    ASSERT_GE(log.DurableSeq(), seq);
+}
+
+// Compaction runs on its own thread after a rotation
+void WaitCompactions(const MutationLog& log, uint64_t count)
+{
+    for (int i = 0; i < 2000 && log.Metrics().at("compactions").as_uint64() < count; ++i) 
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    ASSERT_EQ(log.Metrics().at("compactions").as_uint64(), count);
+}
+
+std::vector<MutationRecord> ReadAll(const MutationLog& log)
+{
+    std::vector<MutationRecord> records;
+    log.Replay(0, [&](const MutationRecord& rec) { records.push_back(rec); return true; });
+    return records;
+}
+
+}
+
+TEST(MutationLogTest, EncodeDecodeRoundTrip) {
+    ToDoItem before = MakeItem("a", "Not Started");
+    ToDoItem after = MakeItem("a", "Completed");
+    std::string data;
+    MutationLog::Encode(7, 1234, MutationRecord::Updated, &before, &after, data);
+
+    MutationRecord rec;
+    size_t used = 0;
+    ASSERT_TRUE(MutationLog::Decode(data.data(), data.size(), rec, used));
+    EXPECT_EQ(used, data.size());
+    EXPECT_EQ(rec.seq, 7u);
+    EXPECT_EQ(rec.op, MutationRecord::Updated);
+    EXPECT_EQ(rec.before.status, "Not Started");
+    EXPECT_EQ(rec.after.status, "Completed");
+    EXPECT_EQ(rec.after.tags, (std::vector<std::string>{"work", "home"}));
+    EXPECT_EQ(rec.after.version, 0u);
+
+    data[data.size() - 1] ^= 0x01;
+    EXPECT_FALSE(MutationLog::Decode(data.data(), data.size(), rec, used));
+    EXPECT_FALSE(MutationLog::Decode(data.data(), data.size() / 2, rec, used));
+}
+
+TEST(MutationLogTest, EventsCarryTheItem) {
+    ToDoItem item = MakeItem("a", "In Progress");
+    std::string data;
+    MutationLog::Encode(8, 1234, MutationRecord::Overdue, nullptr, &item, data);
+
+    MutationRecord rec;
+    size_t used = 0;
+    ASSERT_TRUE(MutationLog::Decode(data.data(), data.size(), rec, used));
+    EXPECT_EQ(rec.op, MutationRecord::Overdue);
+    EXPECT_EQ(rec.after.id, "a");
+    EXPECT_EQ(rec.after.status, "In Progress");
+}
+
+TEST(MutationLogTest, RecoversAndDropsATornTail) {
+    std::string dir = TempDir("recover");
+    {
+        MutationLog log(dir);
+        log.OnCreated(MakeItem("a", "Not Started"));
+        log.OnDeleted(MakeItem("a", "Not Started"));
+        WaitDurable(log, 2);
+    }
+
+    // Simulate a crash in the middle of writing a third record
+    std::string segment = (std::filesystem::path(dir) / "mutations-00000000000000000001.log").string();
+    {
+        std::ofstream out(segment, std::ios::binary | std::ios::app);
+        out << "\x40\x00\x00\x00garbage";
+    }
+
+    MutationLog log(dir);
+    EXPECT_EQ(log.DurableSeq(), 2u);
+    log.OnCreated(MakeItem("b", "In Progress"));
+    WaitDurable(log, 3);
+
+    auto records = ReadAll(log);
+    ASSERT_EQ(records.size(), 3u);
+    EXPECT_EQ(records[2].seq, 3u);
+    EXPECT_EQ(records[2].after.id, "b");
+}
+
+TEST(MutationLogTest, CompactionKeepsTheLastImageOfLiveItems) {
+    MutationLogOptions options;
+    options.segment_bytes = 1;              // every group commit seals a segment
+    options.sync_interval = std::chrono::milliseconds(1);
+    options.compact_after_segments = 3;
+    MutationLog log(TempDir("compact"), options);
+
+    log.OnCreated(MakeItem("a", "Not Started"));
+    WaitDurable(log, 1);
+    log.OnCreated(MakeItem("b", "Not Started"));
+    WaitDurable(log, 2);
+    log.OnUpdated(MakeItem("a", "Not Started"), MakeItem("a", "Completed"));
+    WaitDurable(log, 3);
+    log.OnDeleted(MakeItem("b", "Not Started"));
+    WaitDurable(log, 4);
+    WaitCompactions(log, 1);
+
+    auto records = ReadAll(log);
+    ASSERT_EQ(records.size(), 1u);
+    EXPECT_EQ(records[0].seq, 3u);
+    EXPECT_EQ(records[0].op, MutationRecord::Created);
+    EXPECT_EQ(records[0].after.status, "Completed");
+}
+
+TEST(MutationLogTest, CompactionKeepsTheNewestVersionWhateverTheLogOrder) {
+    // Callbacks that arrived in the opposite order of the commits: a's
+    // update to version 2 was logged after the one to version 3, and b's
+    // delete before the update it followed
+    std::string dir = TempDir("compact_versions");
+    WriteSegment(dir, 1, {{MutationRecord::Created, MakeItem("a", "Not Started").Version(1)},
+                          {MutationRecord::Updated, MakeItem("a", "Completed").Version(3)}});
+    WriteSegment(dir, 3, {{MutationRecord::Updated, MakeItem("a", "In Progress").Version(2)},
+                          {MutationRecord::Created, MakeItem("b", "Not Started").Version(4)}});
+    WriteSegment(dir, 5, {{MutationRecord::Deleted, MakeItem("b", "In Progress").Version(5)},
+                          {MutationRecord::Updated, MakeItem("b", "In Progress").Version(5)}});
+    WriteSegment(dir, 7, {});
+
+    MutationLogOptions options;
+    options.segment_bytes = 1;
+    options.sync_interval = std::chrono::milliseconds(1);
+    options.compact_after_segments = 3;
+    MutationLog log(dir, options);
+    log.OnCreated(MakeItem("c", "Not Started").Version(6));   // seals segment 7
+    WaitDurable(log, 7);
+    WaitCompactions(log, 1);
+
+    auto records = ReadAll(log);
+    ASSERT_EQ(records.size(), 2u);
+    EXPECT_EQ(records[0].after.id, "a");
+    EXPECT_EQ(records[0].after.status, "Completed");
+    EXPECT_EQ(records[0].after.version, 3u);
+    EXPECT_EQ(records[1].after.id, "c");
+}
+
+TEST(MutationLogTest, ASegmentEndsWhereTheNextOneBegins) {
+    // What a failed write leaves behind: records 2 and 3 reached the first
+    // segment and were written again to a segment starting at 2
+    std::string dir = TempDir("retried");
+    WriteSegment(dir, 1, {{MutationRecord::Created, MakeItem("1", "torn")},
+                          {MutationRecord::Created, MakeItem("2", "torn")},
+                          {MutationRecord::Created, MakeItem("3", "torn")}});
+    WriteSegment(dir, 2, {{MutationRecord::Created, MakeItem("2", "retried")},
+                          {MutationRecord::Created, MakeItem("3", "retried")}});
+
+    MutationLog log(dir);
+    EXPECT_EQ(log.DurableSeq(), 3u);
+    auto records = ReadAll(log);
+    ASSERT_EQ(records.size(), 3u);
+    EXPECT_EQ(records[0].after.status, "torn");
+    EXPECT_EQ(records[1].seq, 2u);
+    EXPECT_EQ(records[1].after.status, "retried");
+    EXPECT_EQ(records[2].after.status, "retried");
+}
+
+TEST(MutationLogTest, ForwarderResumesFromItsSavedOffset) {
+    std::string dir = TempDir("forward");
+    std::string offset_path = (std::filesystem::path(dir) / "forwarder.offset").string();
+    MutationLog log(dir);
+    log.OnCreated(MakeItem("a", "Not Started"));
+    log.OnCreated(MakeItem("b", "Not Started"));
+    WaitDurable(log, 2);
+
+    std::vector<uint64_t> forwarded;
+    auto collect = [&](const MutationRecord& rec) { forwarded.push_back(rec.seq); return true; };
+    {
+        MutationForwarder forwarder(log, collect, offset_path, std::chrono::milliseconds(1));
+        for (int i = 0; i < 2000 && forwarder.Offset() < 2; ++i) 
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    }
+    EXPECT_EQ(forwarded, (std::vector<uint64_t>{1, 2}));
+
+    log.OnDeleted(MakeItem("a", "Not Started"));
+    WaitDurable(log, 3);
+    {
+        MutationForwarder forwarder(log, collect, offset_path, std::chrono::milliseconds(1));
+        for (int i = 0; i < 2000 && forwarder.Offset() < 3; ++i) 
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    }
+    EXPECT_EQ(forwarded, (std::vector<uint64_t>{1, 2, 3}));
+}
+
+TEST(MutationLogTest, AppendsAreDroppedOnceFailingPastTheWait) {
+    MutationLogOptions options;
+    options.segment_bytes = 1;                  // every group commit opens a new segment
+    options.max_failing_bytes = 1;              // no room as soon as anything is pending
+    options.max_append_wait = std::chrono::milliseconds(20);
+    std::string dir = TempDir("failing");
+    MutationLog log(dir, options);
+    log.OnCreated(MakeItem("a", "Not Started"));
+    WaitDurable(log, 1);
+
+    // A file in place of the directory: the next segment cannot be opened.
+    // A record can still land in a segment opened before, so append until
+    // a flush fails.
+    std::filesystem::remove_all(dir);
+    std::ofstream(dir).put('x');
+    uint64_t seq = 1;
+    while (log.Metrics().at("write_errors").as_uint64() == 0 && seq < 10) 
+    {
+        log.OnCreated(MakeItem(std::to_string(++seq), "Not Started"));
+        for (int i = 0; i < 2000 && log.DurableSeq() < seq && log.Metrics().at("write_errors").as_uint64() == 0; ++i) 
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    }
+    ASSERT_GT(log.Metrics().at("write_errors").as_uint64(), 0u);
+    uint64_t pending = log.Metrics().at("pending_bytes").as_uint64();
+    ASSERT_GT(pending, 0u);
+
+    log.OnCreated(MakeItem("dropped 1", "Not Started"));
+    log.OnCreated(MakeItem("dropped 2", "Not Started"));
+    EXPECT_EQ(log.Metrics().at("dropped").as_uint64(), 2u);
+    EXPECT_EQ(log.Metrics().at("pending_bytes").as_uint64(), pending);
+
+    // Once the disk is back the pending record goes out and appends resume
+    std::filesystem::remove(dir);
+    std::filesystem::create_directories(dir);
+    WaitDurable(log, seq);
+    log.OnCreated(MakeItem("after", "Not Started"));
+    WaitDurable(log, seq + 1);
+    EXPECT_EQ(log.Metrics().at("dropped").as_uint64(), 2u);
+}
@@ -0,0 +1,151 @@
+// tests/query_coalescer_test.cpp
+// Unit tests for the singleflight coalescing of identical list queries
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../src/QueryCoalescer.hpp"
+
+namespace {
+
+QueryCoalescer::Result Body(const std::string& text)
+{
+    return std::make_shared<const std::string>(text);
+}
+
+ToDoItem AnyItem()
+{
+    return ToDoItem{"a", "name", "", "", "Not Started", 3, {}, kDefaultListId};
+}
+
+}
+
+TEST(QueryCoalescerTest, ConcurrentCallersShareOneExecution) {
+    QueryCoalescer coalescer;
+    std::atomic<int> executions{0};
+    std::promise<void> release;
+    auto gate = release.get_future().share();
+
+    auto load = [&]() {
+        ++executions;
+        gate.wait();
+        return Body("rows");
+    };
+
+    std::vector<std::future<QueryCoalescer::Result>> callers;
+    for (int i = 0; i < 8; ++i) 
+    {
+        callers.push_back(std::async(std::launch::async, [&] { return coalescer.Do("key", load); }));
+    }
+    // Let every caller reach the in-flight execution before it finishes
+    while (coalescer.Metrics().at("coalesced").as_uint64() + coalescer.Metrics().at("executed").as_uint64() < 8) 
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    release.set_value();
+
+    QueryCoalescer::Result first = callers[0].get();
+    for (size_t i = 1; i < callers.size(); ++i) 
+    {
+        EXPECT_EQ(callers[i].get().get(), first.get());  // the very same buffer
+    }
+    EXPECT_EQ(executions.load(), 1);
+}
+
+TEST(QueryCoalescerTest, WithoutTtlFinishedResultsAreNotReused) {
+    QueryCoalescer coalescer;
+    int executions = 0;
+    auto load = [&]() { ++executions; return Body("rows"); };
+    coalescer.Do("key", load);
+    coalescer.Do("key", load);
+    EXPECT_EQ(executions, 2);
+}
+
+TEST(QueryCoalescerTest, TtlReusesResultsUntilAWrite) {
+    QueryCoalescer coalescer(std::chrono::milliseconds(60000));
+    int executions = 0;
+    auto load = [&]() { ++executions; return Body("rows " + std::to_string(executions)); };
+
+    EXPECT_EQ(*coalescer.Do("key", load), "rows 1");
+    EXPECT_EQ(*coalescer.Do("key", load), "rows 1");
+    EXPECT_EQ(*coalescer.Do("other", load), "rows 2");
+
+    coalescer.OnCreated(AnyItem());
+    EXPECT_EQ(*coalescer.Do("key", load), "rows 3");
+}
+
+TEST(QueryCoalescerTest, FailuresAreNotCached) {
+    QueryCoalescer coalescer(std::chrono::milliseconds(60000));
+    int executions = 0;
+    auto failing = [&]() -> QueryCoalescer::Result { ++executions; return nullptr; };
+    EXPECT_EQ(coalescer.Do("key", failing), nullptr);
+    EXPECT_EQ(coalescer.Do("key", failing), nullptr);
+    EXPECT_EQ(executions, 2);
+}
+
+TEST(QueryCoalescerTest, JoinersRetryWhenTheSharedExecutionFails) {
+    QueryCoalescer coalescer;
+    std::atomic<int> executions{0};
+    std::promise<void> release;
+    auto gate = release.get_future().share();
+
+    // The first execution fails (e.g. cancelled); a joiner runs its own
+    auto load = [&]() -> QueryCoalescer::Result {
+        if (++executions == 1) 
+        {
+            gate.wait();
+            return nullptr;
+        }
+        return Body("rows");
+    };
+
+    auto leader = std::async(std::launch::async, [&] { return coalescer.Do("key", load); });
+    while (executions.load() == 0) 
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    auto joiner = std::async(std::launch::async, [&] { return coalescer.Do("key", load); });
+    while (coalescer.Metrics().at("coalesced").as_uint64() == 0) 
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    release.set_value();
+
+    EXPECT_EQ(leader.get(), nullptr);
+    auto retried = joiner.get();
+    ASSERT_NE(retried, nullptr);
+    EXPECT_EQ(*retried, "rows");
+    EXPECT_EQ(executions.load(), 2);
+}
+
+TEST(QueryCoalescerTest, JoinersStopWaitingAtTheirOwnDeadline) {
+    QueryCoalescer coalescer;
+    std::promise<void> release;
+    auto gate = release.get_future().share();
+    std::atomic<bool> started{false};
+    auto slow = [&]() {
+        started = true;
+        gate.wait();
+        return Body("rows");
+    };
+
+    auto leader = std::async(std::launch::async, [&] { return coalescer.Do("key", slow); });
+    while (!started) 
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(20);
+    EXPECT_EQ(coalescer.Do("key", slow, deadline), nullptr);
+    EXPECT_EQ(coalescer.Metrics().at("wait_timeouts").as_uint64(), 1u);
+
+    // The shared execution is unaffected and finishes for its leader
+    release.set_value();
+    ASSERT_NE(leader.get(), nullptr);
+}
@@ -0,0 +1,78 @@
+// tests/request_timing_test.cpp
+// Unit tests for the per-request stage timers and the slow-request log
+
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <string>
+
+#include "../src/RequestContext.hpp"
+#include "../src/RequestTiming.hpp"
+
+namespace {
+
+RequestTimings StartedAgo(int ms)
+{
+    return RequestTimings(std::chrono::steady_clock::now() - std::chrono::milliseconds(ms));
+}
+
+}
+
+TEST(RequestTimingTest, StagesAccumulate) {
+    RequestTimings timings;
+    timings.Add(Stage::Query, std::chrono::milliseconds(2));
+    timings.Add(Stage::Query, std::chrono::milliseconds(3));
+    EXPECT_DOUBLE_EQ(timings.Millis(Stage::Query), 5.0);
+    EXPECT_DOUBLE_EQ(timings.Millis(Stage::Parse), 0.0);
+}
+
+TEST(RequestTimingTest, ScopedStageIsNoOpWithoutTimings) {
+    ScopedStage stage(nullptr, Stage::Query);
+    stage.Stop();
+    SUCCEED();
+}
+
+TEST(RequestTimingTest, ServerTimingHeaderSkipsStagesThatDidNotRun) {
+    RequestTimings timings;
+    timings.Add(Stage::Read, std::chrono::microseconds(1500));
+    timings.Add(Stage::Query, std::chrono::milliseconds(4));
+    std::string header = timings.ServerTimingHeader();
+    EXPECT_EQ(header.rfind("read;dur=1.500, query;dur=4.000, total;dur=", 0), 0u) << header;
+    EXPECT_EQ(header.find("parse"), std::string::npos);
+}
+
+TEST(RequestTimingTest, SlowRequestLogKeepsTheSlowest) {
+    SlowRequestLog log(2);
+    log.Record("GET", "/todos/a", 200, StartedAgo(10));
+    log.Record("GET", "/todos/b", 200, StartedAgo(30));
+    log.Record("GET", "/todos/c", 200, StartedAgo(20));
+    log.Record("GET", "/todos/d", 200, StartedAgo(5));
+
+    auto entries = log.ToJson();
+    ASSERT_EQ(entries.size(), 2u);
+    EXPECT_EQ(entries[0].at("target").as_string(), "/todos/b");
+    EXPECT_EQ(entries[1].at("target").as_string(), "/todos/c");
+    EXPECT_TRUE(entries[0].at("stages").as_object().contains("pool_wait"));
+}
+
+TEST(RequestTimingTest, SlowRequestLogOfSizeZeroKeepsNothing) {
+    SlowRequestLog log(0);
+    log.Record("GET", "/todos/a", 200, StartedAgo(10));
+    log.Record("GET", "/todos/b", 200, StartedAgo(30));
+    EXPECT_TRUE(log.ToJson().empty());
+}
+
+TEST(RequestTimingTest, ContextWithoutDeadlineNeverExpires) {
+    RequestContext ctx;
+    EXPECT_FALSE(ctx.HasDeadline());
+    EXPECT_FALSE(ctx.Expired());
+}
+
+TEST(RequestTimingTest, ContextExpiresAtDeadline) {
+    RequestContext ctx;
+    ctx.deadline = std::chrono::steady_clock::now() + std::chrono::hours(1);
+    EXPECT_TRUE(ctx.HasDeadline());
+    EXPECT_FALSE(ctx.Expired());
+    ctx.deadline = std::chrono::steady_clock::now() - std::chrono::milliseconds(1);
+    EXPECT_TRUE(ctx.Expired());
+}
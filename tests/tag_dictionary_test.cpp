@@ -0,0 +1,64 @@
+// tests/tag_dictionary_test.cpp
+// Unit tests for the in-process tag id <-> name dictionary
+
+#include <gtest/gtest.h>
+
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../src/TagDictionary.hpp"
+
+TEST(TagDictionaryTest, ParsesAndFormatsIdArrays) {
+    EXPECT_EQ(TagDictionary::ParseIds("{}"), std::vector<TagDictionary::TagId>{});
+    EXPECT_EQ(TagDictionary::ParseIds("{3,17,2}"), (std::vector<TagDictionary::TagId>{3, 17, 2}));
+    EXPECT_EQ(TagDictionary::FormatIds({}), "{}");
+    EXPECT_EQ(TagDictionary::FormatIds({3, 17, 2}), "{3,17,2}");
+    EXPECT_EQ(TagDictionary::ParseIds(TagDictionary::FormatIds({1, 20000000})), (std::vector<TagDictionary::TagId>{1, 20000000}));
+}
+
+TEST(TagDictionaryTest, NamesFollowIdOrderAndSkipUnknownIds) {
+    TagDictionary tags;
+    tags.Learn(1, "work");
+    tags.Learn(2, "home");
+    EXPECT_EQ(tags.Names({2, 1}), (std::vector<std::string>{"home", "work"}));
+    EXPECT_EQ(tags.Names({2, 9}), (std::vector<std::string>{"home"}));
+    EXPECT_EQ(tags.Missing({9, 1, 9, 8}), (std::vector<TagDictionary::TagId>{9, 8}));
+    EXPECT_EQ(tags.Size(), 2u);
+}
+
+TEST(TagDictionaryTest, OnlyCommittedNamesAreFindable) {
+    TagDictionary tags;
+    TagDictionary::TagId id = 0;
+
+    // Learned from an uncommitted write: the id may yet be rolled back
+    tags.Learn(5, "draft");
+    EXPECT_FALSE(tags.FindCommitted("draft", id));
+    EXPECT_EQ(tags.Names({5}), std::vector<std::string>{"draft"});
+
+    tags.LearnCommitted(6, "urgent");
+    ASSERT_TRUE(tags.FindCommitted("urgent", id));
+    EXPECT_EQ(id, 6);
+}
+
+TEST(TagDictionaryTest, ConcurrentLearnersAndReaders) {
+    TagDictionary tags;
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; ++t)
+    {
+        threads.emplace_back([&tags, t] {
+            for (int i = 0; i < 1000; ++i)
+            {
+                tags.LearnCommitted(i, "tag" + std::to_string(i));
+                TagDictionary::TagId id = 0;
+                if (tags.FindCommitted("tag" + std::to_string((i + t) % 1000), id))
+                {
+                    EXPECT_EQ(id, (i + t) % 1000);
+                }
+                tags.Names({i, (i + 1) % 1000});
+            }
+        });
+    }
+    for (auto& thread : threads) thread.join();
+    EXPECT_EQ(tags.Size(), 1000u);
+}
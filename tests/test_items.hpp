@@ -0,0 +1,57 @@
+// tests/test_items.hpp
+// The ToDoItem builder shared by the unit tests
+
+#ifndef TEST_ITEMS_HPP
+#define TEST_ITEMS_HPP
+
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "../src/DbAccess.hpp"
+#include "../src/Utility.hpp"
+
+// Starts from an item with every field set: "name <id>", "about <id>",
+// priority 3, tags work and home, no due date, in the default list. Tests
+// change only the fields they look at:
+//
+//     ToDoItem item = MakeItem("a", "Completed").Due(kNow + 60).Tags({});
+//
+class ItemBuilder
+{
+public:
+    ItemBuilder(const std::string& id, const std::string& status)
+        : item_{id, "name " + id, "about " + id, "", status, 3, {"work", "home"}, kDefaultListId}
+    {
+    }
+
+    ItemBuilder& Name(const std::string& name) { item_.name = name; return *this; }
+
+    ItemBuilder& Description(const std::string& description) { item_.description = description; return *this; }
+
+    ItemBuilder& Due(const std::string& due_date) { item_.due_date = due_date; return *this; }
+
+    // Due at `unix_seconds`, formatted as the database returns it
+    ItemBuilder& Due(int64_t unix_seconds) { item_.due_date = format_timestamp(unix_seconds); return *this; }
+
+    ItemBuilder& Priority(int priority) { item_.priority = priority; return *this; }
+
+    ItemBuilder& Tags(std::vector<std::string> tags) { item_.tags = std::move(tags); return *this; }
+
+    ItemBuilder& List(const std::string& list_id) { item_.list_id = list_id; return *this; }
+
+    ItemBuilder& Version(uint64_t version) { item_.version = version; return *this; }
+
+    operator ToDoItem() const { return item_; }
+
+private:
+    ToDoItem item_;
+};
+
+inline ItemBuilder MakeItem(const std::string& id, const std::string& status = "Not Started")
+{
+    return ItemBuilder(id, status);
+}
+
+#endif
@@ -0,0 +1,146 @@
+// tests/todo_decoder_test.cpp
+// Unit tests for the streaming request body decoder
+
+#include <gtest/gtest.h>
+
+#include <string>
+#include <vector>
+
+#include "../src/ToDoDecoder.hpp"
+
+namespace {
+
+const std::string kId1 = "123e4567-e89b-12d3-a456-426614174000";
+const std::string kId2 = "00000000-0000-0000-0000-000000000001";
+
+}
+
+TEST(ToDoDecoderTest, DecodesRequestFormat) {
+    ToDoItem item;
+    DecodeError error;
+    ASSERT_TRUE(ToDoDecoder::DecodeItem(
+        R"({"name": "Buy milk", "description": "2 liters", "due_date": "2026-01-01 10:00:00+00",)"
+        R"( "status": "In Progress", "priority": "4", "tags": "home,errands"})", item, error)) << error.Describe();
+    EXPECT_EQ(item.name, "Buy milk");
+    EXPECT_EQ(item.description, "2 liters");
+    EXPECT_EQ(item.due_date, "2026-01-01 10:00:00+00");
+    EXPECT_EQ(item.status, "In Progress");
+    EXPECT_EQ(item.priority, 4);
+    EXPECT_EQ(item.tags, (std::vector<std::string>{"home", "errands"}));
+}
+
+TEST(ToDoDecoderTest, DecodesExportFormatWithNullsAndUnknownKeys) {
+    ToDoItem item;
+    DecodeError error;
+    ASSERT_TRUE(ToDoDecoder::DecodeItem(
+        R"({"id": "abc", "list_id": "x", "name": "Plan", "description": null, "extra": {"a": [1, {"b": null}]},)"
+        R"( "due_date": null, "status": null, "priority": 2, "tags": ["work", "q1"]})", item, error)) << error.Describe();
+    EXPECT_EQ(item.id, "abc");
+    EXPECT_EQ(item.name, "Plan");
+    EXPECT_EQ(item.description, "");
+    EXPECT_EQ(item.status, "Not Started");
+    EXPECT_EQ(item.priority, 2);
+    EXPECT_EQ(item.tags, (std::vector<std::string>{"work", "q1"}));
+    EXPECT_TRUE(item.list_id.empty() || item.list_id == kDefaultListId);
+}
+
+TEST(ToDoDecoderTest, AppliesDefaults) {
+    ToDoItem item;
+    DecodeError error;
+    ASSERT_TRUE(ToDoDecoder::DecodeItem(R"({"name": "Only a name"})", item, error));
+    EXPECT_EQ(item.status, "Not Started");
+    EXPECT_EQ(item.priority, 3);
+    EXPECT_TRUE(item.tags.empty());
+}
+
+TEST(ToDoDecoderTest, ReportsErrorLocations) {
+    ToDoItem item;
+    DecodeError error;
+    EXPECT_FALSE(ToDoDecoder::DecodeItem("{\"name\": \"a\",\n  \"status\": \"Done\"}", item, error));
+    EXPECT_EQ(error.message, "Invalid status value");
+    EXPECT_EQ(error.line, 2u);
+    EXPECT_EQ(error.column, 18u);
+    EXPECT_EQ(error.Describe(), "Invalid status value at line 2, column 18");
+
+    EXPECT_FALSE(ToDoDecoder::DecodeItem(R"({"name": "a", "priority": 9})", item, error));
+    EXPECT_EQ(error.message, "Priority must be between 1 and 5");
+    EXPECT_EQ(error.column, 28u);
+
+    EXPECT_FALSE(ToDoDecoder::DecodeItem(R"({"name": "a", "priority": "high"})", item, error));
+    EXPECT_EQ(error.message, "Priority must be an integer between 1 and 5");
+
+    EXPECT_FALSE(ToDoDecoder::DecodeItem(R"({"name": 7})", item, error));
+    EXPECT_EQ(error.message, "name must be a string");
+
+    EXPECT_FALSE(ToDoDecoder::DecodeItem(R"({"description": "no name"})", item, error));
+    EXPECT_EQ(error.message, "name is required");
+
+    EXPECT_FALSE(ToDoDecoder::DecodeItem(R"(["name"])", item, error));
+    EXPECT_EQ(error.message, "Item must be a JSON object");
+
+    EXPECT_FALSE(ToDoDecoder::DecodeItem(R"({"name": "a", "tags": ["ok", ""]})", item, error));
+    EXPECT_EQ(error.message.rfind("Tags must be non-empty", 0), 0u);
+
+    EXPECT_FALSE(ToDoDecoder::DecodeItem(R"({"name": "a", "tags": [1]})", item, error));
+    EXPECT_EQ(error.message, "Tags must be an array of strings or a comma-separated string");
+}
+
+TEST(ToDoDecoderTest, ReportsSyntaxErrors) {
+    ToDoItem item;
+    DecodeError error;
+    EXPECT_FALSE(ToDoDecoder::DecodeItem(R"({"name": "a",)", item, error));
+    EXPECT_EQ(error.message.rfind("Invalid JSON", 0), 0u);
+
+    EXPECT_FALSE(ToDoDecoder::DecodeItem(" \n ", item, error));
+    EXPECT_EQ(error.message, "Item must be a JSON object");
+}
+
+TEST(ToDoDecoderTest, DecodesUpdates) {
+    ToDoUpdate update;
+    DecodeError error;
+    ASSERT_TRUE(ToDoDecoder::DecodeUpdate(R"({"status": "Completed", "priority": 5, "tags": "a,b \"c\"", "id": "x"})",
+                                          update, false, error)) << error.Describe();
+    EXPECT_FALSE(update.Empty());
+    EXPECT_FALSE(update.name.has_value());
+    EXPECT_EQ(update.status, "Completed");
+    EXPECT_EQ(update.priority, 5);
+    auto columns = update.Columns();
+    EXPECT_EQ(columns.size(), 3u);
+    EXPECT_EQ(columns["priority"], "5");
+    EXPECT_EQ(columns["tags"], R"({"a","b \"c\""})");
+
+    ToDoUpdate empty;
+    ASSERT_TRUE(ToDoDecoder::DecodeUpdate("", empty, false, error));
+    EXPECT_TRUE(empty.Empty());
+    ASSERT_TRUE(ToDoDecoder::DecodeUpdate(R"({"unrelated": [1, 2]})", empty, false, error));
+    EXPECT_TRUE(empty.Empty());
+
+    ToDoUpdate cleared;
+    ASSERT_TRUE(ToDoDecoder::DecodeUpdate(R"({"tags": ""})", cleared, false, error));
+    EXPECT_EQ(cleared.Columns()["tags"], "{}");
+
+    ToDoUpdate bad;
+    EXPECT_FALSE(ToDoDecoder::DecodeUpdate(R"({"description": null})", bad, false, error));
+    EXPECT_EQ(error.message, "description must be a string");
+}
+
+TEST(ToDoDecoderTest, DecodesBulkIds) {
+    ToDoUpdate update;
+    DecodeError error;
+    ASSERT_TRUE(ToDoDecoder::DecodeUpdate("{\"ids\": [\"" + kId1 + "\", \"" + kId2 + "\"], \"status\": \"Completed\"}",
+                                          update, true, error)) << error.Describe();
+    ASSERT_TRUE(update.ids.has_value());
+    EXPECT_EQ(*update.ids, (std::vector<std::string>{kId1, kId2}));
+
+    // Ignored where the route has no selector
+    ToDoUpdate single;
+    ASSERT_TRUE(ToDoDecoder::DecodeUpdate("{\"ids\": [\"" + kId1 + "\"]}", single, false, error));
+    EXPECT_FALSE(single.ids.has_value());
+
+    ToDoUpdate bad;
+    EXPECT_FALSE(ToDoDecoder::DecodeUpdate(R"({"ids": []})", bad, true, error));
+    EXPECT_EQ(error.message, "ids must be a non-empty array of item ids");
+    EXPECT_FALSE(ToDoDecoder::DecodeUpdate("{\"ids\": [\"" + kId1 + "\", \"nope\"]}", bad, true, error));
+    EXPECT_EQ(error.message, "ids must contain item ids (UUIDs)");
+    EXPECT_EQ(error.column, 55u);
+}
@@ -1,5 +1,5 @@
 // tests/todo_service_test.cpp
-// Unit tests for generate_id() from Utility.hpp using GoogleTest
+// Unit tests for the Utility.hpp helpers using GoogleTest
 
 #include <gtest/gtest.h>
 
@@ -59,6 +59,141 @@ TEST_F(GenerateIdTest, OnlyValidHexCharacters) {
     }
 }
 
+// parse_lsn(): LSNs compare in WAL order
+TEST(ParseLsnTest, OrdersByHighThenLowWord) {
+    EXPECT_EQ(parse_lsn("0/0"), 0u);
+    EXPECT_EQ(parse_lsn("16/B374D848"), (0x16ULL << 32) | 0xB374D848ULL);
+    EXPECT_LT(parse_lsn("0/FFFFFFFF"), parse_lsn("1/0"));
+}
+
+TEST(ParseLsnTest, MalformedInputIsZero) {
+    EXPECT_EQ(parse_lsn(""), 0u);
+    EXPECT_EQ(parse_lsn("16B374D848"), 0u);
+    EXPECT_EQ(parse_lsn("/10"), 0u);
+    EXPECT_EQ(parse_lsn("1/"), 0u);
+    EXPECT_EQ(parse_lsn("zz/10"), 0u);
+    EXPECT_EQ(parse_lsn("1/100000000"), 0u);
+}
+
+// parse_timestamp(): ISO 8601 and PostgreSQL output forms
+TEST(ParseTimestampTest, AcceptsIsoAndPostgresForms) {
+    int64_t t = 0;
+    ASSERT_TRUE(parse_timestamp("2026-01-01T00:00:00Z", t));
+    EXPECT_EQ(t, 1767225600);
+    ASSERT_TRUE(parse_timestamp("2026-01-01", t));
+    EXPECT_EQ(t, 1767225600);
+    ASSERT_TRUE(parse_timestamp("2026-01-01 05:30:00.25+05:30", t));
+    EXPECT_EQ(t, 1767225600);
+    ASSERT_TRUE(parse_timestamp("2025-12-31 19:00:00-05", t));
+    EXPECT_EQ(t, 1767225600);
+}
+
+TEST(ParseTimestampTest, RejectsGarbage) {
+    int64_t t = 0;
+    EXPECT_FALSE(parse_timestamp("", t));
+    EXPECT_FALSE(parse_timestamp("2026-13-01", t));
+    EXPECT_FALSE(parse_timestamp("2026-01-01T10", t));
+    EXPECT_FALSE(parse_timestamp("2026-01-01T10:00:00 UTC", t));
+}
+
+// format_timestamp(): PostgreSQL UTC form that parses back to the same second
+TEST(FormatTimestampTest, RoundTripsThroughParse) {
+    EXPECT_EQ(format_timestamp(1767225600), "2026-01-01 00:00:00+00");
+    EXPECT_EQ(format_timestamp(951825599), "2000-02-29 11:59:59+00");
+    EXPECT_EQ(format_timestamp(-1), "1969-12-31 23:59:59+00");
+    for (int64_t s : {int64_t(0), int64_t(1709210096), int64_t(-86401), int64_t(4102444800)}) {
+        int64_t back = 0;
+        ASSERT_TRUE(parse_timestamp(format_timestamp(s), back));
+        EXPECT_EQ(back, s);
+    }
+}
+
+// parse_pg_array(): text[] literals as returned by libpqxx
+TEST(ParsePgArrayTest, HandlesQuotingAndNulls) {
+    EXPECT_EQ(parse_pg_array("{}"), std::vector<std::string>{});
+    EXPECT_EQ(parse_pg_array("{work,home}"), (std::vector<std::string>{"work", "home"}));
+    EXPECT_EQ(parse_pg_array("{\"a b\",\"c\\\"d\",NULL}"), (std::vector<std::string>{"a b", "c\"d"}));
+    EXPECT_EQ(parse_pg_array("work"), std::vector<std::string>{});
+}
+
+// format_pg_array(): the inverse, for text[] parameters
+TEST(FormatPgArrayTest, QuotesEveryElement) {
+    EXPECT_EQ(format_pg_array({}), "{}");
+    EXPECT_EQ(format_pg_array({"work", "a b"}), "{\"work\",\"a b\"}");
+    std::vector<std::string> awkward{"c\"d", "back\\slash", "NULL", "x,y"};
+    EXPECT_EQ(parse_pg_array(format_pg_array(awkward)), awkward);
+}
+
+// build_prefix_tsquery(): words become prefix terms, operators are dropped
+TEST(BuildPrefixTsqueryTest, PrefixesEveryWord) {
+    EXPECT_EQ(build_prefix_tsquery("Buy mil"), "buy:* & mil:*");
+    EXPECT_EQ(build_prefix_tsquery("  report-2026 "), "report:* & 2026:*");
+    EXPECT_EQ(build_prefix_tsquery("a & !b | c:*"), "a:* & b:* & c:*");
+    EXPECT_EQ(build_prefix_tsquery("&|!()"), "");
+}
+
+// url_decode(): percent escapes and '+'
+TEST(UrlDecodeTest, DecodesEscapes) {
+    EXPECT_EQ(url_decode("In%20Progress"), "In Progress");
+    EXPECT_EQ(url_decode("a+b%2Cc"), "a b,c");
+    EXPECT_EQ(url_decode("100%"), "100%");
+}
+
+// ToDoFields::Parse(): whitelist, id always selected
+TEST(ToDoFieldsTest, ParsesWhitelistedFields) {
+    ToDoFields fields;
+    std::string error;
+    ASSERT_TRUE(ToDoFields::Parse("name, status", fields, error)) << error;
+    EXPECT_EQ(fields.SelectList(), "id, name, status");
+    EXPECT_TRUE(fields.Has(ToDoFields::Status));
+    EXPECT_FALSE(fields.Has(ToDoFields::Description));
+
+    EXPECT_EQ(ToDoFields{}.SelectList(), "id, name, description, due_date, status, priority, tag_ids");
+}
+
+TEST(ToDoFieldsTest, RejectsUnknownFields) {
+    ToDoFields fields;
+    std::string error;
+    EXPECT_FALSE(ToDoFields::Parse("name,password", fields, error));
+    EXPECT_NE(error.find("password"), std::string::npos);
+    EXPECT_FALSE(ToDoFields::Parse("", fields, error));
+}
+
+// is_uuid(): accepts generate_id() output only
+TEST(IsUuidTest, AcceptsCanonicalForm) {
+    EXPECT_TRUE(is_uuid(generate_id()));
+    EXPECT_FALSE(is_uuid(""));
+    EXPECT_FALSE(is_uuid("123e4567-e89b-12d3-a456-42661417400"));
+    EXPECT_FALSE(is_uuid("123e4567-e89b-12d3-a456-4266141740,0"));
+    EXPECT_FALSE(is_uuid("123e4567e89b-12d3-a456-4266141740000"));
+}
+
+// crc32(): standard check value
+TEST(Crc32Test, MatchesReferenceValues) {
+    EXPECT_EQ(crc32("", 0), 0u);
+    EXPECT_EQ(crc32("123456789", 9), 0xCBF43926u);
+}
+
+// PgPool::NoteFailure(): cancelled statements and expired deadlines mark the
+// request so that it is answered 504, other failures do not
+TEST(PgPoolCancelTest, MarksCancelledAndExpiredRequests) {
+    RequestContext ctx;
+    PgPool::NoteFailure(pqxx::sql_error("duplicate key", "INSERT", "23505"), &ctx);
+    PgPool::NoteFailure(std::runtime_error("No ToDo item found with given ID"), &ctx);
+    EXPECT_FALSE(ctx.cancelled);
+
+    EXPECT_TRUE(PgPool::IsCancellation(pqxx::query_canceled("canceling statement due to statement timeout", "SELECT", "57014")));
+    PgPool::NoteFailure(pqxx::query_canceled("canceling statement due to user request", "SELECT", "57014"), &ctx);
+    EXPECT_TRUE(ctx.cancelled);
+
+    RequestContext late;
+    late.deadline = std::chrono::steady_clock::now() - std::chrono::milliseconds(1);
+    PgPool::NoteFailure(std::runtime_error("No available database connection"), &late);
+    EXPECT_TRUE(late.cancelled);
+
+    PgPool::NoteFailure(pqxx::query_canceled("", "", "57014"), nullptr);  // calls outside a request
+}
+
 
 int main(int argc, char **argv) {
     ::testing::InitGoogleTest(&argc, argv);
@@ -0,0 +1,248 @@
+// tests/todo_snapshot_test.cpp
+// Unit tests for the columnar snapshot file and its catch-up by version
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#include "../src/ToDoSnapshot.hpp"
+#include "test_items.hpp"
+
+namespace {
+
+const std::string kOtherList = "11111111-1111-1111-1111-111111111111";
+
+std::string TempFile(const std::string& name)
+{
+    auto path = std::filesystem::temp_directory_path() / ("todo_snapshot_test_" + name + ".snap");
+    std::filesystem::remove(path);
+    return path.string();
+}
+
+// Stands in for the database: rows and tombstones with their versions, and
+// the fence the next scan reports. Its version defaults to the highest
+// visible one; by default no transaction is running.
+struct FakeTable
+{
+    std::vector<std::pair<ToDoItem, uint64_t>> rows;
+    std::vector<std::tuple<std::string, std::string, uint64_t>> tombstones;
+    VersionFence fence{0, 1, 1};
+    uint64_t last_since = 0;
+    bool fail = false;
+
+    ToDoSnapshot::ChangeScan Scan()
+    {
+        return [this](uint64_t since, const ToDoSnapshot::ItemSink& on_item, const ToDoSnapshot::DeleteSink& on_deleted,
+                      VersionFence& scan_fence) {
+            last_since = since;
+            scan_fence = fence;
+            for (const auto& [item, version] : rows) scan_fence.version = std::max(scan_fence.version, version);
+            for (const auto& [list_id, id, version] : tombstones) scan_fence.version = std::max(scan_fence.version, version);
+            for (const auto& [item, version] : rows)
+            {
+                if (version > since) on_item(item, version);
+            }
+            for (const auto& [list_id, id, version] : tombstones)
+            {
+                if (version > since) on_deleted(list_id, id, version);
+            }
+            return !fail;
+        };
+    }
+};
+
+std::map<std::string, ToDoItem> Items(const ToDoSnapshot& snapshot)
+{
+    std::map<std::string, ToDoItem> items;
+    snapshot.ForEach([&](const ToDoItem& item) { items[item.list_id + "/" + item.id] = item; });
+    return items;
+}
+
+}
+
+TEST(ToDoSnapshotTest, SaveAndLoadRoundTrip) {
+    FakeTable table;
+    ToDoItem plain = MakeItem("a", "Not Started").Due("2026-01-01 10:00:00+00").Priority(2);
+    ToDoItem other = MakeItem("b", "Completed").List(kOtherList).Description("").Tags({});
+    table.rows = {{plain, 5}, {other, 7}};
+
+    ToDoSnapshot written;
+    ASSERT_TRUE(written.CatchUp(table.Scan()));
+    auto path = TempFile("round_trip");
+    ASSERT_TRUE(written.Save(path));
+
+    ToDoSnapshot loaded;
+    ASSERT_TRUE(loaded.Load(path));
+    EXPECT_EQ(loaded.Watermark(), 7u);
+    auto items = Items(loaded);
+    ASSERT_EQ(items.size(), 2u);
+
+    const auto& a = items.at(kDefaultListId + "/a");
+    EXPECT_EQ(a.name, "name a");
+    EXPECT_EQ(a.description, "about a");
+    EXPECT_EQ(a.due_date, "2026-01-01 10:00:00+00");
+    EXPECT_EQ(a.status, "Not Started");
+    EXPECT_EQ(a.priority, 2);
+    EXPECT_EQ(a.tags, (std::vector<std::string>{"work", "home"}));
+
+    const auto& b = items.at(kOtherList + "/b");
+    EXPECT_EQ(b.status, "Completed");
+    EXPECT_EQ(b.due_date, "");
+    EXPECT_TRUE(b.tags.empty());
+}
+
+TEST(ToDoSnapshotTest, CatchUpAppliesOnlyNewerVersions) {
+    FakeTable table;
+    table.rows = {{MakeItem("a", "Not Started"), 10}, {MakeItem("b", "Not Started"), 11}};
+    table.fence = {0, 5, 6};
+    ToDoSnapshot snapshot;
+    ASSERT_TRUE(snapshot.CatchUp(table.Scan()));
+    EXPECT_EQ(table.last_since, 0u);
+
+    // "a" updated, "b" deleted, and a stale image of "a" reread below the
+    // highest version seen while the first fence was open
+    table.fence = {0, 6, 6};
+    table.rows = {{MakeItem("a", "Not Started"), 10}, {MakeItem("a", "Completed"), 20}};
+    table.tombstones = {{kDefaultListId, "b", 21}, {kDefaultListId, "gone", 3}};
+    ASSERT_TRUE(snapshot.CatchUp(table.Scan()));
+
+    auto items = Items(snapshot);
+    ASSERT_EQ(items.size(), 1u);
+    EXPECT_EQ(items.at(kDefaultListId + "/a").status, "Completed");
+    EXPECT_EQ(snapshot.Watermark(), 21u);
+}
+
+TEST(ToDoSnapshotTest, ChangesAfterLoadMergeWithTheFile) {
+    FakeTable table;
+    table.rows = {{MakeItem("b", "Not Started"), 1}, {MakeItem("d", "Not Started"), 2},
+                  {MakeItem("f", "Not Started"), 3}};
+    ToDoSnapshot written;
+    ASSERT_TRUE(written.CatchUp(table.Scan()));
+    auto path = TempFile("merge");
+    ASSERT_TRUE(written.Save(path));
+
+    ToDoSnapshot snapshot;
+    ASSERT_TRUE(snapshot.Load(path));
+    table.rows = {{MakeItem("a", "In Progress"), 4}, {MakeItem("d", "Completed"), 5},
+                  {MakeItem("g", "In Progress"), 6}};
+    table.tombstones = {{kDefaultListId, "f", 7}};
+    ASSERT_TRUE(snapshot.CatchUp(table.Scan()));
+
+    std::vector<std::string> order;
+    snapshot.ForEach([&](const ToDoItem& item) { order.push_back(item.id + ":" + item.status); });
+    EXPECT_EQ(order, (std::vector<std::string>{"a:In Progress", "b:Not Started", "d:Completed", "g:In Progress"}));
+
+    // Saving folds the changes into the file
+    ASSERT_TRUE(snapshot.Save(path));
+    ToDoSnapshot reloaded;
+    ASSERT_TRUE(reloaded.Load(path));
+    EXPECT_EQ(reloaded.Watermark(), 7u);
+    EXPECT_EQ(reloaded.Size(), 4u);
+    EXPECT_EQ(Items(reloaded).at(kDefaultListId + "/d").status, "Completed");
+}
+
+TEST(ToDoSnapshotTest, WatermarkWaitsForTransactionsOpenAtTheFence) {
+    FakeTable table;
+    table.rows = {{MakeItem("a", "Not Started"), 5}, {MakeItem("b", "Not Started"), 7}};
+    // Transaction 10 drew version 6 and has not committed yet
+    table.fence = {7, 10, 12};
+    ToDoSnapshot snapshot;
+    ASSERT_TRUE(snapshot.CatchUp(table.Scan()));
+    EXPECT_EQ(snapshot.Watermark(), 0u);
+
+    // It commits below the highest version seen; the fence is now settled
+    table.rows.push_back({MakeItem("late", "In Progress"), 6});
+    table.rows.push_back({MakeItem("c", "Not Started"), 9});
+    table.fence = {0, 12, 14};
+    ASSERT_TRUE(snapshot.CatchUp(table.Scan()));
+    EXPECT_EQ(table.last_since, 0u);
+    EXPECT_EQ(Items(snapshot).count(kDefaultListId + "/late"), 1u);
+    EXPECT_EQ(snapshot.Watermark(), 7u);
+
+    table.fence = {0, 14, 14};
+    ASSERT_TRUE(snapshot.CatchUp(table.Scan()));
+    EXPECT_EQ(table.last_since, 7u);
+    EXPECT_EQ(snapshot.Watermark(), 9u);
+}
+
+TEST(ToDoSnapshotTest, LongTransactionHoldsTheWatermark) {
+    FakeTable table;
+    table.rows = {{MakeItem("a", "Not Started"), 3}};
+    ToDoSnapshot snapshot;
+    ASSERT_TRUE(snapshot.CatchUp(table.Scan()));
+    EXPECT_EQ(snapshot.Watermark(), 3u);
+
+    // Transaction 20 stays open across many catch-ups and version draws
+    table.fence = {0, 20, 21};
+    for (uint64_t version = 100; version <= 100000; version *= 10)
+    {
+        table.rows.push_back({MakeItem(std::to_string(version), "Not Started"), version});
+        ASSERT_TRUE(snapshot.CatchUp(table.Scan()));
+        EXPECT_EQ(table.last_since, 3u);
+        EXPECT_EQ(snapshot.Watermark(), 3u);
+    }
+
+    // Its row commits with a version it drew before all the others
+    table.rows.push_back({MakeItem("bulk", "Completed"), 4});
+    table.fence = {0, 21, 21};
+    ASSERT_TRUE(snapshot.CatchUp(table.Scan()));
+    EXPECT_EQ(Items(snapshot).count(kDefaultListId + "/bulk"), 1u);
+    EXPECT_EQ(snapshot.Watermark(), 100000u);
+}
+
+TEST(ToDoSnapshotTest, PendingFenceSurvivesSaveAndLoad) {
+    FakeTable table;
+    table.rows = {{MakeItem("a", "Not Started"), 5}};
+    table.fence = {6, 10, 11};
+    ToDoSnapshot written;
+    ASSERT_TRUE(written.CatchUp(table.Scan()));
+    auto path = TempFile("pending_fence");
+    ASSERT_TRUE(written.Save(path));
+
+    ToDoSnapshot loaded;
+    ASSERT_TRUE(loaded.Load(path));
+    EXPECT_EQ(loaded.Watermark(), 0u);
+    table.rows.push_back({MakeItem("late", "Not Started"), 6});
+    table.fence = {0, 11, 12};
+    ASSERT_TRUE(loaded.CatchUp(table.Scan()));
+    EXPECT_EQ(table.last_since, 0u);
+    EXPECT_EQ(loaded.Size(), 2u);
+    EXPECT_EQ(loaded.Watermark(), 6u);
+}
+
+TEST(ToDoSnapshotTest, FailedScanKeepsWatermark) {
+    FakeTable table;
+    table.rows = {{MakeItem("a", "Not Started"), 4}};
+    ToDoSnapshot snapshot;
+    ASSERT_TRUE(snapshot.CatchUp(table.Scan()));
+
+    table.rows.push_back({MakeItem("b", "Not Started"), 9});
+    table.fail = true;
+    EXPECT_FALSE(snapshot.CatchUp(table.Scan()));
+    EXPECT_EQ(snapshot.Watermark(), 4u);
+}
+
+TEST(ToDoSnapshotTest, RejectsCorruptOrMissingFile) {
+    FakeTable table;
+    table.rows = {{MakeItem("a", "Not Started"), 1}};
+    ToDoSnapshot written;
+    ASSERT_TRUE(written.CatchUp(table.Scan()));
+    auto path = TempFile("corrupt");
+    ASSERT_TRUE(written.Save(path));
+
+    {
+        std::fstream file(path, std::ios::in | std::ios::out | std::ios::binary);
+        file.seekp(-1, std::ios::end);
+        file.put('\x7f');
+    }
+    ToDoSnapshot loaded;
+    EXPECT_FALSE(loaded.Load(path));
+    EXPECT_FALSE(loaded.Load(TempFile("missing")));
+    EXPECT_EQ(loaded.Size(), 0u);
+}
@@ -0,0 +1,119 @@
+// tests/todo_stats_test.cpp
+// Unit tests for the incrementally maintained ToDoStats counters
+
+#include <gtest/gtest.h>
+
+#include <string>
+#include <vector>
+
+#include "../src/ToDoStats.hpp"
+#include "test_items.hpp"
+
+namespace {
+
+const int64_t kNow = 1767225600;  // 2026-01-01T00:00:00Z
+
+}
+
+TEST(ToDoStatsTest, CountsFollowCreateUpdateDelete) {
+    ToDoStats stats;
+    ToDoItem a = MakeItem("a", "Not Started").Priority(1);
+    ToDoItem b = MakeItem("b", "In Progress").Tags({"work"});
+    stats.OnCreated(a);
+    stats.OnCreated(b);
+
+    auto json = stats.ToJson(kNow);
+    EXPECT_EQ(json.at("total").as_int64(), 2);
+    EXPECT_EQ(json.at("by_status").at("Not Started").as_int64(), 1);
+    EXPECT_EQ(json.at("by_priority").at("3").as_int64(), 1);
+    EXPECT_EQ(json.at("by_tag").at("work").as_int64(), 2);
+
+    auto b2 = b;
+    b2.status = "Completed";
+    b2.tags = {"home"};
+    stats.OnUpdated(b, b2);
+    stats.OnDeleted(a);
+
+    json = stats.ToJson(kNow);
+    EXPECT_EQ(json.at("total").as_int64(), 1);
+    EXPECT_FALSE(json.at("by_status").as_object().contains("Not Started"));
+    EXPECT_EQ(json.at("by_status").at("Completed").as_int64(), 1);
+    EXPECT_FALSE(json.at("by_tag").as_object().contains("work"));
+    EXPECT_EQ(json.at("by_tag").at("home").as_int64(), 1);
+}
+
+TEST(ToDoStatsTest, OverdueAdvancesWithTime) {
+    ToDoStats stats;
+    stats.Overdue(kNow);  // pin the watermark
+
+    ToDoItem past   = MakeItem("p", "Not Started").Due("2025-12-31T00:00:00Z").Tags({});
+    ToDoItem soon   = MakeItem("s", "In Progress").Due("2026-01-01 01:00:00+00").Tags({});
+    ToDoItem closed = MakeItem("c", "Completed").Due("2025-12-01").Tags({});
+    stats.OnCreated(past);
+    stats.OnCreated(soon);
+    stats.OnCreated(closed);
+
+    EXPECT_EQ(stats.Overdue(kNow), 1);
+    EXPECT_EQ(stats.Overdue(kNow + 2 * 3600), 2);
+
+    // Completing an overdue item takes it out of the count
+    auto done = soon;
+    done.status = "Completed";
+    stats.OnUpdated(soon, done);
+    EXPECT_EQ(stats.Overdue(kNow + 2 * 3600), 1);
+
+    stats.OnDeleted(past);
+    EXPECT_EQ(stats.Overdue(kNow + 2 * 3600), 0);
+}
+
+TEST(ToDoStatsTest, BulkImportAddsTheImportedRows) {
+    ToDoStats stats;
+    stats.Overdue(kNow);
+    ToDoItem a = MakeItem("a", "Not Started").Priority(1).Tags({"work"});
+    stats.OnCreated(a);
+
+    // Imported rows are applied as they are, so a write that lands while the
+    // import runs is kept
+    stats.OnBulkImport({MakeItem("b", "Not Started").Priority(2).Due("2025-12-31").Tags({"work"}),
+                        MakeItem("c", "Completed").Priority(2).Tags({})});
+    auto a2 = a;
+    a2.status = "Completed";
+    stats.OnUpdated(a, a2);
+
+    auto json = stats.ToJson(kNow);
+    EXPECT_EQ(json.at("total").as_int64(), 3);
+    EXPECT_EQ(json.at("by_status").at("Completed").as_int64(), 2);
+    EXPECT_EQ(json.at("by_priority").at("2").as_int64(), 2);
+    EXPECT_EQ(json.at("by_tag").at("work").as_int64(), 2);
+    EXPECT_EQ(json.at("overdue").as_int64(), 1);
+}
+
+TEST(ToDoStatsTest, ListsKeepTheirOwnCounts) {
+    ToDoStats stats;
+    stats.Overdue(kNow);
+
+    const std::string other = "11111111-1111-1111-1111-111111111111";
+    ToDoItem a = MakeItem("a", "Not Started").Priority(1).Due("2025-12-31T00:00:00Z").Tags({"work"});
+    ToDoItem b = MakeItem("b", "Completed").Priority(2).Tags({"home"}).List(other);
+    stats.OnCreated(a);
+    stats.OnCreated(b);
+
+    auto all = stats.ToJson(kNow);
+    EXPECT_EQ(all.at("total").as_int64(), 2);
+    EXPECT_EQ(all.at("overdue").as_int64(), 1);
+
+    auto mine = stats.ListJson(kDefaultListId, kNow);
+    EXPECT_EQ(mine.at("total").as_int64(), 1);
+    EXPECT_EQ(mine.at("overdue").as_int64(), 1);
+    EXPECT_EQ(mine.at("by_tag").at("work").as_int64(), 1);
+    EXPECT_FALSE(mine.at("by_tag").as_object().contains("home"));
+
+    auto theirs = stats.ListJson(other, kNow);
+    EXPECT_EQ(theirs.at("total").as_int64(), 1);
+    EXPECT_EQ(theirs.at("overdue").as_int64(), 0);
+    EXPECT_EQ(theirs.at("by_status").at("Completed").as_int64(), 1);
+
+    stats.OnDeleted(b);
+    EXPECT_EQ(stats.ListJson(other, kNow).at("total").as_int64(), 0);
+    EXPECT_EQ(stats.ToJson(kNow).at("total").as_int64(), 1);
+}